@@ -0,0 +1,148 @@
+/// @file concurrent_map_bench.c
+///
+/// Benchmark for implementations of ADT Concurrent Map.
+///
+/// Threads look up and overwrite random int keys of a shared map, at various
+/// thread counts and read ratios. The same workload also runs on a Map guarded
+/// by a single mutex, the alternative to a concurrent map.
+
+#include "concurrent_map.h"
+
+#include <pthread.h> // pthread_create, pthread_join, pthread_mutex_t
+#include <stdint.h>  // uint64_t
+#include <stdio.h>   // printf
+#include <stdlib.h>  // malloc, free
+
+#include "bench_companion.h"
+
+static int compare_ints(const void *a, const void *b) {
+  return *(int *)a - *(int *)b;
+}
+
+/// @brief The map under test, and the work of one thread.
+///
+struct worker {
+  ConcurrentMap concurrent; // Used if not NULL, otherwise map and mutex.
+  Map map;
+  pthread_mutex_t *mutex;
+
+  int *keys;
+  size_t key_count;
+  size_t operations;
+  int read_percent;
+  uint64_t random; // State of the thread's xorshift generator.
+  size_t found;
+};
+
+/// @brief Returns the next number of the xorshift64 generator.
+///
+static uint64_t next_random(uint64_t *state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 7;
+  *state ^= *state << 17;
+  return *state;
+}
+
+static void *work(void *argument) {
+  struct worker *w = argument;
+
+  for (size_t i = 0; i < w->operations; i++) {
+    uint64_t random = next_random(&w->random);
+    int *key = &w->keys[(random >> 8) % w->key_count];
+    bool read = (int)(random & 0xFF) * 100 < w->read_percent * 256;
+
+    if (w->concurrent != NULL) {
+      if (read)
+        w->found += concurrent_map_find(w->concurrent, key) != NULL;
+      else
+        concurrent_map_insert(w->concurrent, key, key);
+    } else {
+      pthread_mutex_lock(w->mutex);
+      if (read)
+        w->found += map_find(w->map, key) != NULL;
+      else
+        map_insert(w->map, key, key);
+      pthread_mutex_unlock(w->mutex);
+    }
+  }
+
+  return NULL;
+}
+
+/// @brief Runs operations split over thread_count threads, and returns the
+/// throughput in millions of operations per second.
+///
+static double run(struct worker *prototype, int thread_count) {
+  pthread_t threads[thread_count];
+  struct worker workers[thread_count];
+
+  double start = bench_wall_now();
+  for (int t = 0; t < thread_count; t++) {
+    workers[t] = *prototype;
+    workers[t].operations = prototype->operations / thread_count;
+    workers[t].random = 0x9e3779b97f4a7c15ull * (t + 1);
+    pthread_create(&threads[t], NULL, work, &workers[t]);
+  }
+
+  size_t found = 0;
+  for (int t = 0; t < thread_count; t++) {
+    pthread_join(threads[t], NULL);
+    found += workers[t].found;
+  }
+  double seconds = bench_wall_now() - start;
+
+  if (found == 0 && prototype->read_percent > 0)
+    printf("Unexpected result: no key found\n");
+
+  return prototype->operations / seconds / 1e6;
+}
+
+int main(int argc, char *argv[]) {
+  size_t N = bench_size(argc, argv, 1000000);
+  size_t operations = 4 * N;
+
+  int *keys = malloc(N * sizeof(*keys));
+  for (size_t i = 0; i < N; i++)
+    keys[i] = i;
+
+  ConcurrentMap concurrent =
+      concurrent_map_create(compare_ints, NULL, NULL, hash_int, 0);
+  Map map = map_create(compare_ints, NULL, NULL);
+  map_set_hash_function(map, hash_int);
+  pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+
+  for (size_t i = 0; i < N; i++) {
+    concurrent_map_insert(concurrent, &keys[i], &keys[i]);
+    map_insert(map, &keys[i], &keys[i]);
+  }
+
+  printf("%s: %zu int keys, %zu operations per run\n", argv[0], N,
+         operations);
+  printf("%-8s %-8s %16s %16s\n", "threads", "reads", "mutex Mops/s",
+         "concurrent Mops/s");
+
+  int read_percents[] = {100, 90, 50};
+  int thread_counts[] = {1, 2, 4, 8, 16, 32, 64};
+
+  for (size_t r = 0; r < sizeof(read_percents) / sizeof(int); r++) {
+    for (size_t t = 0; t < sizeof(thread_counts) / sizeof(int); t++) {
+      struct worker prototype = {NULL, map,        &mutex,
+                                 keys, N,          operations,
+                                 read_percents[r], 0,
+                                 0};
+      double locked = run(&prototype, thread_counts[t]);
+
+      prototype.concurrent = concurrent;
+      double striped = run(&prototype, thread_counts[t]);
+
+      printf("%-8d %6d%% %16.2f %16.2f\n", thread_counts[t], read_percents[r],
+             locked, striped);
+    }
+  }
+
+  concurrent_map_destroy(concurrent);
+  map_destroy(map);
+  free(keys);
+
+  return 0;
+}
@@ -0,0 +1,91 @@
+/// @file frozen_map_bench.c
+///
+/// Benchmark for ADT FrozenMap.
+///
+/// Measures the build of a frozen map from the Map linked in, and its lookups
+/// next to the lookups of that Map, with the same string keys.
+
+#include "frozen_map.h"
+
+#include <stdio.h>  // printf, snprintf
+#include <stdlib.h> // malloc, free
+#include <string.h> // strcmp, strdup
+
+#include "bench_companion.h"
+
+static int compare_strings(const void *a, const void *b) {
+  return strcmp(a, b);
+}
+
+int main(int argc, char *argv[]) {
+  size_t N = bench_size(argc, argv, 1000000);
+
+  char buffer[64];
+  void **keys = malloc(N * sizeof(*keys));
+  void **missing = malloc(N * sizeof(*missing));
+  for (size_t i = 0; i < N; i++) {
+    snprintf(buffer, sizeof(buffer), "key:%zu", i);
+    keys[i] = strdup(buffer);
+    snprintf(buffer, sizeof(buffer), "missing:%zu", i);
+    missing[i] = strdup(buffer);
+  }
+
+  // Look up the keys in random order, so that neither map is helped by the
+  // order of insertion.
+  size_t *order = malloc(N * sizeof(*order));
+  for (size_t i = 0; i < N; i++)
+    order[i] = i;
+  bench_shuffle(order, N);
+
+  printf("%s: %zu string keys\n", argv[0], N);
+
+  size_t heap = bench_heap_usage();
+  Map map = map_create(compare_strings, NULL, NULL);
+  map_set_hash_function(map, hash_string);
+  for (size_t i = 0; i < N; i++)
+    map_insert(map, keys[i], keys[i]);
+  bench_report_memory("map_insert", N, bench_heap_usage() - heap);
+
+  heap = bench_heap_usage();
+  double start = bench_now();
+  FrozenMap frozen = frozen_map_build(map, compare_strings, hash_string);
+  bench_report("frozen_map_build", N, bench_now() - start);
+  bench_report_memory("frozen_map_build", N, bench_heap_usage() - heap);
+
+  size_t found = 0;
+  start = bench_now();
+  for (size_t i = 0; i < N; i++)
+    found += map_find(map, keys[order[i]]) != NULL;
+  bench_report("map_find (hit)", N, bench_now() - start);
+
+  start = bench_now();
+  for (size_t i = 0; i < N; i++)
+    found += frozen_map_find(frozen, keys[order[i]]) != NULL;
+  bench_report("frozen_map_find (hit)", N, bench_now() - start);
+
+  start = bench_now();
+  for (size_t i = 0; i < N; i++)
+    found += map_find(map, missing[order[i]]) != NULL;
+  bench_report("map_find (miss)", N, bench_now() - start);
+
+  start = bench_now();
+  for (size_t i = 0; i < N; i++)
+    found += frozen_map_find(frozen, missing[order[i]]) != NULL;
+  bench_report("frozen_map_find (miss)", N, bench_now() - start);
+
+  if (found != 2 * N)
+    printf("Unexpected result: found %zu of %zu\n", found, 2 * N);
+
+  frozen_map_destroy(frozen);
+  map_destroy(map);
+
+  for (size_t i = 0; i < N; i++) {
+    free(keys[i]);
+    free(missing[i]);
+  }
+  free(keys);
+  free(missing);
+  free(order);
+
+  return 0;
+}
@@ -0,0 +1,92 @@
+/// @file hash_bench.c
+///
+/// Benchmark for the hash functions of hash.h.
+///
+/// Measures the throughput of hashing strings of various lengths, and the time
+/// per hash of integers and pointers, next to the hash functions of map.c.
+
+#include "hash.h"
+
+#include <stdint.h> // uint64_t
+#include <stdio.h>  // printf, snprintf
+#include <stdlib.h> // malloc, free, rand
+#include <string.h> // strlen
+
+#include "bench_companion.h"
+#include "map.h" // hash_string, hash_int
+
+int main(int argc, char *argv[]) {
+  // Total bytes hashed for each string length.
+  size_t N = bench_size(argc, argv, 1 << 28);
+
+  printf("%s: %zu bytes per length\n", argv[0], N);
+
+  size_t lengths[] = {4, 16, 64, 256, 4096, 1 << 20};
+  size_t buffer_size = 1 << 20;
+  char *buffer = malloc(buffer_size + 1);
+  for (size_t i = 0; i < buffer_size; i++)
+    buffer[i] = 'a' + rand() % 26;
+  buffer[buffer_size] = '\0';
+
+  // Accumulate the hashes, so that the compiler keeps the calls.
+  uint64_t sum = 0;
+  uint64_t seed = hash_seed();
+
+  for (size_t l = 0; l < sizeof(lengths) / sizeof(*lengths); l++) {
+    size_t length = lengths[l];
+    size_t count = N / length;
+    char name[64];
+
+    // Strings at different offsets of the buffer, as they would be in a map.
+    double start = bench_now();
+    for (size_t i = 0; i < count; i++) {
+      size_t offset = (i * 64) % (buffer_size - length + 1);
+      sum += hash_bytes(buffer + offset, length, seed);
+    }
+    snprintf(name, sizeof(name), "hash_bytes (%zu B)", length);
+    bench_report_throughput(name, count * length, bench_now() - start);
+
+    // hash_string needs NUL terminated strings, so hash the end of the buffer.
+    char *string = buffer + buffer_size - length;
+    start = bench_now();
+    for (size_t i = 0; i < count; i++) {
+      string[0] = 'a' + i % 26; // Keep the compiler from hoisting the call.
+      sum += hash_string(string);
+    }
+    snprintf(name, sizeof(name), "hash_string (%zu B)", length);
+    bench_report_throughput(name, count * length, bench_now() - start);
+  }
+
+  size_t M = N / 8;
+
+  double start = bench_now();
+  for (size_t i = 0; i < M; i++)
+    sum += hash_u64(i, seed);
+  bench_report("hash_u64", M, bench_now() - start);
+
+  start = bench_now();
+  for (size_t i = 0; i < M; i++) {
+    int key = i;
+    sum += hash_int_seeded(&key);
+  }
+  bench_report("hash_int_seeded", M, bench_now() - start);
+
+  start = bench_now();
+  for (size_t i = 0; i < M; i++) {
+    int key = i;
+    sum += hash_int(&key);
+  }
+  bench_report("hash_int", M, bench_now() - start);
+
+  start = bench_now();
+  for (size_t i = 0; i < M; i++)
+    sum += hash_pointer_seeded(buffer + i);
+  bench_report("hash_pointer_seeded", M, bench_now() - start);
+
+  // Print the sum, so that it is not optimized out.
+  printf("(checksum %llu)\n", (unsigned long long)sum);
+
+  free(buffer);
+
+  return 0;
+}
@@ -0,0 +1,106 @@
+/// @file int_map_bench.c
+///
+/// Benchmark for the maps of int_map.h.
+///
+/// Measures U64Map next to the Map linked in, holding the same uint64_t keys
+/// and values boxed in allocated memory, as map.h requires.
+
+#include "int_map.h"
+
+#include <stdint.h> // uint64_t
+#include <stdio.h>  // printf
+#include <stdlib.h> // malloc, free
+
+#include "bench_companion.h"
+#include "map.h"
+
+static int compare_u64(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+static unsigned int hash_u64_boxed(void *value) {
+  return (unsigned int)int_map_hash(*(uint64_t *)value);
+}
+
+static uint64_t *create_u64(uint64_t value) {
+  uint64_t *pointer = malloc(sizeof(*pointer));
+  *pointer = value;
+  return pointer;
+}
+
+int main(int argc, char *argv[]) {
+  size_t N = bench_size(argc, argv, 1000000);
+
+  // Random distinct keys (splitmix64 is a bijection), and keys not inserted.
+  uint64_t *keys = malloc(N * sizeof(*keys));
+  uint64_t *missing = malloc(N * sizeof(*missing));
+  for (size_t i = 0; i < N; i++) {
+    keys[i] = int_map_hash(2 * i);
+    missing[i] = int_map_hash(2 * i + 1);
+  }
+
+  printf("%s: %zu uint64_t keys\n", argv[0], N);
+
+  // Accumulate the values found, so that the compiler keeps the lookups.
+  uint64_t sum = 0;
+
+  size_t heap = bench_heap_usage();
+  double start = bench_now();
+  U64Map u64_map = u64_map_create();
+  for (size_t i = 0; i < N; i++)
+    u64_map_insert(u64_map, keys[i], i);
+  bench_report("u64_map_insert", N, bench_now() - start);
+  bench_report_memory("u64_map_insert", N, bench_heap_usage() - heap);
+
+  start = bench_now();
+  for (size_t i = 0; i < N; i++)
+    sum += *u64_map_find(u64_map, keys[i]);
+  bench_report("u64_map_find (hit)", N, bench_now() - start);
+
+  start = bench_now();
+  for (size_t i = 0; i < N; i++)
+    sum += u64_map_find(u64_map, missing[i]) != NULL;
+  bench_report("u64_map_find (miss)", N, bench_now() - start);
+
+  start = bench_now();
+  for (size_t i = 0; i < N; i++)
+    u64_map_remove(u64_map, keys[i]);
+  bench_report("u64_map_remove", N, bench_now() - start);
+  u64_map_destroy(u64_map);
+
+  // The same operations on a Map, with the keys and values boxed.
+  heap = bench_heap_usage();
+  start = bench_now();
+  Map map = map_create(compare_u64, free, free);
+  map_set_hash_function(map, hash_u64_boxed);
+  for (size_t i = 0; i < N; i++)
+    map_insert(map, create_u64(keys[i]), create_u64(i));
+  bench_report("map_insert (boxed)", N, bench_now() - start);
+  bench_report_memory("map_insert (boxed)", N, bench_heap_usage() - heap);
+
+  start = bench_now();
+  for (size_t i = 0; i < N; i++)
+    sum += *(uint64_t *)map_find(map, &keys[i]);
+  bench_report("map_find (boxed, hit)", N, bench_now() - start);
+
+  start = bench_now();
+  for (size_t i = 0; i < N; i++)
+    sum += map_find(map, &missing[i]) != NULL;
+  bench_report("map_find (boxed, miss)", N, bench_now() - start);
+
+  start = bench_now();
+  for (size_t i = 0; i < N; i++)
+    map_remove(map, &keys[i]);
+  bench_report("map_remove (boxed)", N, bench_now() - start);
+  map_destroy(map);
+
+  uint64_t expected = 2 * ((uint64_t)N * (N - 1) / 2);
+  if (sum != expected)
+    printf("Unexpected sum of values: %llu\n", (unsigned long long)sum);
+
+  free(keys);
+  free(missing);
+
+  return 0;
+}
@@ -0,0 +1,187 @@
+/// @file map_bench.c
+///
+/// Benchmark for implementations of ADT Map.
+///
+/// Measures the basic operations of a map with string keys, hashed with
+/// hash_string. Link against different implementations to compare them.
+
+#include "map.h"
+
+#include <stdio.h>  // printf, snprintf
+#include <stdlib.h> // malloc, free
+#include <string.h> // strcmp, strdup
+
+#include "bench_companion.h"
+
+static int compare_strings(const void *a, const void *b) {
+  return strcmp(a, b);
+}
+
+/// @brief Creates size strings of the form "<prefix><i>".
+///
+static char **create_strings(size_t size, const char *prefix) {
+  char **array = malloc(size * sizeof(*array));
+  char buffer[64];
+  for (size_t i = 0; i < size; i++) {
+    snprintf(buffer, sizeof(buffer), "%s%zu", prefix, i);
+    array[i] = strdup(buffer);
+  }
+  return array;
+}
+
+int main(int argc, char *argv[]) {
+  size_t N = bench_size(argc, argv, 1000000);
+
+  char **keys = create_strings(N, "key:");
+  char **missing = create_strings(N, "missing:");
+
+  // Look keys up in a different order than the one they were inserted in.
+  size_t *order = malloc(N * sizeof(*order));
+  for (size_t i = 0; i < N; i++)
+    order[i] = i;
+  bench_shuffle(order, N);
+
+  printf("%s: %zu string keys\n", argv[0], N);
+
+  // Fill a map timing each insertion separately, to find the slowest one.
+  // (e.g. the one that resizes the table) It runs first and its map is kept
+  // until the end, so that no memory has been freed yet: reusing freed memory
+  // can stall malloc, which would hide the behaviour of the map.
+  Map latency_map = map_create(compare_strings, NULL, NULL);
+  map_set_hash_function(latency_map, hash_string);
+
+  double slowest = 0;
+  for (size_t i = 0; i < N; i++) {
+    double start = bench_now();
+    map_insert(latency_map, keys[i], keys[i]);
+    double elapsed = bench_now() - start;
+    if (elapsed > slowest)
+      slowest = elapsed;
+  }
+  printf("%-32s %10.1f us\n", "map_insert (slowest)", slowest * 1e6);
+
+  // Memory of many small maps, and of a map sized for N elements before
+  // anything is inserted.
+  size_t MAPS = 10000;
+  Map *maps = malloc(MAPS * sizeof(*maps));
+  size_t heap = bench_heap_usage();
+  double start = bench_now();
+  for (size_t i = 0; i < MAPS; i++) {
+    maps[i] = map_create(compare_strings, NULL, NULL);
+    map_set_hash_function(maps[i], hash_string);
+    for (size_t j = 0; j < 4 && j < N; j++)
+      map_insert(maps[i], keys[j], keys[j]);
+  }
+  bench_report("map_create (4 keys)", MAPS, bench_now() - start);
+  bench_report_memory("map_create (4 keys)", MAPS,
+                      bench_heap_usage() - heap);
+  for (size_t i = 0; i < MAPS; i++)
+    map_destroy(maps[i]);
+  free(maps);
+
+  heap = bench_heap_usage();
+  Map empty = map_create_with_capacity(compare_strings, NULL, NULL, N);
+  bench_report_memory("map_create_with_capacity (empty)", N,
+                      bench_heap_usage() - heap);
+  map_destroy(empty);
+
+  Map map = map_create(compare_strings, NULL, NULL);
+  map_set_hash_function(map, hash_string);
+
+  heap = bench_heap_usage();
+  start = bench_now();
+  for (size_t i = 0; i < N; i++)
+    map_insert(map, keys[i], keys[i]);
+  bench_report("map_insert", N, bench_now() - start);
+  bench_report_memory("map_insert", N, bench_heap_usage() - heap);
+
+  Map presized = map_create_with_capacity(compare_strings, NULL, NULL, N);
+  map_set_hash_function(presized, hash_string);
+
+  start = bench_now();
+  for (size_t i = 0; i < N; i++)
+    map_insert(presized, keys[i], keys[i]);
+  bench_report("map_insert (presized)", N, bench_now() - start);
+  map_destroy(presized);
+
+  size_t found = 0;
+  start = bench_now();
+  for (size_t i = 0; i < N; i++)
+    found += map_find(map, keys[order[i]]) != NULL;
+  bench_report("map_find (hit)", N, bench_now() - start);
+
+  start = bench_now();
+  for (size_t i = 0; i < N; i++)
+    found += map_find(map, missing[order[i]]) != NULL;
+  bench_report("map_find (miss)", N, bench_now() - start);
+
+  // The same lookups, batched. They only hide the cache misses of the map when
+  // it does not fit in the last level cache, e.g. for 4000000 keys.
+  void **batch = malloc(N * sizeof(*batch));
+  void **values = malloc(N * sizeof(*values));
+  for (size_t i = 0; i < N; i++)
+    batch[i] = keys[order[i]];
+
+  size_t batch_found = 0;
+  start = bench_now();
+  map_find_batch(map, batch, N, values);
+  bench_report("map_find_batch (hit)", N, bench_now() - start);
+  for (size_t i = 0; i < N; i++)
+    batch_found += values[i] != NULL;
+
+  for (size_t i = 0; i < N; i++)
+    batch[i] = missing[order[i]];
+
+  start = bench_now();
+  map_find_batch(map, batch, N, values);
+  bench_report("map_find_batch (miss)", N, bench_now() - start);
+  for (size_t i = 0; i < N; i++)
+    batch_found += values[i] != NULL;
+
+  Map batched = map_create(compare_strings, NULL, NULL);
+  map_set_hash_function(batched, hash_string);
+
+  start = bench_now();
+  map_insert_batch(batched, (void **)keys, N, (void **)keys);
+  bench_report("map_insert_batch", N, bench_now() - start);
+  map_destroy(batched);
+
+  size_t visited = 0;
+  start = bench_now();
+  for (MapNode node = map_first(map); node != MAP_EOF;
+       node = map_next(map, node))
+    visited++;
+  bench_report("map_first/map_next", visited, bench_now() - start);
+
+  size_t iterated = 0;
+  start = bench_now();
+  for (MapIterator iter = map_iter_begin(map); map_iter_valid(map, &iter);
+       map_iter_next(map, &iter))
+    iterated++;
+  bench_report("map_iter_begin/map_iter_next", iterated, bench_now() - start);
+
+  start = bench_now();
+  for (size_t i = 0; i < N; i++)
+    map_remove(map, keys[order[i]]);
+  bench_report("map_remove", N, bench_now() - start);
+
+  if (found != N || batch_found != N || visited != N || iterated != N)
+    printf("Unexpected result: found %zu, batch found %zu, visited %zu, "
+           "iterated %zu\n",
+           found, batch_found, visited, iterated);
+
+  map_destroy(map);
+  map_destroy(latency_map);
+
+  for (size_t i = 0; i < N; i++) {
+    free(keys[i]);
+    free(missing[i]);
+  }
+  free(keys);
+  free(missing);
+  free(order);
+  free(batch);
+  free(values);
+
+  return 0;
+}
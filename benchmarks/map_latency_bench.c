@@ -0,0 +1,113 @@
+/// @file map_latency_bench.c
+///
+/// Tail latency benchmark for implementations of ADT Map.
+///
+/// Times every single lookup of a map, and reports the median, the 99th and
+/// 99.9th percentiles and the maximum, where map_bench.c reports averages. Link
+/// against different implementations to compare them.
+///
+/// The default size, 1415000 keys, fills HashTable right below its maximum
+/// load factor (0.9 of 1572869 buckets), where its chains are the longest.
+
+#include "map.h"
+
+#include <stdio.h>  // printf, snprintf
+#include <stdlib.h> // malloc, free
+#include <string.h> // strcmp, strdup
+
+#include "bench_companion.h"
+
+static int compare_strings(const void *a, const void *b) {
+  return strcmp(a, b);
+}
+
+static int compare_ints(const void *a, const void *b) {
+  return *(int *)a - *(int *)b;
+}
+
+/// @brief Times map_find() on each of the N keys, in the given order, and
+/// reports the latencies.
+///
+static void report_find(const char *name, Map map, void **keys, size_t *order,
+                        size_t N, double *latencies) {
+  size_t found = 0;
+  for (size_t i = 0; i < N; i++) {
+    void *key = keys[order[i]];
+    double start = bench_wall_now();
+    found += map_find(map, key) != NULL;
+    latencies[i] = bench_wall_now() - start;
+  }
+  bench_report_latency(name, latencies, N);
+
+  if (found != 0 && found != N)
+    printf("Unexpected result: found %zu of %zu\n", found, N);
+}
+
+int main(int argc, char *argv[]) {
+  size_t N = bench_size(argc, argv, 1415000);
+
+  char buffer[64];
+  void **strings = malloc(N * sizeof(*strings));
+  void **missing = malloc(N * sizeof(*missing));
+  int *ints = malloc(N * sizeof(*ints));
+  void **int_keys = malloc(N * sizeof(*int_keys));
+  for (size_t i = 0; i < N; i++) {
+    snprintf(buffer, sizeof(buffer), "key:%zu", i);
+    strings[i] = strdup(buffer);
+    snprintf(buffer, sizeof(buffer), "missing:%zu", i);
+    missing[i] = strdup(buffer);
+    ints[i] = rand();
+    int_keys[i] = &ints[i];
+  }
+
+  size_t *order = malloc(N * sizeof(*order));
+  for (size_t i = 0; i < N; i++)
+    order[i] = i;
+  bench_shuffle(order, N);
+
+  double *latencies = malloc(N * sizeof(*latencies));
+
+  printf("%s: %zu keys\n", argv[0], N);
+
+  // Cost of reading the clock, included in every latency.
+  for (size_t i = 0; i < N; i++) {
+    double start = bench_wall_now();
+    latencies[i] = bench_wall_now() - start;
+  }
+  bench_report_latency("(clock)", latencies, N);
+
+  Map map = map_create(compare_strings, NULL, NULL);
+  map_set_hash_function(map, hash_string);
+  for (size_t i = 0; i < N; i++) {
+    double start = bench_wall_now();
+    map_insert(map, strings[i], strings[i]);
+    latencies[i] = bench_wall_now() - start;
+  }
+  bench_report_latency("map_insert (string)", latencies, N);
+
+  report_find("map_find (string, hit)", map, strings, order, N, latencies);
+  report_find("map_find (string, miss)", map, missing, order, N, latencies);
+  map_destroy(map);
+
+  // Random ints, with duplicates, hashed by hash_int.
+  map = map_create(compare_ints, NULL, NULL);
+  map_set_hash_function(map, hash_int);
+  for (size_t i = 0; i < N; i++)
+    map_insert(map, int_keys[i], int_keys[i]);
+
+  report_find("map_find (int, hit)", map, int_keys, order, N, latencies);
+  map_destroy(map);
+
+  for (size_t i = 0; i < N; i++) {
+    free(strings[i]);
+    free(missing[i]);
+  }
+  free(strings);
+  free(missing);
+  free(ints);
+  free(int_keys);
+  free(order);
+  free(latencies);
+
+  return 0;
+}
@@ -0,0 +1,97 @@
+/// @file mapped_map_bench.c
+///
+/// Benchmark for ADT MappedMap.
+///
+/// Compares the two ways to start with a map of N string keys: rebuilding the
+/// Map linked in from the source data, or opening a file saved by map_save().
+/// Then compares their lookups, once the pages of the file are cached.
+
+#include "mapped_map.h"
+
+#include <stdio.h>  // printf, snprintf, remove
+#include <stdlib.h> // malloc, free
+#include <string.h> // strcmp, strdup, strlen, memcpy
+
+#include "bench_companion.h"
+
+#define PATH "mapped_map_bench.map"
+
+static int compare_strings(const void *a, const void *b) {
+  return strcmp(a, b);
+}
+
+static size_t serialize_string(void *value, void *buffer, size_t size) {
+  size_t length = strlen(value);
+  if (length <= size)
+    memcpy(buffer, value, length);
+  return length;
+}
+
+int main(int argc, char *argv[]) {
+  size_t N = bench_size(argc, argv, 1000000);
+
+  char buffer[64];
+  void **keys = malloc(N * sizeof(*keys));
+  size_t *lengths = malloc(N * sizeof(*lengths));
+  for (size_t i = 0; i < N; i++) {
+    snprintf(buffer, sizeof(buffer), "key:%zu", i);
+    keys[i] = strdup(buffer);
+    lengths[i] = strlen(buffer);
+  }
+
+  size_t *order = malloc(N * sizeof(*order));
+  for (size_t i = 0; i < N; i++)
+    order[i] = i;
+  bench_shuffle(order, N);
+
+  printf("%s: %zu string keys\n", argv[0], N);
+
+  double start = bench_now();
+  Map map = map_create(compare_strings, NULL, NULL);
+  map_set_hash_function(map, hash_string);
+  for (size_t i = 0; i < N; i++)
+    map_insert(map, keys[i], keys[i]);
+  bench_report("map_insert (rebuild)", N, bench_now() - start);
+
+  start = bench_now();
+  if (!map_save(map, PATH, serialize_string, serialize_string)) {
+    printf("Could not save %s\n", PATH);
+    return 1;
+  }
+  bench_report("map_save", N, bench_now() - start);
+
+  // Opening does no work per element: the time is for the whole file.
+  start = bench_wall_now();
+  MappedMap mapped = map_open_mmap(PATH);
+  printf("%-32s %10.1f us total\n", "map_open_mmap",
+         (bench_wall_now() - start) * 1e6);
+
+  size_t found = 0;
+  start = bench_now();
+  for (size_t i = 0; i < N; i++)
+    found += map_find(map, keys[order[i]]) != NULL;
+  bench_report("map_find (hit)", N, bench_now() - start);
+
+  size_t size;
+  start = bench_now();
+  for (size_t i = 0; i < N; i++) {
+    size_t j = order[i];
+    found += mapped_map_find(mapped, keys[j], lengths[j], &size) != NULL;
+  }
+  bench_report("mapped_map_find (hit)", N, bench_now() - start);
+
+  if (found != 2 * N)
+    printf("Unexpected result: found %zu of %zu\n", found, 2 * N);
+
+  mapped_map_close(mapped);
+  map_destroy(map);
+  remove(PATH);
+
+  for (size_t i = 0; i < N; i++)
+    free(keys[i]);
+  free(keys);
+  free(lengths);
+  free(order);
+
+  return 0;
+}
@@ -0,0 +1,91 @@
+/// @file oset_bench.c
+///
+/// Benchmark for ADT OrderedSet.
+///
+/// Inserts, finds and removes integer keys in random order, looks up their
+/// positions, and scans ranges of them.
+
+#include "oset.h"
+
+#include <stdio.h>  // printf
+#include <stdlib.h> // malloc, free
+
+#include "bench_companion.h"
+
+/// @brief Counts the elements visited by oset_range().
+///
+static void count_element(void *key, void *value, void *count) {
+  (*(size_t *)count)++;
+}
+
+static int compare_keys(const void *a, const void *b) {
+  size_t x = *(const size_t *)a, y = *(const size_t *)b;
+  return (x > y) - (x < y);
+}
+
+int main(int argc, char *argv[]) {
+  size_t N = bench_size(argc, argv, 1000000);
+
+  // Keys are the shuffled numbers 0, ..., N - 1, looked up in another order.
+  size_t *keys = malloc(N * sizeof(*keys));
+  size_t *order = malloc(N * sizeof(*order));
+  for (size_t i = 0; i < N; i++) {
+    keys[i] = i;
+    order[i] = i;
+  }
+  bench_shuffle(keys, N);
+  bench_shuffle(order, N);
+
+  printf("%s: %zu random keys\n", argv[0], N);
+
+  size_t heap = bench_heap_usage();
+  // Seeded, so that runs build the same skip list.
+  OrderedSet oset = oset_create_with_seed(compare_keys, NULL, NULL, 1);
+  double start = bench_now();
+  for (size_t i = 0; i < N; i++)
+    oset_insert(oset, &keys[i], &keys[i]);
+  bench_report("oset_insert", N, bench_now() - start);
+  bench_report_memory("oset_insert", N, bench_heap_usage() - heap);
+
+  size_t found = 0;
+  start = bench_now();
+  for (size_t i = 0; i < N; i++)
+    found += oset_find(oset, &order[i]) != NULL;
+  bench_report("oset_find", N, bench_now() - start);
+
+  start = bench_now();
+  for (size_t i = 0; i < N; i++)
+    found += oset_rank(oset, &order[i]) == order[i];
+  bench_report("oset_rank", N, bench_now() - start);
+
+  start = bench_now();
+  for (size_t i = 0; i < N; i++)
+    found += *(size_t *)oset_node_key(oset, oset_get_at(oset, order[i])) ==
+             order[i];
+  bench_report("oset_get_at", N, bench_now() - start);
+
+  // Scans of 100 consecutive keys, from random keys.
+  size_t scans = N / 100 + 1, visited = 0;
+  start = bench_now();
+  for (size_t i = 0; i < scans; i++) {
+    size_t lo = order[i], hi = lo + 99;
+    oset_range(oset, &lo, &hi, count_element, &visited);
+  }
+  bench_report("oset_range (100 keys)", scans, bench_now() - start);
+
+  start = bench_now();
+  for (size_t i = 0; i < N; i++)
+    found += oset_remove(oset, &order[i]);
+  bench_report("oset_remove", N, bench_now() - start);
+
+  if (visited == 0)
+    printf("Unexpected result: no element in range\n");
+  if (found != 4 * N)
+    printf("Unexpected result: found %zu of %zu\n", found, 4 * N);
+
+  oset_destroy(oset);
+  free(keys);
+  free(order);
+
+  return 0;
+}
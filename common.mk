@@ -37,7 +37,7 @@ SHELL := bash
 ROOT_DIR := $(dir $(lastword $(MAKEFILE_LIST)))
 INCLUDE := $(ROOT_DIR)include
 MODULES := $(ROOT_DIR)modules
-BIN := $(ROOT_DIR)tests/bin
+BIN ?= $(ROOT_DIR)tests/bin
 
 # Compiler
 CC = gcc
@@ -0,0 +1,100 @@
+/// \file bench_companion.h
+///
+/// Various functions used when benchmarking the modules.
+
+#include <stdio.h>  // printf
+#include <stdlib.h> // strtoul, qsort, size_t
+#include <time.h>   // clock, CLOCKS_PER_SEC, clock_gettime
+
+#ifdef __GLIBC__
+#include <malloc.h> // mallinfo2
+#endif
+
+/// @brief Returns the processor time used by the program, in seconds.
+///
+double bench_now(void) { return (double)clock() / CLOCKS_PER_SEC; }
+
+/// @brief Returns the wall-clock time in seconds, for benchmarks that run
+/// threads: bench_now() adds up the processor time of all of them.
+///
+double bench_wall_now(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/// @brief Returns the number of elements to benchmark with.
+///
+/// The number can be given as the first argument of the benchmark, otherwise
+/// \p default_size is used.
+///
+size_t bench_size(int argc, char *argv[], size_t default_size) {
+  if (argc > 1) {
+    char *end;
+    size_t size = strtoul(argv[1], &end, 10);
+    if (*end == '\0' && size > 0)
+      return size;
+  }
+
+  return default_size;
+}
+
+/// @brief Prints the time per operation and the throughput of \p operations
+/// that took \p seconds .
+///
+void bench_report(const char *name, size_t operations, double seconds) {
+  printf("%-32s %10.1f ns/op %14.0f ops/sec\n", name,
+         seconds * 1e9 / operations, operations / seconds);
+}
+
+/// @brief Prints the throughput of processing \p bytes in \p seconds .
+///
+void bench_report_throughput(const char *name, size_t bytes, double seconds) {
+  printf("%-32s %10.2f GB/s\n", name, bytes / seconds / 1e9);
+}
+
+/// @brief Returns the bytes of heap memory allocated by the program, including
+/// the overhead of malloc, or 0 if the C library can not tell.
+///
+size_t bench_heap_usage(void) {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+  struct mallinfo2 info = mallinfo2();
+  return info.uordblks + info.hblkhd; // Large blocks are mmap()ed.
+#else
+  return 0;
+#endif
+}
+
+/// @brief Prints the heap memory used per item, by \p items that took
+/// \p bytes in total.
+///
+void bench_report_memory(const char *name, size_t items, size_t bytes) {
+  printf("%-32s %10.1f bytes/item %9.1f MB total\n", name,
+         (double)bytes / items, bytes / 1e6);
+}
+
+static int bench_compare_doubles(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+/// @brief Prints the median, tail percentiles and maximum of the latencies of
+/// \p count operations, in seconds. Sorts \p latencies .
+///
+void bench_report_latency(const char *name, double *latencies, size_t count) {
+  qsort(latencies, count, sizeof(*latencies), bench_compare_doubles);
+  printf("%-32s p50 %7.0f ns  p99 %7.0f ns  p99.9 %7.0f ns  max %9.0f ns\n",
+         name, latencies[count / 2] * 1e9, latencies[count * 99 / 100] * 1e9,
+         latencies[count * 999 / 1000] * 1e9, latencies[count - 1] * 1e9);
+}
+
+/// @brief Shuffles the values of an array of size_t.
+///
+void bench_shuffle(size_t *array, size_t size) {
+  for (size_t i = 0; i + 1 < size; i++) {
+    size_t j = i + rand() % (size - i);
+    size_t t = array[j];
+    array[j] = array[i];
+    array[i] = t;
+  }
+}
@@ -0,0 +1,90 @@
+/// \file concurrent_map.h
+///
+/// Concurrent Map Abstract Data Type.
+///
+/// Implementation independent.
+///
+/// A map that can be shared by threads without any external locking. It has
+/// the semantics of map.h: keys are compared with a CompareFunc, hashed with a
+/// HashFunc, and destroyed with the DestroyFuncs given at creation.
+///
+/// The user does not need to know how a ConcurrentMap is implemented, they use
+/// the API functions provided `concurrent_map_<operation>` with the appropriate
+/// parameters.
+
+#ifndef CONCURRENT_MAP_H
+#define CONCURRENT_MAP_H
+
+#include "common_types.h" // CompareFunc, DestroyFunc
+#include "map.h"          // HashFunc, MapUpdateFunc
+#include <stdbool.h>      // bool
+#include <stddef.h>       // size_t
+
+/// ConcurrentMap type.
+///
+/// Incomplete struct, to keep it implementation independent.
+typedef struct concurrent_map *ConcurrentMap;
+
+/// Allocate space for a new concurrent map.
+///
+/// \p compare , \p destroy_key and \p destroy_value work as in map_create().
+///
+/// \param hash Hashes the keys. \sa HashFunc. Can NOT be NULL.
+/// \param shards Number of independently locked parts of the map. More shards
+/// let more threads modify the map at the same time. If 0, a default is used.
+///
+/// \return Newly created concurrent map, or NULL if an error occured.
+ConcurrentMap concurrent_map_create(CompareFunc compare, DestroyFunc destroy_key,
+                                    DestroyFunc destroy_value, HashFunc hash,
+                                    size_t shards);
+
+/// Deallocate the space held by \p map .
+///
+/// No other thread may use \p map during or after its destruction.
+void concurrent_map_destroy(ConcurrentMap map);
+
+/// Returns the number of elements in \p map .
+///
+/// While other threads modify \p map , the result is only an approximation.
+size_t concurrent_map_size(ConcurrentMap map);
+
+/// Associate \p key with \p value , as map_insert() does.
+///
+/// \return true, if \p key is associated with \p value , otherwise false (out
+/// of memory), and \p map is left unchanged.
+bool concurrent_map_insert(ConcurrentMap map, void *key, void *value);
+
+/// Call `update(&value, context)` on the value associated with \p key , as
+/// map_update() does.
+///
+/// Updates of the same key do not run at the same time, so \p update can read
+/// and replace the value atomically with respect to other updates.
+///
+/// Unlike map_update(), if \p update replaces the value, the previous one is
+/// destroyed with `destroy_value`, once no other thread can use it. \p update
+/// must not modify or destroy the previous value itself: depending on the
+/// implementation, concurrent_map_find() may return it meanwhile.
+///
+/// If out of memory, \p update is not called, \p map is left unchanged, and
+/// false is returned.
+///
+/// \return true, if \p key was inserted, otherwise false.
+bool concurrent_map_update(ConcurrentMap map, void *key, MapUpdateFunc update,
+                           void *context);
+
+/// Remove \p key from \p map , as map_remove() does.
+///
+/// \return true, if \p key was removed successfully, otherwise false.
+bool concurrent_map_remove(ConcurrentMap map, void *key);
+
+/// Find and return the value associated with \p key , as map_find() does.
+///
+/// \warning If \p map has a `destroy_value`, the returned value is destroyed
+/// when another thread removes or overwrites \p key . Use
+/// concurrent_map_update() to access such values.
+///
+/// \return Value associated with \p key , or NULL if \p key is not part of
+/// \p map .
+void *concurrent_map_find(ConcurrentMap map, void *key);
+
+#endif // CONCURRENT_MAP_H
@@ -0,0 +1,88 @@
+/// \file epoch.h
+///
+/// Epoch-based memory reclamation.
+///
+/// Lets readers traverse a shared data structure without any locks, while
+/// writers modify it: a writer unlinks an element, publishing the change with
+/// a release store, and defers its destruction with epoch_defer(). The element
+/// is destroyed once every reader that might still see it has left its
+/// critical section.
+///
+/// Typical usage:
+/// \code {.c}
+///   // Reader
+///   epoch_enter(domain);
+///   struct node *node = __atomic_load_n(&list->head, __ATOMIC_ACQUIRE);
+///   // ... node stays valid until epoch_exit()
+///   epoch_exit(domain);
+///
+///   // Writer, serialized with other writers
+///   struct node *node = list->head;
+///   __atomic_store_n(&list->head, node->next, __ATOMIC_RELEASE);
+///   epoch_defer(domain, free, node);
+/// \endcode
+///
+/// Readers write only to memory of their own thread, and do no atomic
+/// read-modify-write operations on shared memory: a critical section costs a
+/// store and a fence. Deferred destructions are run by the writers, in batches.
+
+#ifndef EPOCH_H
+#define EPOCH_H
+
+#include "common_types.h" // DestroyFunc
+
+/// Maximum number of threads alive at the same time that use epochs.
+///
+/// A thread takes one of the EPOCH_MAX_THREADS places on its first
+/// epoch_enter(), and gives it back when it exits. The first epoch_enter() of
+/// a thread beyond them aborts the program.
+#define EPOCH_MAX_THREADS 128
+
+/// EpochDomain type.
+///
+/// Incomplete struct, to keep it implementation independent.
+///
+/// Readers and writers of a data structure share a domain. Readers of one
+/// domain never delay the reclamation of another domain.
+typedef struct epoch_domain *EpochDomain;
+
+/// Allocate space for a new epoch domain.
+///
+/// \return Newly created domain, or NULL if an error occured.
+EpochDomain epoch_domain_create(void);
+
+/// Run every deferred destruction of \p domain , and deallocate the space held
+/// by \p domain .
+///
+/// No thread may be in a critical section of \p domain , or use it afterwards.
+void epoch_domain_destroy(EpochDomain domain);
+
+/// Enter a critical section of \p domain .
+///
+/// Elements reachable from the data structure at any point of the critical
+/// section are not destroyed before the matching epoch_exit().
+///
+/// Critical sections can be nested.
+void epoch_enter(EpochDomain domain);
+
+/// Exit the critical section of \p domain entered last.
+void epoch_exit(EpochDomain domain);
+
+/// Call `destroy(pointer)` once every critical section of \p domain in progress
+/// has exited.
+///
+/// \p pointer must already be unreachable for readers that enter a critical
+/// section from now on.
+///
+/// Can be called inside or outside a critical section, by any thread. Outside
+/// of one, \p pointer may be destroyed by another thread as soon as
+/// epoch_defer() returns.
+void epoch_defer(EpochDomain domain, DestroyFunc destroy, void *pointer);
+
+/// Wait until every destruction deferred so far on \p domain has run.
+///
+/// \warning Must not be called inside a critical section of \p domain , it
+/// would wait forever.
+void epoch_synchronize(EpochDomain domain);
+
+#endif // EPOCH_H
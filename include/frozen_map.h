@@ -0,0 +1,70 @@
+/// \file frozen_map.h
+///
+/// Frozen Map Abstract Data Type.
+///
+/// Implementation independent.
+///
+/// A read-only map, built once from the current elements of a Map. It can not
+/// be modified afterwards, in exchange for lookups that are faster and take
+/// less memory than the lookups of a Map.
+///
+/// Typical usage:
+/// \code {.c}
+///   Map map = map_create(compare_ints, NULL, NULL);
+///   map_set_hash_function(map, hash_int);
+///   // ... insert every element
+///
+///   FrozenMap frozen = frozen_map_build(map, compare_ints, hash_int);
+///   int *value = frozen_map_find(frozen, &key);
+///
+///   frozen_map_destroy(frozen);
+///   map_destroy(map);
+/// \endcode
+///
+/// The user does not need to know how a FrozenMap is implemented, they use the
+/// API functions provided `frozen_map_<operation>` with the appropriate
+/// parameters.
+
+#ifndef FROZEN_MAP_H
+#define FROZEN_MAP_H
+
+#include "common_types.h" // CompareFunc
+#include "map.h"          // Map, HashFunc
+#include <stddef.h>       // size_t
+
+/// FrozenMap type.
+///
+/// Incomplete struct, to keep it implementation independent.
+typedef struct frozen_map *FrozenMap;
+
+/// Build a frozen map of the elements of \p map .
+///
+/// \p map is only traversed, and can be modified or destroyed afterwards. The
+/// keys and values themselves are not copied: they are shared with \p map , so
+/// they must remain valid while the frozen map is used. E.g. destroy the frozen
+/// map before \p map , or set the destroy functions of \p map to NULL.
+///
+/// \param compare Compares two keys, as the compare function of \p map .
+/// \param hash Hashes a key, as the hash function of \p map . Each key is
+/// hashed once.
+///
+/// \return Newly created frozen map, or NULL if an error occured.
+FrozenMap frozen_map_build(Map map, CompareFunc compare, HashFunc hash);
+
+/// Deallocate the space held by \p map .
+///
+/// The keys and values are not destroyed.
+void frozen_map_destroy(FrozenMap map);
+
+/// Returns the number of elements in \p map .
+size_t frozen_map_size(FrozenMap map);
+
+/// Find and return the value associated with \p key .
+///
+/// Threads may look up keys at the same time.
+///
+/// \return Value associated with \p key , or NULL if \p key is not part of
+/// \p map .
+void *frozen_map_find(FrozenMap map, void *key);
+
+#endif // FROZEN_MAP_H
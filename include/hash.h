@@ -0,0 +1,75 @@
+/// \file hash.h
+///
+/// Hash functions.
+///
+/// 64-bit hashes of byte strings, integers and pointers, all of them seeded.
+/// Every output bit depends on every input bit, so any bits of a hash, e.g.
+/// the lowest ones kept by `hash % capacity` or `hash & mask`, are evenly
+/// distributed.
+///
+/// Hashes are not stable between processes: each process picks a random seed
+/// (see hash_seed()), so that inputs that collide can not be crafted in
+/// advance. Hashes also depend on the endianness of the machine.
+
+#ifndef HASH_H
+#define HASH_H
+
+#include <stddef.h> // size_t
+#include <stdint.h> // uint64_t
+
+/// Hash the \p size bytes at \p data , with \p seed .
+///
+/// Reads 8 bytes at a time, \p data does not have to be aligned.
+///
+/// \return 64-bit hash of the bytes.
+uint64_t hash_bytes(const void *data, size_t size, uint64_t seed);
+
+/// Hash the integer \p value , with \p seed .
+///
+/// For a given seed, different values always have different hashes.
+///
+/// \return 64-bit hash of \p value .
+uint64_t hash_u64(uint64_t value, uint64_t seed);
+
+/// Hash the address \p pointer , with \p seed .
+///
+/// The low bits of an address are mostly zero, due to alignment. They do not
+/// take part in the hash less than the other bits, but different addresses
+/// always have different hashes.
+///
+/// \return 64-bit hash of the address.
+uint64_t hash_address(const void *pointer, uint64_t seed);
+
+/// Return the seed of the process.
+///
+/// The seed is random, and picked once before main() runs.
+uint64_t hash_seed(void);
+
+/// Set the seed of the process to \p seed , e.g. to reproduce a run.
+///
+/// \warning Call hash_set_seed() before hashing anything with the seed of the
+/// process, hashes computed earlier will not match the ones computed later.
+void hash_set_seed(uint64_t seed);
+
+/// Hash the string \p value , with the seed of the process.
+///
+/// Same signature as HashFunc of map.h, to be used with map_set_hash_function().
+///
+/// \return 32-bit hash of \p value .
+unsigned int hash_string_seeded(void *value);
+
+/// Hash the int pointed to by \p value , with the seed of the process.
+///
+/// Same signature as HashFunc of map.h, to be used with map_set_hash_function().
+///
+/// \return 32-bit hash of \p value .
+unsigned int hash_int_seeded(void *value);
+
+/// Hash the address \p value , with the seed of the process.
+///
+/// Same signature as HashFunc of map.h, to be used with map_set_hash_function().
+///
+/// \return 32-bit hash of \p value .
+unsigned int hash_pointer_seeded(void *value);
+
+#endif // HASH_H
@@ -0,0 +1,334 @@
+/// \file int_map.h
+///
+/// Maps with integer keys, specialized at compile time.
+///
+/// Unlike map.h, keys and values are stored by value, inline in a flat array of
+/// slots, and the hash and equality of keys are inlined instead of called
+/// through function pointers. A map of `uint64_t` to `uint64_t` takes 16 bytes
+/// per slot and no allocation per entry.
+///
+/// The maps are generated by macros, for any integer (or pointer) key type and
+/// any value type:
+/// - INT_MAP_DECLARE() declares the map type and its functions, in a header.
+/// - INT_MAP_DEFINE() defines the functions, in exactly one source file.
+///
+/// Two maps are provided:
+/// - IntMap, from `int` to `int`, with functions `int_map_<operation>`.
+/// - U64Map, from `uint64_t` to `uint64_t`, with functions `u64_map_<operation>`.
+///
+/// Typical usage:
+/// \code {.c}
+///   U64Map map = u64_map_create();
+///   u64_map_insert(map, 42, 1);
+///
+///   uint64_t *value = u64_map_find(map, 42);
+///   if (value != NULL)
+///     (*value)++;
+///
+///   u64_map_destroy(map);
+/// \endcode
+///
+/// Collisions are resolved with linear probing. A slot is empty when its key is
+/// the sentinel key given to INT_MAP_DEFINE(), 0 for IntMap and U64Map. The
+/// sentinel key itself is still a valid key: its entry is kept outside of the
+/// slots.
+
+#ifndef INT_MAP_H
+#define INT_MAP_H
+
+#include <stdbool.h> // bool
+#include <stddef.h>  // size_t
+#include <stdint.h>  // uint64_t
+#include <stdlib.h>  // malloc, calloc, free
+#include <string.h>  // memset
+
+/// Hash \p key .
+///
+/// Finalizer of splitmix64: every bit of the hash depends on every bit of
+/// \p key , so the lowest bits of the hash pick a slot, and different keys
+/// always have different hashes.
+///
+/// \return 64-bit hash of \p key .
+static inline uint64_t int_map_hash(uint64_t key) {
+  key ^= key >> 30;
+  key *= 0xbf58476d1ce4e5b9;
+  key ^= key >> 27;
+  key *= 0x94d049bb133111eb;
+  key ^= key >> 31;
+  return key;
+}
+
+/// Declare the map type \p Name , from \p Key to \p Value , and its functions,
+/// named `<prefix>_<operation>`:
+///
+/// - `Name prefix_create(void)`
+///
+///   Allocate space for a new map. \return Newly created map, or NULL if an
+///   error occured.
+///
+/// - `Name prefix_create_with_capacity(size_t expected)`
+///
+///   Same as `prefix_create()`, except that the map does not have to resize
+///   until it holds more than \p expected entries.
+///
+/// - `void prefix_destroy(Name map)`
+///
+///   Deallocate the space held by \p map .
+///
+/// - `size_t prefix_size(Name map)`
+///
+///   Return the number of entries in \p map .
+///
+/// - `void prefix_reserve(Name map, size_t n)`
+///
+///   Make room in \p map for \p n entries in total.
+///
+/// - `void prefix_insert(Name map, Key key, Value value)`
+///
+///   Associate \p key with \p value , overwriting its previous value.
+///
+/// - `Value *prefix_find(Name map, Key key)`
+///
+///   \return Address of the value associated with \p key , or NULL if \p key
+///   is not part of \p map .
+///
+/// - `Value *prefix_find_or_insert(Name map, Key key, bool *inserted)`
+///
+///   Same as `prefix_find()`, except that \p key is inserted with a zeroed
+///   value if it is not part of \p map . \p inserted is set to true, if \p key
+///   was inserted, otherwise false.
+///
+/// - `bool prefix_remove(Name map, Key key)`
+///
+///   Remove \p key from \p map . \return true, if \p key was removed,
+///   otherwise false.
+///
+/// - `bool prefix_next(Name map, size_t *position, Key *key, Value *value)`
+///
+///   Traverse \p map : store the entry at or after \p position in \p key and
+///   \p value , and move \p position after it. Start at position 0.
+///   \return true, if an entry was stored, or false, if the traversal is over.
+///
+/// Addresses returned by `prefix_find()` and `prefix_find_or_insert()` are
+/// invalidated by the next `prefix_insert()`, `prefix_find_or_insert()` or
+/// `prefix_remove()`, and so is a traversal in progress.
+#define INT_MAP_DECLARE(Name, prefix, Key, Value)                              \
+  typedef struct prefix *Name;                                                 \
+                                                                               \
+  Name prefix##_create(void);                                                  \
+  Name prefix##_create_with_capacity(size_t expected);                         \
+  void prefix##_destroy(Name map);                                             \
+  size_t prefix##_size(Name map);                                              \
+  void prefix##_reserve(Name map, size_t n);                                   \
+  void prefix##_insert(Name map, Key key, Value value);                        \
+  Value *prefix##_find(Name map, Key key);                                     \
+  Value *prefix##_find_or_insert(Name map, Key key, bool *inserted);           \
+  bool prefix##_remove(Name map, Key key);                                     \
+  bool prefix##_next(Name map, size_t *position, Key *key, Value *value);
+
+/// Define the functions declared by INT_MAP_DECLARE() with the same \p Name ,
+/// \p prefix , \p Key and \p Value .
+///
+/// \param EMPTY Sentinel key of empty slots, a constant. Slots are allocated
+/// with calloc() when it is 0, so the pages of a large table are only touched
+/// when entries are placed in them.
+/// \param hash Function or macro that hashes a key to a `uint64_t`, e.g.
+/// int_map_hash(). Its lowest bits pick the slot of a key.
+#define INT_MAP_DEFINE(Name, prefix, Key, Value, EMPTY, hash)                  \
+  struct prefix##_slot {                                                       \
+    Key key;                                                                   \
+    Value value;                                                               \
+  };                                                                           \
+                                                                               \
+  struct prefix {                                                              \
+    struct prefix##_slot *slots;                                               \
+    size_t mask; /* Number of slots - 1, a power of two - 1. */                \
+    size_t used; /* Number of occupied slots. */                               \
+                                                                               \
+    /* Entry of the key EMPTY, that can not be placed in a slot. */            \
+    bool has_empty;                                                            \
+    Value empty_value;                                                         \
+  };                                                                           \
+                                                                               \
+  /* Smallest number of slots, and maximum load factor (3/4). */               \
+  enum { prefix##_MIN_SLOTS = 16 };                                            \
+  static inline size_t prefix##_max_used(size_t slots) {                       \
+    return slots - slots / 4;                                                  \
+  }                                                                            \
+                                                                               \
+  static struct prefix##_slot *prefix##_slots_create(size_t slots) {           \
+    struct prefix##_slot *array;                                               \
+    if ((Key)(EMPTY) == 0)                                                     \
+      return calloc(slots, sizeof(*array));                                    \
+                                                                               \
+    array = malloc(slots * sizeof(*array));                                    \
+    if (array != NULL) {                                                       \
+      for (size_t i = 0; i < slots; i++)                                       \
+        array[i].key = (EMPTY);                                                \
+    }                                                                          \
+    return array;                                                              \
+  }                                                                            \
+                                                                               \
+  /* Position of the slot where key is, or where it would be placed. */       \
+  static inline size_t prefix##_probe(Name map, Key key) {                     \
+    size_t pos = hash(key) & map->mask;                                        \
+    while (map->slots[pos].key != key && map->slots[pos].key != (EMPTY))       \
+      pos = (pos + 1) & map->mask;                                             \
+    return pos;                                                                \
+  }                                                                            \
+                                                                               \
+  /* Places every entry of the table again, in slots slots. */                \
+  static void prefix##_rehash(Name map, size_t slots) {                        \
+    struct prefix##_slot *array = prefix##_slots_create(slots);                \
+    if (array == NULL)                                                         \
+      return; /* Keep the current table, at a higher load factor. */          \
+                                                                               \
+    struct prefix##_slot *old = map->slots;                                    \
+    size_t old_slots = map->mask + 1;                                          \
+    map->slots = array;                                                        \
+    map->mask = slots - 1;                                                     \
+                                                                               \
+    for (size_t i = 0; i < old_slots; i++) {                                   \
+      if (old[i].key != (EMPTY))                                               \
+        map->slots[prefix##_probe(map, old[i].key)] = old[i];                  \
+    }                                                                          \
+    free(old);                                                                 \
+  }                                                                            \
+                                                                               \
+  static size_t prefix##_slots_for(size_t n) {                                 \
+    size_t slots = prefix##_MIN_SLOTS;                                         \
+    while (prefix##_max_used(slots) < n)                                       \
+      slots *= 2;                                                              \
+    return slots;                                                              \
+  }                                                                            \
+                                                                               \
+  Name prefix##_create(void) { return prefix##_create_with_capacity(0); }      \
+                                                                               \
+  Name prefix##_create_with_capacity(size_t expected) {                        \
+    Name map = malloc(sizeof(*map));                                           \
+    if (map == NULL)                                                           \
+      return NULL;                                                             \
+                                                                               \
+    size_t slots = prefix##_slots_for(expected);                               \
+    map->slots = prefix##_slots_create(slots);                                 \
+    if (map->slots == NULL) {                                                  \
+      free(map);                                                               \
+      return NULL;                                                             \
+    }                                                                          \
+    map->mask = slots - 1;                                                     \
+    map->used = 0;                                                             \
+    map->has_empty = false;                                                    \
+    return map;                                                                \
+  }                                                                            \
+                                                                               \
+  void prefix##_destroy(Name map) {                                            \
+    free(map->slots);                                                          \
+    free(map);                                                                 \
+  }                                                                            \
+                                                                               \
+  size_t prefix##_size(Name map) { return map->used + map->has_empty; }        \
+                                                                               \
+  void prefix##_reserve(Name map, size_t n) {                                  \
+    size_t slots = prefix##_slots_for(n);                                      \
+    if (slots > map->mask + 1)                                                 \
+      prefix##_rehash(map, slots);                                             \
+  }                                                                            \
+                                                                               \
+  Value *prefix##_find(Name map, Key key) {                                    \
+    if (key == (EMPTY))                                                        \
+      return map->has_empty ? &map->empty_value : NULL;                        \
+                                                                               \
+    size_t pos = prefix##_probe(map, key);                                     \
+    return map->slots[pos].key == key ? &map->slots[pos].value : NULL;         \
+  }                                                                            \
+                                                                               \
+  Value *prefix##_find_or_insert(Name map, Key key, bool *inserted) {          \
+    if (key == (EMPTY)) {                                                      \
+      *inserted = !map->has_empty;                                             \
+      if (*inserted) {                                                         \
+        map->has_empty = true;                                                 \
+        memset(&map->empty_value, 0, sizeof(map->empty_value));                \
+      }                                                                        \
+      return &map->empty_value;                                                \
+    }                                                                          \
+                                                                               \
+    size_t pos = prefix##_probe(map, key);                                     \
+    *inserted = map->slots[pos].key != key;                                    \
+    if (!*inserted)                                                            \
+      return &map->slots[pos].value;                                           \
+                                                                               \
+    /* Grow only when key is placed, then probe the new table. */             \
+    if (map->used + 1 > prefix##_max_used(map->mask + 1)) {                    \
+      prefix##_rehash(map, 2 * (map->mask + 1));                               \
+      pos = prefix##_probe(map, key);                                          \
+    }                                                                          \
+                                                                               \
+    map->slots[pos].key = key;                                                 \
+    memset(&map->slots[pos].value, 0, sizeof(map->slots[pos].value));          \
+    map->used++;                                                               \
+    return &map->slots[pos].value;                                             \
+  }                                                                            \
+                                                                               \
+  void prefix##_insert(Name map, Key key, Value value) {                       \
+    bool inserted;                                                             \
+    *prefix##_find_or_insert(map, key, &inserted) = value;                     \
+  }                                                                            \
+                                                                               \
+  bool prefix##_remove(Name map, Key key) {                                    \
+    if (key == (EMPTY)) {                                                      \
+      bool removed = map->has_empty;                                           \
+      map->has_empty = false;                                                  \
+      return removed;                                                          \
+    }                                                                          \
+                                                                               \
+    size_t pos = prefix##_probe(map, key);                                     \
+    if (map->slots[pos].key != key)                                            \
+      return false;                                                            \
+                                                                               \
+    /* Backward shift deletion: move back each following entry of the      */ \
+    /* cluster that may occupy pos without being placed before its home     */ \
+    /* slot, instead of leaving a tombstone.                                */ \
+    size_t next = (pos + 1) & map->mask;                                       \
+    while (map->slots[next].key != (EMPTY)) {                                  \
+      size_t home = hash(map->slots[next].key) & map->mask;                    \
+      if (((next - home) & map->mask) >= ((next - pos) & map->mask)) {         \
+        map->slots[pos] = map->slots[next];                                    \
+        pos = next;                                                            \
+      }                                                                        \
+      next = (next + 1) & map->mask;                                           \
+    }                                                                          \
+    map->slots[pos].key = (EMPTY);                                             \
+    map->used--;                                                               \
+    return true;                                                               \
+  }                                                                            \
+                                                                               \
+  bool prefix##_next(Name map, size_t *position, Key *key, Value *value) {     \
+    /* Position 0 is the entry of EMPTY, position i + 1 is slot i. */         \
+    if (*position == 0) {                                                      \
+      *position = 1;                                                           \
+      if (map->has_empty) {                                                    \
+        *key = (EMPTY);                                                        \
+        *value = map->empty_value;                                             \
+        return true;                                                           \
+      }                                                                        \
+    }                                                                          \
+                                                                               \
+    for (; *position <= map->mask + 1; (*position)++) {                        \
+      struct prefix##_slot *slot = &map->slots[*position - 1];                 \
+      if (slot->key != (EMPTY)) {                                              \
+        *key = slot->key;                                                      \
+        *value = slot->value;                                                  \
+        (*position)++;                                                         \
+        return true;                                                           \
+      }                                                                        \
+    }                                                                          \
+    return false;                                                              \
+  }
+
+/// IntMap, from `int` to `int`.
+INT_MAP_DECLARE(IntMap, int_map, int, int)
+
+/// U64Map, from `uint64_t` to `uint64_t`.
+INT_MAP_DECLARE(U64Map, u64_map, uint64_t, uint64_t)
+
+#endif // INT_MAP_H
@@ -57,6 +57,27 @@ typedef struct map *Map;
 Map map_create(CompareFunc compare, DestroyFunc destroy_key,
                DestroyFunc destroy_value);
 
+/// Allocate space for a new map, sized to hold \p expected elements.
+///
+/// Same as map_create(), except that \p map does not have to resize until it
+/// holds more than \p expected elements.
+///
+/// \return Newly created map, or NULL if an error occured.
+Map map_create_with_capacity(CompareFunc compare, DestroyFunc destroy_key,
+                             DestroyFunc destroy_value, size_t expected);
+
+/// Make room in \p map for \p n elements in total.
+///
+/// \p map does not have to resize until it holds more than \p n elements.
+/// Does nothing if \p map already has room for them.
+void map_reserve(Map map, size_t n);
+
+/// Shrink \p map to the smallest size that holds its current elements.
+///
+/// A map never shrinks on its own, call map_shrink_to_fit() to give back the
+/// memory of removed elements.
+void map_shrink_to_fit(Map map);
+
 /// Deallocate the space held by \p map .
 ///
 /// Any operation on \p map after its destruction, causes undefined behaviour.
@@ -126,6 +147,60 @@ size_t map_size(Map map);
 /// undefined behaviour.
 void map_insert(Map map, void *key, void *value);
 
+/// Return the address of the value associated with \p key , inserting \p key
+/// with value `NULL` if it is not part of \p map .
+///
+/// \p key is hashed once and looked up once, so counting and aggregation
+/// workloads do not have to call map_find() and then map_insert().
+///
+/// If \p key is already part of \p map , \p key is **not** stored, and the
+/// caller remains responsible for it. A new value stored through the returned
+/// address does not destroy the previous one.
+///
+/// \p key can not be `NULL`.
+///
+/// Typical usage:
+/// \code {.c}
+///   bool inserted;
+///   int **count = (int **)map_find_or_insert(map, word, &inserted);
+///   if (count == NULL)
+///     return; // Out of memory.
+///   if (inserted)
+///     *count = create_int(0);
+///   else
+///     free(word);
+///   (**count)++;
+/// \endcode
+///
+/// \param inserted Set to true, if \p key was inserted, otherwise false.
+///
+/// \return Address of the value associated with \p key . It is invalidated by
+/// the next map_insert() or map_remove() on \p map . If \p key could not be
+/// inserted (out of memory), NULL, \p inserted is set to false, and \p map is
+/// left unchanged.
+void **map_find_or_insert(Map map, void *key, bool *inserted);
+
+/// Update the value associated with a key.
+///
+/// \p value is the address of the value, and \p context is the context
+/// passed to map_update().
+typedef void (*MapUpdateFunc)(void **value, void *context);
+
+/// Call `update(&value, context)` on the value associated with \p key ,
+/// inserting \p key with value `NULL` first, if it is not part of \p map .
+///
+/// \p key is hashed once and looked up once. As in map_find_or_insert(), if
+/// \p key is already part of \p map , the caller remains responsible for it,
+/// and \p update is responsible for the value it replaces.
+///
+/// \p key can not be `NULL`.
+///
+/// If \p key could not be inserted (out of memory), \p update is not called,
+/// \p map is left unchanged, and false is returned.
+///
+/// \return true, if \p key was inserted, otherwise false.
+bool map_update(Map map, void *key, MapUpdateFunc update, void *context);
+
 /// Remove \p key from \p map .
 ///
 /// \p key can not be `NULL`.
@@ -143,10 +218,38 @@ bool map_remove(Map map, void *key);
 ///  - if \p key is associated with the value `NULL`.
 /// To differentiate the two circumstances use map_find_node().
 ///
+/// \note Lookups do not modify the elements or the layout of \p map , only its
+/// MapSavings counters. Threads may look up keys at the same time, as long as
+/// no thread modifies \p map , e.g. under a shared lock. The counters are then
+/// approximate.
+///
 /// \return Value associated with \p key , or NULL if \p key is not part of
 /// \p map .
 void *map_find(Map map, void *key);
 
+/// Find the values associated with the \p n keys of \p keys , and store them
+/// in \p values , in the same order.
+///
+/// Same as `values[i] = map_find(map, keys[i])` for every key, but faster on
+/// maps that do not fit in the cache: keys are hashed a few positions ahead of
+/// the key being looked up, and the memory their lookups will touch is
+/// prefetched, so that the cache misses of independent lookups overlap instead
+/// of stalling one after the other.
+///
+/// \p keys can not contain `NULL`, and \p values must have room for \p n
+/// values. Like map_find(), it does not modify \p map .
+void map_find_batch(Map map, void **keys, size_t n, void **values);
+
+/// Associate each of the \p n keys of \p keys with the value at the same
+/// position of \p values .
+///
+/// Same as `map_insert(map, keys[i], values[i])` for every key, in order, so a
+/// key that appears more than once ends up associated with its last value.
+/// Prefetches like map_find_batch().
+///
+/// \p keys can not contain `NULL`.
+void map_insert_batch(Map map, void **keys, size_t n, void **values);
+
 #define MAP_EOF (MapNode)0 ///< Defines the "virtual" end of the map.
 
 /// MapNode type.
@@ -178,6 +281,8 @@ void *map_node_key(Map map, MapNode node);
 
 /// \defgroup traversal Traversal functions
 /// \note Map traversal is arbitrary.
+/// \note Depending on the implementation, map_insert() and map_remove() may
+/// invalidate every MapNode of the map.
 ///@{
 
 /// Return the first node, or `MAP_EOF` if \p map is empty.
@@ -187,6 +292,46 @@ MapNode map_first(Map);
 /// node.
 MapNode map_next(Map, MapNode);
 
+/// MapIterator type.
+///
+/// Traverses a map without looking up the current node again on every step,
+/// so a full traversal calls neither the hash nor the compare function.
+///
+/// Typical usage:
+/// \code {.c}
+///   for (MapIterator iter = map_iter_begin(map); map_iter_valid(map, &iter);
+///        map_iter_next(map, &iter)) {
+///     MapNode node = map_iter_node(map, &iter);
+///     // ...
+///   }
+/// \endcode
+///
+/// The fields are implementation specific, use the API functions provided
+/// `map_iter_<operation>` instead. An iterator is invalidated by map_insert()
+/// and map_remove().
+typedef struct map_iterator {
+  MapNode node;    ///< Current node, or `MAP_EOF`.
+  size_t position; ///< Position of node in the map (e.g. bucket or slot).
+  void *cursor;    ///< Position of node inside its bucket, if any.
+} MapIterator;
+
+/// Return an iterator at the first node of \p map .
+MapIterator map_iter_begin(Map map);
+
+/// Return true, if \p iter is at a node of \p map , or false, if the traversal
+/// is over.
+bool map_iter_valid(Map map, MapIterator *iter);
+
+/// Move \p iter to the next node of \p map .
+///
+/// If \p iter is not valid, it causes undefined behaviour.
+void map_iter_next(Map map, MapIterator *iter);
+
+/// Return the node \p iter is at.
+///
+/// If \p iter is not valid, it causes undefined behaviour.
+MapNode map_iter_node(Map map, MapIterator *iter);
+
 ///@}  // End of traversal
 
 /// \defgroup hashing Hash functions
@@ -211,6 +356,64 @@ unsigned int hash_string(void *value);
 /// Hash \p value of type int.
 unsigned int hash_int(void *value);
 
+/// Calls of the hash and compare functions that a map avoided, because it
+/// keeps the hash of every key.
+typedef struct map_savings {
+  size_t hash_calls;    ///< Calls of the hash function avoided.
+  size_t compare_calls; ///< Calls of the compare function avoided.
+} MapSavings;
+
+/// Store in \p savings the calls of the hash and compare functions that
+/// \p map avoided since its creation.
+///
+/// A key is hashed once, when it is inserted. Its hash is reused whenever the
+/// map is resized or traversed, and keys whose hash differs from the hash of
+/// the key looked up are never compared.
+void map_savings(Map map, MapSavings *savings);
+
 ///@} // End of hashing
 
+#ifdef MAP_STATS
+
+/// \defgroup stats Instrumentation
+///
+/// Compiled only with MAP_STATS defined, both for the map implementation and
+/// for the code that calls map_stats(). Without it, a map counts nothing and
+/// costs nothing more.
+///
+/// Implemented by HashTable.
+///@{
+
+/// Number of entries of MapStats.chain_lengths.
+#define MAP_STATS_CHAINS 16
+
+/// Shape of the table of a map, and the work done on it since its creation.
+///
+/// A weak hash function shows up as a few long chains: e.g. hash_int on keys
+/// that are all multiples of the capacity puts every key in one bucket.
+typedef struct map_stats {
+  size_t capacity;  ///< Buckets of the table.
+  size_t occupied;  ///< Buckets that hold at least one element.
+  double load;      ///< Elements per bucket.
+  size_t max_chain; ///< Elements of the longest chain.
+  /// Buckets whose chain holds each number of elements, empty buckets
+  /// included. The last entry counts every longer chain too.
+  size_t chain_lengths[MAP_STATS_CHAINS];
+
+  size_t rehashes;       ///< Resizes of the table.
+  double rehash_seconds; ///< Time spent resizing the table.
+  size_t hash_calls;     ///< Calls of the hash function.
+  size_t compare_calls;  ///< Calls of the compare function.
+} MapStats;
+
+/// Store in \p stats the shape of the table of \p map , and the work done on
+/// it since its creation.
+///
+/// Takes time proportional to the capacity of \p map .
+void map_stats(Map map, MapStats *stats);
+
+///@} // End of stats
+
+#endif // MAP_STATS
+
 #endif // MAP_H
@@ -0,0 +1,95 @@
+/// \file mapped_map.h
+///
+/// Mapped Map Abstract Data Type.
+///
+/// A Map saved to a file, and looked up straight from the file mapped in
+/// memory. map_save() writes the elements of a Map as a hash table of bytes,
+/// and map_open_mmap() maps that file without reading or allocating anything
+/// per element: opening takes the same time for any size, pages are read from
+/// the disk when a lookup first touches them, and processes that open the same
+/// file share its pages in the page cache.
+///
+/// Typical usage:
+/// \code {.c}
+///   size_t serialize_string(void *value, void *buffer, size_t size) {
+///     size_t length = strlen(value);
+///     if (length <= size)
+///       memcpy(buffer, value, length);
+///     return length;
+///   }
+///
+///   map_save(map, "words.map", serialize_string, serialize_string);
+///
+///   // Later, maybe in another process.
+///   MappedMap mapped = map_open_mmap("words.map");
+///   size_t size;
+///   const char *value = mapped_map_find(mapped, "key", 3, &size);
+///   mapped_map_close(mapped);
+/// \endcode
+///
+/// The file holds offsets, not pointers, so it can be mapped at any address.
+/// It is written in the byte order of the machine, and can only be opened by
+/// machines of the same byte order.
+///
+/// A corrupt file may make lookups miss or return wrong values, but never read
+/// outside the file or loop forever.
+
+#ifndef MAPPED_MAP_H
+#define MAPPED_MAP_H
+
+#include "map.h"     // Map
+#include <stdbool.h> // bool
+#include <stddef.h>  // size_t
+
+/// MappedMap type.
+///
+/// Incomplete struct, to keep it implementation independent.
+typedef struct mapped_map *MappedMap;
+
+/// Writes the bytes of \p value to \p buffer .
+///
+/// Writes nothing if \p size , the size of \p buffer , is less than the size of
+/// the bytes. Called again with a large enough buffer in that case.
+///
+/// \return Size of the bytes of \p value .
+typedef size_t (*SerializeFunc)(void *value, void *buffer, size_t size);
+
+/// Save the elements of \p map to the file \p path .
+///
+/// Keys and values are written as the bytes returned by \p serialize_key and
+/// \p serialize_value . Keys are then looked up by their bytes: two keys of
+/// \p map must not have the same bytes.
+///
+/// The file is written next to \p path and renamed to \p path once complete,
+/// so processes that have the previous file open keep reading it unchanged.
+///
+/// \return true, if the file was saved, otherwise false.
+bool map_save(Map map, const char *path, SerializeFunc serialize_key,
+              SerializeFunc serialize_value);
+
+/// Map the file \p path , saved by map_save(), in memory.
+///
+/// \return Newly opened map, or NULL if the file could not be mapped or was
+/// not saved by map_save().
+MappedMap map_open_mmap(const char *path);
+
+/// Unmap the file of \p map , and deallocate the space held by \p map .
+///
+/// Pointers returned by mapped_map_find() are no longer valid.
+void mapped_map_close(MappedMap map);
+
+/// Returns the number of elements in \p map .
+size_t mapped_map_size(MappedMap map);
+
+/// Find the value of the key with the \p key_size bytes at \p key .
+///
+/// Threads may look up keys at the same time.
+///
+/// \param value_size Set to the size of the value, if found.
+///
+/// \return Bytes of the value, inside the mapped file and aligned to 8 bytes,
+/// or NULL if the key is not part of \p map .
+const void *mapped_map_find(MappedMap map, const void *key, size_t key_size,
+                            size_t *value_size);
+
+#endif // MAPPED_MAP_H
@@ -14,6 +14,7 @@
 #include "common_types.h" // CompareFunc, DestroyFunc
 #include <stdbool.h>      // bool
 #include <stddef.h>       // size_t
+#include <stdint.h>       // uint64_t
 
 /// OrderedSet type.
 ///
@@ -48,6 +49,20 @@ typedef struct ordered_set *OrderedSet;
 OrderedSet oset_create(CompareFunc compare, DestroyFunc destroy_key,
                        DestroyFunc destroy_value);
 
+/// Allocate space for a new ordered set, that draws the levels of its nodes
+/// from a random number generator seeded with \p seed .
+///
+/// Same as oset_create(), except that sets created with the same \p seed ,
+/// given the same operations, have the same shape. Useful for reproducible
+/// tests and benchmarks.
+///
+/// Each ordered set has its own random number generator, so threads can use
+/// different ordered sets at the same time.
+///
+/// \return Newly created ordered set, or NULL if an error occured.
+OrderedSet oset_create_with_seed(CompareFunc compare, DestroyFunc destroy_key,
+                                 DestroyFunc destroy_value, uint64_t seed);
+
 /// Deallocate the space held by \p oset .
 ///
 /// Any operation on \p oset after its destruction, causes undefined behaviour.
@@ -197,6 +212,70 @@ typedef struct ordered_set_node *OrderedSetNode;
 /// \p oset .
 OrderedSetNode oset_find_node(OrderedSet oset, void *key);
 
+/// \defgroup positions Position functions
+///
+/// Positions count from 0, in ascending order of keys. Each of these functions
+/// takes O(log n) time.
+///@{
+
+/// Return the node at position \p index , that is the node with the
+/// (\p index + 1)-th smallest key.
+///
+/// \return Node at position \p index , or `OSET_EOF` if \p index is not less
+/// than the size of \p oset .
+OrderedSetNode oset_get_at(OrderedSet oset, size_t index);
+
+/// Return the number of keys of \p oset less than \p key .
+///
+/// If \p key is part of \p oset , this is the position of its first node.
+///
+/// \p key can not be `NULL`.
+size_t oset_rank(OrderedSet oset, void *key);
+
+/// Return the number of keys of \p oset between \p lo and \p hi , both
+/// included.
+///
+/// Returns 0 if \p lo > \p hi . \p lo and \p hi can not be `NULL`.
+size_t oset_count_range(OrderedSet oset, void *lo, void *hi);
+
+///@}  // End of positions.
+
+/// \defgroup ranges Range functions
+///
+/// Each of these functions takes O(log n) time, plus the number of nodes it
+/// visits.
+///@{
+
+/// Return the first node with a key not less than \p key , or `OSET_EOF` if
+/// every key of \p oset is less than \p key .
+///
+/// \p key can not be `NULL`.
+OrderedSetNode oset_lower_bound(OrderedSet oset, void *key);
+
+/// Return the first node with a key greater than \p key , or `OSET_EOF` if no
+/// key of \p oset is greater than \p key .
+///
+/// \p key can not be `NULL`.
+OrderedSetNode oset_upper_bound(OrderedSet oset, void *key);
+
+/// Called by oset_range() on each element in the range, with the \p context
+/// passed to it.
+typedef void (*OrderedSetRangeFunc)(void *key, void *value, void *context);
+
+/// Call `callback(key, value, context)` on each element of \p oset with a key
+/// between \p lo and \p hi , both included, in ascending order.
+///
+/// Keys are compared to \p lo and \p hi only to find the ends of the range.
+///
+/// \p callback must not insert to or remove from \p oset . \p lo and \p hi
+/// can not be `NULL`.
+///
+/// \return Number of elements in the range, 0 if \p lo > \p hi .
+size_t oset_range(OrderedSet oset, void *lo, void *hi,
+                  OrderedSetRangeFunc callback, void *context);
+
+///@}  // End of ranges.
+
 /// Return the key of \p node .
 ///
 /// If \p node is `NULL`, it causes to undefined behaviour.
@@ -0,0 +1,877 @@
+/// @file map.c
+///
+/// Implementation of Map Abstract Data Type using bucketized cuckoo hashing.
+///
+/// Every key has two candidate buckets, picked by two hash functions derived
+/// from its hash, and each bucket holds up to 4 entries. A key is always in one
+/// of its two buckets, or, rarely, in a small stash: a lookup reads at most two
+/// buckets, whatever the load, so its worst case is bounded.
+///
+/// A bucket keeps the hashes and the keys of its entries, and takes exactly
+/// one cache line. Values are kept in a separate array, parallel to the slots,
+/// so a lookup touches at most two cache lines of buckets before it finds the
+/// key, plus the line of the value when it does.
+///
+/// When both buckets of a new key are full, an entry of one of them is evicted
+/// to its other bucket, which may evict another entry, and so on. An entry that
+/// is still homeless after MAX_KICKS evictions goes to the stash. When the
+/// stash grows too large, the table is rebuilt with new hash functions, or
+/// twice the buckets.
+///
+/// @note A MapNode points inside the value array, so it is invalidated by
+/// map_insert() and map_remove().
+
+#include "map.h"
+
+#include <assert.h>  // assert
+#include <stdbool.h> // bool
+#include <stdint.h>  // uint32_t, uint64_t
+#include <stdlib.h>  // malloc, aligned_alloc, realloc, free, size_t
+#include <string.h>  // memset
+
+/// @brief Entries per bucket.
+///
+#define BUCKET_SLOTS 4
+
+/// @brief Smallest number of buckets. Always a power of two.
+///
+#define MIN_BUCKETS 4
+
+/// @brief Maximum load factor before the table grows.
+///
+/// Two choices of 4-way buckets can be filled above 95%, but evictions get
+/// longer close to that.
+///
+#define MAX_LOAD_FACTOR 0.9
+
+/// @brief Evictions tried before an entry goes to the stash.
+///
+#define MAX_KICKS 128
+
+/// @brief Entries of the stash that trigger a rebuild of the table.
+///
+#define STASH_SIZE 8
+
+/// @brief Size of a cache line.
+///
+#define CACHE_LINE 64
+
+/// @brief Value of a slot. A MapNode points to one of these.
+///
+struct map_node {
+  void *value;
+};
+
+/// @brief Hashes and keys of BUCKET_SLOTS slots. A slot is empty when its key
+/// is NULL. The values of bucket b are values[b * BUCKET_SLOTS, ...].
+///
+struct bucket {
+  unsigned int hashes[BUCKET_SLOTS]; // Hash of each key, as returned by
+                                     // hash_function.
+  void *keys[BUCKET_SLOTS];
+} __attribute__((aligned(CACHE_LINE)));
+
+/// @brief An entry of the stash.
+///
+struct stash_entry {
+  void *key;
+  unsigned int hash;
+};
+
+struct map {
+  struct bucket *buckets;
+  struct map_node *values; // BUCKET_SLOTS values per bucket.
+  size_t bucket_count;     // A power of two.
+  size_t size;             // Entries, in the buckets and in the stash.
+  uint64_t seed;           // Seed of the two hash functions.
+  uint32_t random;         // State of the generator of evictions.
+
+  // Entries that found no slot. Lookups scan the stash after the buckets.
+  struct stash_entry *stash;
+  struct map_node *stash_values;
+  size_t stash_size;
+  size_t stash_capacity;
+  size_t stash_limit; // Stash size that triggers a rebuild.
+
+  CompareFunc compare;
+  HashFunc hash_function;
+  DestroyFunc destroy_key;
+  DestroyFunc destroy_value;
+
+  MapSavings savings; // Calls of hash_function and compare avoided, thanks to
+                      // the stored hashes.
+};
+
+/// @brief Mixes 64 bits. (Finalizer of splitmix64.)
+///
+static uint64_t hash_mix(uint64_t h) {
+  h ^= h >> 30;
+  h *= 0xbf58476d1ce4e5b9;
+  h ^= h >> 27;
+  h *= 0x94d049bb133111eb;
+  h ^= h >> 31;
+  return h;
+}
+
+/// @brief Stores in b1 and b2 the two buckets of hash.
+///
+/// The two hash functions are the low and the high half of one 64-bit mix of
+/// hash and seed, so a new seed gives new functions. The buckets always differ.
+///
+static inline void buckets_of(Map map, unsigned int hash, size_t *b1,
+                              size_t *b2) {
+  uint64_t h = hash_mix(hash ^ map->seed);
+  size_t mask = map->bucket_count - 1;
+  *b1 = h & mask;
+  *b2 = (h >> 32) & mask;
+  if (*b2 == *b1)
+    *b2 = *b1 ^ 1;
+}
+
+/// @brief Returns a pseudo-random number, to pick the entries to evict.
+///
+/// Evicting the same entries in the same situation could loop forever.
+///
+static uint32_t random_next(Map map) {
+  uint32_t x = map->random; // xorshift32
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return map->random = x;
+}
+
+/// @brief Returns the smallest number of buckets that holds size entries
+/// within MAX_LOAD_FACTOR.
+///
+static size_t bucket_count_for(size_t size) {
+  size_t count = MIN_BUCKETS;
+  while ((double)size / (count * BUCKET_SLOTS) > MAX_LOAD_FACTOR)
+    count *= 2;
+  return count;
+}
+
+/// @brief Allocates bucket_count empty buckets and their values for map.
+///
+/// @return true, if the allocation succeeded, otherwise false.
+///
+static bool table_allocate(Map map, size_t bucket_count) {
+  struct bucket *buckets =
+      aligned_alloc(CACHE_LINE, bucket_count * sizeof(*buckets));
+  struct map_node *values =
+      malloc(bucket_count * BUCKET_SLOTS * sizeof(*values));
+  if (buckets == NULL || values == NULL) {
+    free(buckets);
+    free(values);
+    return false;
+  }
+  memset(buckets, 0, bucket_count * sizeof(*buckets));
+
+  map->buckets = buckets;
+  map->values = values;
+  map->bucket_count = bucket_count;
+
+  return true;
+}
+
+Map map_create(CompareFunc compare, DestroyFunc destroy_key,
+               DestroyFunc destroy_value) {
+  return map_create_with_capacity(compare, destroy_key, destroy_value, 0);
+}
+
+Map map_create_with_capacity(CompareFunc compare, DestroyFunc destroy_key,
+                             DestroyFunc destroy_value, size_t expected) {
+  Map map = malloc(sizeof(*map));
+  if (map == NULL)
+    return NULL;
+
+  if (!table_allocate(map, bucket_count_for(expected))) {
+    free(map);
+    return NULL;
+  }
+  map->size = 0;
+  map->seed = 0;
+  map->random = 0x9e3779b9;
+
+  map->stash = NULL;
+  map->stash_values = NULL;
+  map->stash_size = 0;
+  map->stash_capacity = 0;
+  map->stash_limit = STASH_SIZE;
+
+  map->compare = compare;
+  map->hash_function = NULL;
+  map->destroy_key = destroy_key;
+  map->destroy_value = destroy_value;
+
+  map->savings.hash_calls = 0;
+  map->savings.compare_calls = 0;
+
+  return map;
+}
+
+/// @brief Calls the destroy functions on every entry of map.
+///
+static void entries_destroy(Map map) {
+  for (size_t b = 0; b < map->bucket_count; b++) {
+    for (int i = 0; i < BUCKET_SLOTS; i++) {
+      if (map->buckets[b].keys[i] == NULL)
+        continue;
+      if (map->destroy_key != NULL)
+        map->destroy_key(map->buckets[b].keys[i]);
+      if (map->destroy_value != NULL)
+        map->destroy_value(map->values[b * BUCKET_SLOTS + i].value);
+    }
+  }
+
+  for (size_t j = 0; j < map->stash_size; j++) {
+    if (map->destroy_key != NULL)
+      map->destroy_key(map->stash[j].key);
+    if (map->destroy_value != NULL)
+      map->destroy_value(map->stash_values[j].value);
+  }
+}
+
+void map_destroy(Map map) {
+  entries_destroy(map);
+
+  free(map->buckets);
+  free(map->values);
+  free(map->stash);
+  free(map->stash_values);
+  free(map);
+}
+
+DestroyFunc map_set_destroy_key(Map map, DestroyFunc destroy_key) {
+  DestroyFunc old = map->destroy_key;
+  map->destroy_key = destroy_key;
+  return old;
+}
+
+DestroyFunc map_set_destroy_value(Map map, DestroyFunc destroy_value) {
+  DestroyFunc old = map->destroy_value;
+  map->destroy_value = destroy_value;
+  return old;
+}
+
+size_t map_size(Map map) { return map->size; }
+
+/// @brief Adds n to a counter of the map's savings.
+///
+/// Lookups may run concurrently (see map_find()), so the counter is read and
+/// written atomically, to not cause a data race. It is not incremented
+/// atomically, which would slow lookups down: concurrent additions may be lost.
+///
+static inline void savings_add(size_t *counter, size_t n) {
+  size_t value = __atomic_load_n(counter, __ATOMIC_RELAXED);
+  __atomic_store_n(counter, value + n, __ATOMIC_RELAXED);
+}
+
+/// @brief Returns the slot of bucket b holding key, or -1 if there is none.
+///
+static inline int bucket_find(Map map, size_t b, void *key,
+                              unsigned int hash) {
+  struct bucket *bucket = &map->buckets[b];
+  for (int i = 0; i < BUCKET_SLOTS; i++) {
+    if (bucket->keys[i] == NULL)
+      continue;
+
+    if (bucket->hashes[i] != hash)
+      savings_add(&map->savings.compare_calls, 1);
+    else if (map->compare(bucket->keys[i], key) == 0)
+      return i;
+  }
+
+  return -1;
+}
+
+/// @brief Returns the node of key with given hash, or MAP_EOF if key is not
+/// part of the map.
+///
+static MapNode node_find(Map map, void *key, unsigned int hash) {
+  size_t b1, b2;
+  buckets_of(map, hash, &b1, &b2);
+
+  int i = bucket_find(map, b1, key, hash);
+  if (i != -1)
+    return &map->values[b1 * BUCKET_SLOTS + i];
+
+  i = bucket_find(map, b2, key, hash);
+  if (i != -1)
+    return &map->values[b2 * BUCKET_SLOTS + i];
+
+  for (size_t j = 0; j < map->stash_size; j++) {
+    if (map->stash[j].hash != hash)
+      savings_add(&map->savings.compare_calls, 1);
+    else if (map->compare(map->stash[j].key, key) == 0)
+      return &map->stash_values[j];
+  }
+
+  return MAP_EOF;
+}
+
+/// @brief Places an entry in a free slot of bucket b, if there is one.
+///
+/// @return true, if the entry was placed, otherwise false.
+///
+static bool bucket_place(Map map, size_t b, void *key, void *value,
+                         unsigned int hash) {
+  struct bucket *bucket = &map->buckets[b];
+  for (int i = 0; i < BUCKET_SLOTS; i++) {
+    if (bucket->keys[i] == NULL) {
+      bucket->keys[i] = key;
+      bucket->hashes[i] = hash;
+      map->values[b * BUCKET_SLOTS + i].value = value;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/// @brief Makes room in the stash for one more entry.
+///
+/// @return true, if there is room, otherwise false (out of memory).
+///
+static bool stash_reserve(Map map) {
+  if (map->stash_size < map->stash_capacity)
+    return true;
+
+  size_t capacity =
+      map->stash_capacity != 0 ? 2 * map->stash_capacity : STASH_SIZE;
+  struct stash_entry *stash =
+      realloc(map->stash, capacity * sizeof(*map->stash));
+  if (stash == NULL)
+    return false;
+  map->stash = stash; // Valid either way, the capacity says how much is used.
+
+  struct map_node *stash_values =
+      realloc(map->stash_values, capacity * sizeof(*map->stash_values));
+  if (stash_values == NULL)
+    return false;
+  map->stash_values = stash_values;
+
+  map->stash_capacity = capacity;
+  return true;
+}
+
+/// @brief Where entry_place() put an entry.
+///
+enum placement { PLACED_IN_BUCKET, PLACED_IN_STASH, NOT_PLACED };
+
+/// @brief Appends an entry to the stash, which has room for it (see
+/// stash_reserve()).
+///
+static void stash_push(Map map, void *key, void *value, unsigned int hash) {
+  assert(map->stash_size < map->stash_capacity);
+
+  map->stash[map->stash_size] = (struct stash_entry){key, hash};
+  map->stash_values[map->stash_size].value = value;
+  map->stash_size++;
+}
+
+/// @brief Removes entry j of the stash, moving the last entry in its place.
+///
+static void stash_remove(Map map, size_t j) {
+  map->stash_size--;
+  map->stash[j] = map->stash[map->stash_size];
+  map->stash_values[j] = map->stash_values[map->stash_size];
+}
+
+/// @brief Places an entry in one of its buckets, evicting other entries to
+/// their other bucket if both are full, or in the stash.
+///
+/// Uses the stored hashes of the evicted entries, so hash_function is not
+/// called.
+///
+/// @return PLACED_IN_BUCKET, PLACED_IN_STASH, or NOT_PLACED if the stash
+/// could not grow, in which case the map is left unchanged.
+///
+static enum placement entry_place(Map map, void *key, void *value,
+                                  unsigned int hash) {
+  size_t b1, b2;
+  buckets_of(map, hash, &b1, &b2);
+  if (bucket_place(map, b1, key, value, hash) ||
+      bucket_place(map, b2, key, value, hash))
+    return PLACED_IN_BUCKET;
+
+  // Evictions may end in the stash: make room first, so that no evicted entry
+  // is left without a place.
+  if (!stash_reserve(map))
+    return NOT_PLACED;
+
+  size_t b = random_next(map) & 1 ? b1 : b2;
+  for (int kick = 0; kick < MAX_KICKS; kick++) {
+    // Swap the entry with a random entry of bucket b, which is full.
+    int i = random_next(map) % BUCKET_SLOTS;
+    struct bucket *bucket = &map->buckets[b];
+    struct map_node *slot_value = &map->values[b * BUCKET_SLOTS + i];
+
+    void *evicted_key = bucket->keys[i];
+    void *evicted_value = slot_value->value;
+    unsigned int evicted_hash = bucket->hashes[i];
+    bucket->keys[i] = key;
+    bucket->hashes[i] = hash;
+    slot_value->value = value;
+
+    key = evicted_key;
+    value = evicted_value;
+    hash = evicted_hash;
+
+    // The evicted entry moves to its other bucket.
+    buckets_of(map, hash, &b1, &b2);
+    b = b == b1 ? b2 : b1;
+    if (bucket_place(map, b, key, value, hash))
+      return PLACED_IN_BUCKET;
+  }
+
+  stash_push(map, key, value, hash);
+  return PLACED_IN_STASH;
+}
+
+/// @brief Rebuilds the table with bucket_count buckets and new hash functions,
+/// placing every entry again.
+///
+/// Uses the stored hashes, so hash_function is not called.
+///
+/// @return true, if the table was rebuilt, otherwise false (out of memory) and
+/// the current table is kept.
+///
+static bool rehash(Map map, size_t bucket_count) {
+  struct bucket *old_buckets = map->buckets;
+  struct map_node *old_values = map->values;
+  size_t old_count = map->bucket_count;
+
+  if (!table_allocate(map, bucket_count))
+    return false; // Keep the current table, the stash keeps growing.
+
+  // The stash is placed again too.
+  struct stash_entry *old_stash = map->stash;
+  struct map_node *old_stash_values = map->stash_values;
+  size_t old_stash_size = map->stash_size;
+  size_t old_stash_capacity = map->stash_capacity;
+  uint64_t old_seed = map->seed;
+  map->stash = NULL;
+  map->stash_values = NULL;
+  map->stash_size = map->stash_capacity = 0;
+
+  map->seed = hash_mix(map->seed + 0x9e3779b97f4a7c15);
+
+  // Entries are copied, so the current table stays intact until the end.
+  bool placed = true;
+  for (size_t b = 0; b < old_count && placed; b++) {
+    for (int i = 0; i < BUCKET_SLOTS && placed; i++) {
+      if (old_buckets[b].keys[i] != NULL) {
+        placed = entry_place(map, old_buckets[b].keys[i],
+                             old_values[b * BUCKET_SLOTS + i].value,
+                             old_buckets[b].hashes[i]) != NOT_PLACED;
+        map->savings.hash_calls++;
+      }
+    }
+  }
+  for (size_t j = 0; j < old_stash_size && placed; j++) {
+    placed = entry_place(map, old_stash[j].key, old_stash_values[j].value,
+                         old_stash[j].hash) != NOT_PLACED;
+    map->savings.hash_calls++;
+  }
+
+  if (!placed) {
+    // Out of memory for the new stash: go back to the current table.
+    free(map->buckets);
+    free(map->values);
+    free(map->stash);
+    free(map->stash_values);
+    map->buckets = old_buckets;
+    map->values = old_values;
+    map->bucket_count = old_count;
+    map->stash = old_stash;
+    map->stash_values = old_stash_values;
+    map->stash_size = old_stash_size;
+    map->stash_capacity = old_stash_capacity;
+    map->seed = old_seed;
+    return false;
+  }
+
+  // If many keys share a hash, no hash function separates them: let the stash
+  // keep them, rather than rebuild on every insertion.
+  map->stash_limit =
+      map->stash_size > STASH_SIZE / 2 ? 2 * map->stash_size : STASH_SIZE;
+
+  free(old_buckets);
+  free(old_values);
+  free(old_stash);
+  free(old_stash_values);
+  return true;
+}
+
+/// @brief Returns the node of key, which was just placed by entry_place(),
+/// comparing addresses of keys instead of calling compare.
+///
+static MapNode node_of_placed(Map map, void *key, unsigned int hash) {
+  size_t b[2];
+  buckets_of(map, hash, &b[0], &b[1]);
+  for (int k = 0; k < 2; k++) {
+    for (int i = 0; i < BUCKET_SLOTS; i++) {
+      if (map->buckets[b[k]].keys[i] == key)
+        return &map->values[b[k] * BUCKET_SLOTS + i];
+    }
+  }
+
+  for (size_t j = 0; j < map->stash_size; j++) {
+    if (map->stash[j].key == key)
+      return &map->stash_values[j];
+  }
+
+  assert(false && "Placed key not found");
+  return MAP_EOF;
+}
+
+/// @brief Returns the node of key, inserting key with value NULL if it is not
+/// part of the map.
+///
+/// @param hash Hash of key, as returned by hash_function.
+/// @param inserted Set to true, if key was inserted, otherwise false.
+///
+/// @return Node of key, or MAP_EOF if key could not be inserted (out of
+/// memory).
+///
+static MapNode node_find_or_insert(Map map, void *key, unsigned int hash,
+                                   bool *inserted) {
+  MapNode node = node_find(map, key, hash);
+  if (node != MAP_EOF) {
+    *inserted = false;
+    return node;
+  }
+
+  if ((double)(map->size + 1) / (map->bucket_count * BUCKET_SLOTS) >
+      MAX_LOAD_FACTOR)
+    rehash(map, 2 * map->bucket_count);
+
+  enum placement placement = entry_place(map, key, NULL, hash);
+  if (placement == NOT_PLACED) {
+    *inserted = false;
+    return MAP_EOF;
+  }
+
+  map->size++;
+
+  // A full stash is rare below MAX_LOAD_FACTOR: try new hash functions first,
+  // and only double the buckets if the table is more than half full.
+  if (placement == PLACED_IN_STASH && map->stash_size > map->stash_limit) {
+    bool half_full = map->size > map->bucket_count * BUCKET_SLOTS / 2;
+    rehash(map, half_full ? 2 * map->bucket_count : map->bucket_count);
+  }
+
+  *inserted = true;
+  return node_of_placed(map, key, hash);
+}
+
+void map_reserve(Map map, size_t n) {
+  size_t bucket_count = bucket_count_for(n);
+  if (bucket_count > map->bucket_count)
+    rehash(map, bucket_count);
+}
+
+void map_shrink_to_fit(Map map) {
+  size_t bucket_count = bucket_count_for(map->size);
+  if (bucket_count < map->bucket_count)
+    rehash(map, bucket_count);
+}
+
+/// @brief Returns the key of node.
+///
+static void **node_key(Map map, MapNode node) {
+  if (node >= map->values &&
+      node < map->values + map->bucket_count * BUCKET_SLOTS) {
+    size_t pos = node - map->values;
+    return &map->buckets[pos / BUCKET_SLOTS].keys[pos % BUCKET_SLOTS];
+  }
+
+  return &map->stash[node - map->stash_values].key;
+}
+
+/// @brief Associates node, returned by node_find_or_insert(), with key and
+/// value.
+///
+/// @param inserted true, if node was inserted, otherwise its previous key and
+/// value are destroyed.
+///
+static void node_set(Map map, MapNode node, bool inserted, void *key,
+                     void *value) {
+  if (!inserted) {
+    void **node_key_address = node_key(map, node);
+
+    // Destroy old key, value pair
+    if (map->destroy_key != NULL)
+      map->destroy_key(*node_key_address);
+    if (map->destroy_value != NULL)
+      map->destroy_value(node->value);
+
+    *node_key_address = key;
+  }
+
+  node->value = value;
+}
+
+void map_insert(Map map, void *key, void *value) {
+  assert(map->hash_function != NULL && key != NULL &&
+         "Expected key and hash function");
+
+  bool inserted;
+  MapNode node =
+      node_find_or_insert(map, key, map->hash_function(key), &inserted);
+  if (node != MAP_EOF)
+    node_set(map, node, inserted, key, value);
+}
+
+void **map_find_or_insert(Map map, void *key, bool *inserted) {
+  assert(map->hash_function != NULL && key != NULL &&
+         "Expected key and hash function");
+
+  MapNode node =
+      node_find_or_insert(map, key, map->hash_function(key), inserted);
+  return node != MAP_EOF ? &node->value : NULL;
+}
+
+bool map_update(Map map, void *key, MapUpdateFunc update, void *context) {
+  assert(map->hash_function != NULL && key != NULL &&
+         "Expected key and hash function");
+
+  bool inserted;
+  MapNode node =
+      node_find_or_insert(map, key, map->hash_function(key), &inserted);
+  if (node == MAP_EOF)
+    return false; // Out of memory, key was not inserted.
+
+  update(&node->value, context);
+
+  return inserted;
+}
+
+bool map_remove(Map map, void *key) {
+  assert(map->hash_function != NULL && key != NULL &&
+         "Expected key and hash function");
+
+  unsigned int hash = map->hash_function(key);
+  MapNode node = node_find(map, key, hash);
+  if (node == MAP_EOF)
+    return false;
+
+  void **key_address = node_key(map, node);
+  if (map->destroy_key != NULL)
+    map->destroy_key(*key_address);
+  if (map->destroy_value != NULL)
+    map->destroy_value(node->value);
+
+  map->size--;
+
+  if (node < map->values ||
+      node >= map->values + map->bucket_count * BUCKET_SLOTS) {
+    stash_remove(map, node - map->stash_values);
+    return true;
+  }
+
+  *key_address = NULL;
+
+  // The slot is free: move back an entry of the stash that belongs here.
+  size_t b = (node - map->values) / BUCKET_SLOTS;
+  for (size_t j = 0; j < map->stash_size; j++) {
+    size_t b1, b2;
+    buckets_of(map, map->stash[j].hash, &b1, &b2);
+    if (b1 == b || b2 == b) {
+      bucket_place(map, b, map->stash[j].key, map->stash_values[j].value,
+                   map->stash[j].hash);
+      stash_remove(map, j);
+      break;
+    }
+  }
+
+  return true;
+}
+
+void *map_find(Map map, void *key) {
+  MapNode node = map_find_node(map, key);
+  return node != MAP_EOF ? node->value : NULL;
+}
+
+MapNode map_find_node(Map map, void *key) {
+  assert(map->hash_function != NULL && key != NULL &&
+         "Expected key and hash function");
+
+  return node_find(map, key, map->hash_function(key));
+}
+
+void *map_node_key(Map map, MapNode node) { return *node_key(map, node); }
+
+void *map_node_value(Map map, MapNode node) { return node->value; }
+
+/////////////////////////////// Traversal //////////////////////////////////////
+
+// Positions [0, slots) of the traversal are the slots of the buckets, the
+// following ones the entries of the stash.
+
+/// @brief Returns the node at the first occupied position at or after pos, or
+/// MAP_EOF if there is none, and stores its position in pos.
+///
+static MapNode node_next_occupied(Map map, size_t *pos) {
+  size_t slots = map->bucket_count * BUCKET_SLOTS;
+  for (; *pos < slots; (*pos)++) {
+    if (map->buckets[*pos / BUCKET_SLOTS].keys[*pos % BUCKET_SLOTS] != NULL)
+      return &map->values[*pos];
+  }
+
+  if (*pos < slots + map->stash_size)
+    return &map->stash_values[*pos - slots];
+
+  return MAP_EOF;
+}
+
+/// @brief Returns the position of node in the traversal.
+///
+static size_t node_position(Map map, MapNode node) {
+  size_t slots = map->bucket_count * BUCKET_SLOTS;
+  if (node >= map->values && node < map->values + slots)
+    return node - map->values;
+
+  return slots + (node - map->stash_values);
+}
+
+MapNode map_first(Map map) {
+  size_t pos = 0;
+  return node_next_occupied(map, &pos);
+}
+
+MapNode map_next(Map map, MapNode node) {
+  assert(node != NULL);
+  size_t pos = node_position(map, node) + 1;
+  return node_next_occupied(map, &pos);
+}
+
+MapIterator map_iter_begin(Map map) {
+  MapIterator iter;
+  iter.position = 0;
+  iter.node = node_next_occupied(map, &iter.position);
+  iter.cursor = NULL;
+  return iter;
+}
+
+bool map_iter_valid(Map map, MapIterator *iter) {
+  return iter->node != MAP_EOF;
+}
+
+void map_iter_next(Map map, MapIterator *iter) {
+  assert(iter->node != MAP_EOF);
+  iter->position++;
+  iter->node = node_next_occupied(map, &iter->position);
+}
+
+MapNode map_iter_node(Map map, MapIterator *iter) { return iter->node; }
+
+//////////////////////////////// Batches ///////////////////////////////////////
+
+// A batch is pipelined: while key i is looked up, both buckets of key
+// i + 2 * BATCH_DISTANCE are prefetched, and, since the buckets of key
+// i + BATCH_DISTANCE were prefetched BATCH_DISTANCE keys ago, the keys and
+// values of their slots whose hash matches too.
+
+/// @brief Keys between the two prefetches of a key, and between the second
+/// prefetch and the lookup.
+///
+#define BATCH_DISTANCE 8
+
+/// @brief Hashes of the keys in flight, indexed by position % BATCH_WINDOW.
+///
+#define BATCH_WINDOW (2 * BATCH_DISTANCE)
+
+/// @brief First prefetch of a batch: both buckets of hash.
+///
+static inline void prefetch_buckets(Map map, unsigned int hash) {
+  size_t b1, b2;
+  buckets_of(map, hash, &b1, &b2);
+  __builtin_prefetch(&map->buckets[b1]);
+  __builtin_prefetch(&map->buckets[b2]);
+}
+
+/// @brief Second prefetch of a batch: the keys and values of the slots of
+/// both buckets whose hash matches.
+///
+static inline void prefetch_entries(Map map, unsigned int hash) {
+  size_t b[2];
+  buckets_of(map, hash, &b[0], &b[1]);
+  for (int k = 0; k < 2; k++) {
+    struct bucket *bucket = &map->buckets[b[k]];
+    for (int i = 0; i < BUCKET_SLOTS; i++) {
+      if (bucket->keys[i] != NULL && bucket->hashes[i] == hash) {
+        __builtin_prefetch(bucket->keys[i]);
+        __builtin_prefetch(&map->values[b[k] * BUCKET_SLOTS + i]);
+      }
+    }
+  }
+}
+
+void map_find_batch(Map map, void **keys, size_t n, void **values) {
+  assert(map->hash_function != NULL && "Expected hash function");
+
+  unsigned int hashes[BATCH_WINDOW];
+  for (size_t i = 0; i < n + BATCH_WINDOW; i++) {
+    // The oldest key first, as the newest one takes its place in hashes.
+    if (i >= BATCH_WINDOW) {
+      size_t k = i - BATCH_WINDOW;
+      MapNode node = node_find(map, keys[k], hashes[k % BATCH_WINDOW]);
+      values[k] = node != MAP_EOF ? node->value : NULL;
+    }
+
+    if (i >= BATCH_DISTANCE && i - BATCH_DISTANCE < n)
+      prefetch_entries(map, hashes[(i - BATCH_DISTANCE) % BATCH_WINDOW]);
+
+    if (i < n) {
+      assert(keys[i] != NULL && "Expected key");
+      hashes[i % BATCH_WINDOW] = map->hash_function(keys[i]);
+      prefetch_buckets(map, hashes[i % BATCH_WINDOW]);
+    }
+  }
+}
+
+void map_insert_batch(Map map, void **keys, size_t n, void **values) {
+  assert(map->hash_function != NULL && "Expected hash function");
+
+  // Same pipeline as map_find_batch(). A rehash in the middle of the batch
+  // only makes the prefetches of the keys in flight useless.
+  unsigned int hashes[BATCH_WINDOW];
+  for (size_t i = 0; i < n + BATCH_WINDOW; i++) {
+    if (i >= BATCH_WINDOW) {
+      size_t k = i - BATCH_WINDOW;
+      bool inserted;
+      MapNode node = node_find_or_insert(map, keys[k],
+                                         hashes[k % BATCH_WINDOW], &inserted);
+      if (node != MAP_EOF)
+        node_set(map, node, inserted, keys[k], values[k]);
+    }
+
+    if (i >= BATCH_DISTANCE && i - BATCH_DISTANCE < n)
+      prefetch_entries(map, hashes[(i - BATCH_DISTANCE) % BATCH_WINDOW]);
+
+    if (i < n) {
+      assert(keys[i] != NULL && "Expected key");
+      hashes[i % BATCH_WINDOW] = map->hash_function(keys[i]);
+      prefetch_buckets(map, hashes[i % BATCH_WINDOW]);
+    }
+  }
+}
+
+void map_savings(Map map, MapSavings *savings) { *savings = map->savings; }
+
+void map_set_hash_function(Map map, HashFunc func) {
+  map->hash_function = func;
+}
+
+unsigned int hash_string(void *value) {
+  // djb2 hash function, simple, fast, and generally efficient.
+  unsigned int hash = 5381;
+  for (char *s = value; *s != '\0'; s++)
+    hash = (hash << 5) + hash + *s; // hash * 33 + *s
+  return hash;
+}
+
+unsigned int hash_int(void *value) { return *(int *)value; }
+
+unsigned int hash_pointer(void *value) { return (size_t)value; }
@@ -0,0 +1,278 @@
+/// @file epoch.c
+///
+/// Implementation of epoch-based reclamation, with three epochs.
+///
+/// A domain has a global epoch, and a slot per thread where a reader announces
+/// the epoch it entered its critical section in. A destruction deferred during
+/// epoch e goes to the limbo bag of e. The global epoch only advances from e to
+/// e + 1 when every reader in a critical section has announced e, so once it
+/// reaches e + 2 no reader can still see what was deferred during e, and the
+/// bag of e is emptied. Three bags, indexed by epoch % 3, are enough.
+///
+/// Threads are numbered by a registry shared by all domains, so that a thread
+/// uses the same slot in every domain.
+
+#include "epoch.h"
+
+#include <assert.h>  // assert
+#include <pthread.h> // pthread_mutex_t, pthread_key_t, pthread_once
+#include <sched.h>   // sched_yield
+#include <stdbool.h> // bool
+#include <stdint.h>  // uint64_t, intptr_t
+#include <stdio.h>   // fprintf, stderr
+#include <stdlib.h>  // abort, aligned_alloc, free, realloc
+#include <string.h>  // memset
+
+/// @brief Size of a cache line.
+///
+#define CACHE_LINE 64
+
+/// @brief Deferred destructions per bag, before a writer tries to advance the
+/// epoch. Advancing reads the slot of every thread.
+///
+#define RECLAIM_THRESHOLD 64
+
+/// @brief Slot of a thread in a domain. Written only by its thread.
+///
+/// Each slot takes a whole cache line, so that readers do not invalidate each
+/// other's caches.
+///
+struct epoch_slot {
+  uint64_t epoch;   // Epoch of the critical section, or 0 outside of one.
+  unsigned nesting; // Depth of nested critical sections.
+} __attribute__((aligned(CACHE_LINE)));
+
+/// @brief A deferred destruction.
+///
+struct deferred {
+  DestroyFunc destroy;
+  void *pointer;
+};
+
+/// @brief Destructions deferred during an epoch.
+///
+struct bag {
+  struct deferred *array;
+  size_t size;
+  size_t capacity;
+};
+
+struct epoch_domain {
+  uint64_t epoch; // Global epoch, starting at 1. Only advanced under lock.
+
+  pthread_mutex_t lock; // Guards the bags and running.
+  struct bag bags[3];   // Bag of epoch e is bags[e % 3].
+  int running;          // Bags taken out of the domain, that are being run.
+
+  struct epoch_slot slots[EPOCH_MAX_THREADS];
+};
+
+////////////////////////////// Thread registry /////////////////////////////////
+
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static bool registry_taken[EPOCH_MAX_THREADS];
+static pthread_once_t registry_once = PTHREAD_ONCE_INIT;
+static pthread_key_t registry_key; // Releases the number of a thread at exit.
+
+/// @brief Number of the current thread, or -1 if it has none yet.
+///
+static _Thread_local int thread_number = -1;
+
+/// @brief Gives the number of an exiting thread back to the registry.
+///
+static void registry_release(void *value) {
+  pthread_mutex_lock(&registry_lock);
+  registry_taken[(intptr_t)value - 1] = false;
+  pthread_mutex_unlock(&registry_lock);
+}
+
+static void registry_init(void) {
+  pthread_key_create(&registry_key, registry_release);
+}
+
+/// @brief Returns the number of the current thread, taking a free one on the
+/// first call.
+///
+static int registry_number(void) {
+  if (thread_number != -1)
+    return thread_number;
+
+  pthread_once(&registry_once, registry_init);
+
+  pthread_mutex_lock(&registry_lock);
+  int number = 0;
+  while (number < EPOCH_MAX_THREADS && registry_taken[number])
+    number++;
+  if (number == EPOCH_MAX_THREADS) {
+    // Every slot is taken, and a reader without one could not be waited for.
+    fprintf(stderr, "epoch: more than %d threads use epochs\n",
+            EPOCH_MAX_THREADS);
+    abort();
+  }
+  registry_taken[number] = true;
+  pthread_mutex_unlock(&registry_lock);
+
+  // Stored as number + 1: destructors are not called for NULL values.
+  pthread_setspecific(registry_key, (void *)(intptr_t)(number + 1));
+  thread_number = number;
+
+  return number;
+}
+
+//////////////////////////////////// Domain ////////////////////////////////////
+
+EpochDomain epoch_domain_create(void) {
+  EpochDomain domain = aligned_alloc(CACHE_LINE, sizeof(*domain));
+  if (domain == NULL)
+    return NULL;
+
+  memset(domain, 0, sizeof(*domain)); // Empty bags, and no critical sections.
+  domain->epoch = 1;
+  pthread_mutex_init(&domain->lock, NULL);
+
+  return domain;
+}
+
+/// @brief Runs and empties the deferred destructions of bag.
+///
+static void bag_run(struct bag *bag) {
+  for (size_t i = 0; i < bag->size; i++)
+    bag->array[i].destroy(bag->array[i].pointer);
+
+  free(bag->array);
+  bag->array = NULL;
+  bag->size = bag->capacity = 0;
+}
+
+void epoch_domain_destroy(EpochDomain domain) {
+  for (int i = 0; i < 3; i++)
+    bag_run(&domain->bags[i]);
+
+  pthread_mutex_destroy(&domain->lock);
+  free(domain);
+}
+
+void epoch_enter(EpochDomain domain) {
+  struct epoch_slot *slot = &domain->slots[registry_number()];
+  if (slot->nesting++ != 0)
+    return;
+
+  // Announce the epoch, before reading anything of the data structure. The
+  // fence orders the store before the loads that follow, and only touches
+  // memory of this thread.
+  uint64_t epoch = __atomic_load_n(&domain->epoch, __ATOMIC_RELAXED);
+  __atomic_store_n(&slot->epoch, epoch, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+void epoch_exit(EpochDomain domain) {
+  struct epoch_slot *slot = &domain->slots[thread_number];
+  assert(slot->nesting > 0 && "epoch_exit() without epoch_enter()");
+  if (--slot->nesting != 0)
+    return;
+
+  // Reads of the critical section happen before the slot is cleared.
+  __atomic_store_n(&slot->epoch, 0, __ATOMIC_RELEASE);
+}
+
+/// @brief Advances the global epoch, if every critical section in progress
+/// has announced it.
+///
+/// Called under domain->lock.
+///
+/// @param expired Set to the bag that can be run, if the epoch advanced. It
+/// is taken out of the domain, to run it without holding the lock, and must be
+/// passed to bag_run_expired().
+///
+/// @return true, if the epoch advanced.
+///
+static bool try_advance(EpochDomain domain, struct bag *expired) {
+  uint64_t epoch = domain->epoch;
+
+  // Pairs with the fence of epoch_enter(): a reader whose announcement is not
+  // seen here, sees every removal that happened before.
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  for (int i = 0; i < EPOCH_MAX_THREADS; i++) {
+    uint64_t announced =
+        __atomic_load_n(&domain->slots[i].epoch, __ATOMIC_ACQUIRE);
+    if (announced != 0 && announced != epoch)
+      return false;
+  }
+
+  __atomic_store_n(&domain->epoch, epoch + 1, __ATOMIC_RELEASE);
+
+  // The bag of epoch - 1 (same index as epoch + 2) is no longer reachable.
+  struct bag *bag = &domain->bags[(epoch + 2) % 3];
+  *expired = *bag;
+  bag->array = NULL;
+  bag->size = bag->capacity = 0;
+  domain->running++;
+
+  return true;
+}
+
+/// @brief Runs a bag taken out of domain by try_advance().
+///
+/// Called without holding domain->lock.
+///
+static void bag_run_expired(EpochDomain domain, struct bag *expired) {
+  bag_run(expired);
+
+  pthread_mutex_lock(&domain->lock);
+  domain->running--;
+  pthread_mutex_unlock(&domain->lock);
+}
+
+void epoch_defer(EpochDomain domain, DestroyFunc destroy, void *pointer) {
+  pthread_mutex_lock(&domain->lock);
+
+  struct bag *bag = &domain->bags[domain->epoch % 3];
+  if (bag->size == bag->capacity) {
+    size_t capacity = bag->capacity != 0 ? 2 * bag->capacity : 16;
+    struct deferred *array =
+        realloc(bag->array, capacity * sizeof(*bag->array));
+    if (array == NULL) {
+      // Out of memory: leak pointer, rather than destroy it while it may be
+      // in use.
+      pthread_mutex_unlock(&domain->lock);
+      return;
+    }
+    bag->array = array;
+    bag->capacity = capacity;
+  }
+  bag->array[bag->size++] = (struct deferred){destroy, pointer};
+
+  struct bag expired = {NULL, 0, 0};
+  bool advanced = bag->size % RECLAIM_THRESHOLD == 0 &&
+                  try_advance(domain, &expired);
+
+  pthread_mutex_unlock(&domain->lock);
+
+  // Destructions may defer more destructions, so run them without the lock.
+  if (advanced)
+    bag_run_expired(domain, &expired);
+}
+
+void epoch_synchronize(EpochDomain domain) {
+  // Everything deferred so far is in the bags of the current and previous
+  // epoch, so two more epochs later they are all run.
+  pthread_mutex_lock(&domain->lock);
+  uint64_t target = domain->epoch + 2;
+  pthread_mutex_unlock(&domain->lock);
+
+  for (;;) {
+    pthread_mutex_lock(&domain->lock);
+    struct bag expired = {NULL, 0, 0};
+    bool reached = domain->epoch >= target;
+    bool done = reached && domain->running == 0;
+    bool advanced = !reached && try_advance(domain, &expired);
+    pthread_mutex_unlock(&domain->lock);
+
+    if (done)
+      return;
+    if (advanced)
+      bag_run_expired(domain, &expired);
+    else
+      sched_yield(); // Wait for the readers, or for other threads running bags.
+  }
+}
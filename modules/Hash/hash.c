@@ -0,0 +1,160 @@
+/// @file hash.c
+///
+/// Implementation of the hash module: strings and bytes are hashed with wyhash
+/// (final version 4), integers and addresses with the finalizer of splitmix64,
+/// and the seed of the process is read from getrandom() before main() runs.
+
+#include "hash.h"
+
+#include <stdint.h>     // uint64_t, uint32_t, uint8_t, uintptr_t
+#include <string.h>     // memcpy, strlen
+#include <sys/random.h> // getrandom
+#include <time.h>       // time
+#include <unistd.h>     // getpid
+
+// The string hash follows wyhash (final version 4) by Wang Yi, released to the
+// public domain: https://github.com/wangyi-fudan/wyhash
+
+/// @brief Secret of wyhash: odd constants with 32 set bits.
+///
+static const uint64_t secret[4] = {0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull,
+                                   0x4b33a62ed433d4a3ull, 0x4d5a2da51de1aa47ull};
+
+/// @brief Seed of the process.
+///
+static uint64_t process_seed;
+
+/// @brief Returns the high 64 bits of a * b xor-ed with the low ones.
+///
+static inline uint64_t mix(uint64_t a, uint64_t b) {
+  __uint128_t product = (__uint128_t)a * b;
+  return (uint64_t)product ^ (uint64_t)(product >> 64);
+}
+
+/// @brief Reads 8 bytes at p, aligned or not.
+///
+static inline uint64_t read8(const uint8_t *p) {
+  uint64_t value;
+  memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+/// @brief Reads 4 bytes at p, aligned or not.
+///
+static inline uint64_t read4(const uint8_t *p) {
+  uint32_t value;
+  memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+/// @brief Reads 1 to 3 bytes at p, the first, middle and last one.
+///
+static inline uint64_t read3(const uint8_t *p, size_t size) {
+  return ((uint64_t)p[0] << 16) | ((uint64_t)p[size >> 1] << 8) | p[size - 1];
+}
+
+uint64_t hash_bytes(const void *data, size_t size, uint64_t seed) {
+  const uint8_t *p = data;
+  uint64_t a, b;
+
+  seed ^= mix(seed ^ secret[0], secret[1]);
+
+  if (size <= 16) {
+    // Two possibly overlapping reads cover all the bytes.
+    if (size >= 4) {
+      size_t middle = (size >> 3) << 2; // 0 or 4
+      a = (read4(p) << 32) | read4(p + middle);
+      b = (read4(p + size - 4) << 32) | read4(p + size - 4 - middle);
+    } else if (size > 0) {
+      a = read3(p, size);
+      b = 0;
+    } else {
+      a = b = 0;
+    }
+  } else {
+    size_t i = size;
+
+    // Three independent lanes, to keep the multiplier busy.
+    if (i >= 48) {
+      uint64_t seed1 = seed, seed2 = seed;
+      do {
+        seed = mix(read8(p) ^ secret[1], read8(p + 8) ^ seed);
+        seed1 = mix(read8(p + 16) ^ secret[2], read8(p + 24) ^ seed1);
+        seed2 = mix(read8(p + 32) ^ secret[3], read8(p + 40) ^ seed2);
+        p += 48;
+        i -= 48;
+      } while (i >= 48);
+      seed ^= seed1 ^ seed2;
+    }
+
+    while (i > 16) {
+      seed = mix(read8(p) ^ secret[1], read8(p + 8) ^ seed);
+      p += 16;
+      i -= 16;
+    }
+
+    // The last 16 bytes, which may overlap the ones already read.
+    a = read8(p + i - 16);
+    b = read8(p + i - 8);
+  }
+
+  a ^= secret[1];
+  b ^= seed;
+  __uint128_t product = (__uint128_t)a * b;
+  a = (uint64_t)product;
+  b = (uint64_t)(product >> 64);
+
+  return mix(a ^ secret[0] ^ size, b ^ secret[1]);
+}
+
+uint64_t hash_u64(uint64_t value, uint64_t seed) {
+  // The finalizer of splitmix64. Every step is invertible, so no two values
+  // collide.
+  uint64_t x = (value ^ seed) + 0x9e3779b97f4a7c15ull;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+  return x ^ (x >> 31);
+}
+
+uint64_t hash_address(const void *pointer, uint64_t seed) {
+  // Rotate the alignment bits to the top, instead of shifting them out:
+  // addresses of chars are not aligned at all.
+  uint64_t address = (uintptr_t)pointer;
+  return hash_u64(address >> 4 | address << 60, seed);
+}
+
+/// @brief Picks a random seed for the process, before main() runs.
+///
+__attribute__((constructor)) static void seed_process(void) {
+  uint64_t seed;
+  if (getrandom(&seed, sizeof(seed), GRND_NONBLOCK) != sizeof(seed)) {
+    // No entropy yet, e.g. early at boot. Fall back to what differs between
+    // runs: the time, the pid and, with ASLR, the addresses.
+    seed = hash_u64((uint64_t)time(NULL), (uint64_t)getpid());
+    seed = hash_address(&seed, seed);
+  }
+
+  process_seed = seed;
+}
+
+uint64_t hash_seed(void) { return process_seed; }
+
+void hash_set_seed(uint64_t seed) { process_seed = seed; }
+
+/// @brief Folds a 64-bit hash to 32 bits.
+///
+static inline unsigned int fold(uint64_t hash) {
+  return (unsigned int)(hash ^ (hash >> 32));
+}
+
+unsigned int hash_string_seeded(void *value) {
+  return fold(hash_bytes(value, strlen(value), process_seed));
+}
+
+unsigned int hash_int_seeded(void *value) {
+  return fold(hash_u64((uint64_t)*(int *)value, process_seed));
+}
+
+unsigned int hash_pointer_seeded(void *value) {
+  return fold(hash_address(value, process_seed));
+}
@@ -1,8 +1,30 @@
+/// @file map.c
+///
+/// Implementation of Map Abstract Data Type using a hash table with separate
+/// chaining.
+///
+/// By default the capacity is a prime, and a hash is reduced to a bucket with
+/// `hash % capacity`. Define MAP_POWER_OF_TWO to use power of two capacities
+/// instead: a hash is then reduced with a mask, which is much cheaper than the
+/// division, and hashes are mixed first so that every bit of them affects the
+/// bucket.
+///
+/// A map that holds at most SMALL_CAPACITY entries has no table at all: its
+/// entries are stored inline in the map and found by a linear scan. It moves to
+/// a table once it outgrows them, and back with map_shrink_to_fit().
+///
+/// Define MAP_STATS to count the calls of the hash and compare functions and
+/// the resizes of every map, reported by map_stats().
+
 #include "map.h"
 
 #include <assert.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
+#ifdef MAP_STATS
+#include <time.h> // clock_gettime
+#endif
 
 #include "slist.h"
 
@@ -22,19 +44,51 @@ int prime_sizes[] = {
 // έχουμε αποδoτικές πράξεις
 #define MAX_LOAD_FACTOR 0.9
 
+/// @brief Smallest capacity, when MAP_POWER_OF_TWO is defined.
+///
+#define MIN_CAPACITY 64
+
+/// @brief Most entries of a map without a table.
+///
+/// A scan of a few entries, that compares cached hashes first, is as fast as a
+/// lookup in a table, without allocating its buckets.
+///
+#define SMALL_CAPACITY 8
+
 // Δομή του κάθε κόμβου που έχει το hash table (με το οποίο υλοιποιούμε το map)
 
 // Το MapNode περιέχει τα δεδομένα
 struct map_node {
   void *key; // Το κλειδί που χρησιμοποιείται για να hash-αρουμε
   void *value; // Η τιμή που αντισοιχίζεται στο παραπάνω κλειδί
+  unsigned int hash; // Cached hash of key. Keys with different hashes are not
+                     // compared, and the key is never hashed again.
 };
 
+/// @brief Maximum number of buckets migrated by a single operation while the
+/// table is being resized.
+///
+/// The new table has about twice the buckets of the old one, so the migration
+/// always completes long before the new table reaches MAX_LOAD_FACTOR.
+///
+#define MIGRATE_BUCKETS 4
+
 // Δομή του Map (περιέχει όλες τις πληροφορίες που χρεαζόμαστε για το HashTable)
 struct map {
-  SList *array; // Array of slists (buckets)
-  int capacity; // Πόσο χώρο έχουμε δεσμεύσει.
+  SList *array; // Array of slists (buckets). Empty buckets may be NULL: a
+                // bucket's slist is only created when its first entry arrives.
+                // NULL if the map is small.
+  int capacity; // Πόσο χώρο έχουμε δεσμεύσει. 0 if the map is small.
   int size;     // Πόσα στοιχεία έχουμε προσθέσει
+
+  // Incremental rehashing. While old_array is not NULL, the entries of its
+  // buckets [migrate_pos, old_capacity) have not been moved to array yet.
+  SList *old_array;
+  int old_capacity;
+  int migrate_pos; // Next bucket of old_array to migrate. Only insertions and
+                   // removals migrate buckets: lookups and traversals never
+                   // modify the map.
+
   CompareFunc compare; // Συνάρτηση για σύγκρηση δεικτών, που πρέπει να δίνεται
                        // απο τον χρήστη
   HashFunc hash_function; // Συνάρτηση για να παίρνουμε το hash code του κάθε
@@ -42,141 +96,624 @@ struct map {
   DestroyFunc destroy_key; // Συναρτήσεις που καλούνται όταν διαγράφουμε έναν
                            // κόμβο απο το map.
   DestroyFunc destroy_value;
+
+  MapSavings savings; // Calls of hash_function and compare avoided, thanks to
+                      // the cached hashes.
+
+  struct map_node small[SMALL_CAPACITY]; // Entries [0, size) of a small map,
+                                         // in insertion order.
+
+#ifdef MAP_STATS
+  MapStats stats; // Counters of map_stats(). The shape of the table is
+                  // computed by map_stats() itself.
+#endif
 };
 
+/// @brief Adds n to a counter of the map's savings.
+///
+/// Lookups may run concurrently (see map_find()), so the counter is read and
+/// written atomically, to not cause a data race. It is not incremented
+/// atomically, which would slow lookups down: concurrent additions may be lost.
+///
+static inline void savings_add(size_t *counter, size_t n) {
+  size_t value = __atomic_load_n(counter, __ATOMIC_RELAXED);
+  __atomic_store_n(counter, value + n, __ATOMIC_RELAXED);
+}
+
+// Without MAP_STATS, the following functions do nothing and are compiled away.
+
+/// @brief Returns the time, to measure a resize with stats_resized().
+///
+static inline double stats_clock(void) {
+#ifdef MAP_STATS
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec / 1e9;
+#else
+  return 0;
+#endif
+}
+
+/// @brief Adds the time since start, returned by stats_clock(), to the time
+/// spent resizing map.
+///
+static inline void stats_resized(Map map, double start) {
+#ifdef MAP_STATS
+  map->stats.rehash_seconds += stats_clock() - start;
+#endif
+}
+
+/// @brief Counts a new table of map.
+///
+static inline void stats_rehashed(Map map) {
+#ifdef MAP_STATS
+  map->stats.rehashes++;
+#endif
+}
+
+/// @brief Returns hash_function(key), counting the call.
+///
+static inline unsigned int stats_hash(Map map, void *key) {
+#ifdef MAP_STATS
+  savings_add(&map->stats.hash_calls, 1);
+#endif
+  return map->hash_function(key);
+}
+
+/// @brief Returns compare(a, b), counting the call.
+///
+static inline int stats_compare(Map map, void *a, void *b) {
+#ifdef MAP_STATS
+  savings_add(&map->stats.compare_calls, 1);
+#endif
+  return map->compare(a, b);
+}
+
+/// @brief Returns the smallest capacity that holds size entries within
+/// MAX_LOAD_FACTOR.
+///
+static int capacity_for(size_t size) {
+#ifdef MAP_POWER_OF_TWO
+  int capacity = MIN_CAPACITY;
+  while ((float)size / capacity > MAX_LOAD_FACTOR)
+    capacity *= 2;
+  return capacity;
+#else
+  int prime_no = sizeof(prime_sizes) / sizeof(int); // το μέγεθος του πίνακα
+  for (int i = 0; i < prime_no; i++) {
+    if ((float)size / prime_sizes[i] <= MAX_LOAD_FACTOR)
+      return prime_sizes[i];
+  }
+
+  // Αν έχουμε εξαντλήσει όλους τους πρώτους, διπλασιάζουμε
+  int capacity = prime_sizes[prime_no - 1]; // LCOV_EXCL_LINE
+  while ((float)size / capacity > MAX_LOAD_FACTOR) // LCOV_EXCL_LINE
+    capacity *= 2;                                 // LCOV_EXCL_LINE
+  return capacity;                                 // LCOV_EXCL_LINE
+#endif
+}
+
 Map map_create(CompareFunc compare, DestroyFunc destroy_key,
                DestroyFunc destroy_value) {
+  return map_create_with_capacity(compare, destroy_key, destroy_value, 0);
+}
+
+Map map_create_with_capacity(CompareFunc compare, DestroyFunc destroy_key,
+                             DestroyFunc destroy_value, size_t expected) {
   // Δεσμεύουμε κατάλληλα τον χώρο που χρειαζόμαστε για το hash table
   Map map = malloc(sizeof(*map));
   if (map == NULL) {
     return NULL;
   }
 
-  map->capacity = prime_sizes[0];
+  // A map expected to stay small starts without a table.
+  map->capacity = expected <= SMALL_CAPACITY ? 0 : capacity_for(expected);
+  map->array = NULL;
 
-  // Αρχικοποιούμε τους κόμβους που έχουμε σαν διαθέσιμους.
-  map->array = malloc(map->capacity * sizeof(*map->array));
-  if (map->array == NULL) {
-    return NULL;
-  }
-  for (int i = 0; i < map->capacity; i++) {
-    map->array[i] = slist_create(NULL);
+  // Every bucket starts empty, without an slist.
+  if (map->capacity != 0) {
+    map->array = calloc(map->capacity, sizeof(*map->array));
+    if (map->array == NULL) {
+      free(map);
+      return NULL;
+    }
   }
 
   map->size = 0;
 
+  map->old_array = NULL;
+  map->old_capacity = 0;
+  map->migrate_pos = 0;
+
   map->compare = compare;
+  map->hash_function = NULL;
   map->destroy_key = destroy_key;
   map->destroy_value = destroy_value;
 
+  map->savings.hash_calls = 0;
+  map->savings.compare_calls = 0;
+
+#ifdef MAP_STATS
+  memset(&map->stats, 0, sizeof(map->stats));
+#endif
+
   return map;
 }
 
+/// @brief Returns the index of the bucket of hash, in a table of capacity
+/// buckets.
+///
+static inline unsigned int bucket_index(unsigned int hash, int capacity) {
+#ifdef MAP_POWER_OF_TWO
+  return hash & (capacity - 1);
+#else
+  return hash % capacity;
+#endif
+}
+
+/// @brief Returns the hash of key, as cached in its node.
+///
+/// With power of two capacities only the lowest bits of a hash pick its
+/// bucket, so the hash is mixed (finalizer of murmur3), to not degrade weak
+/// hash functions, e.g. hash_int. Mixing is invertible: keys with equal
+/// mixed hashes still have equal hashes.
+///
+static inline unsigned int hash_key(Map map, void *key) {
+  unsigned int hash = stats_hash(map, key);
+#ifdef MAP_POWER_OF_TWO
+  hash ^= hash >> 16;
+  hash *= 0x85ebca6b;
+  hash ^= hash >> 13;
+  hash *= 0xc2b2ae35;
+  hash ^= hash >> 16;
+#endif
+  return hash;
+}
+
 // Επιστρέφει τον αριθμό των entries του map σε μία χρονική στιγμή.
 size_t map_size(Map map) { return map->size; }
 
-// Συνάρτηση για την επέκταση του Hash Table σε περίπτωση που ο load factor
-// μεγαλώσει πολύ.
-static void rehash(Map map) {
-  // Αποθήκευση των παλιών δεδομένων
-  int old_capacity = map->capacity;
-  SList *old_array = map->array;
+/// @brief Returns true if map has no table, and holds its entries inline.
+///
+static inline bool is_small(Map map) { return map->array == NULL; }
+
+/// @brief Returns the array element of the bucket that holds, or would hold,
+/// the key with given hash.
+///
+/// Keys of buckets that are not migrated yet are still in old_array.
+///
+static SList *bucket_of(Map map, unsigned int hash) {
+  if (map->old_array != NULL) {
+    unsigned int old_pos = bucket_index(hash, map->old_capacity);
+    if (old_pos >= map->migrate_pos)
+      return &map->old_array[old_pos];
+  }
 
-  // Βρίσκουμε τη νέα χωρητικότητα, διασχίζοντας τη λίστα των πρώτων ώστε να
-  // βρούμε τον επόμενο.
-  int prime_no = sizeof(prime_sizes) / sizeof(int); // το μέγεθος του πίνακα
-  for (int i = 0; i < prime_no; i++) { // LCOV_EXCL_LINE
-    if (prime_sizes[i] > old_capacity) {
-      map->capacity = prime_sizes[i];
-      break;
+  return &map->array[bucket_index(hash, map->capacity)];
+}
+
+/// @brief Returns the slist of the bucket at given array element, creating it
+/// if the bucket has none yet.
+///
+static SList bucket_create(SList *bucket) {
+  if (*bucket == NULL)
+    *bucket = slist_create(NULL);
+
+  return *bucket;
+}
+
+/// @brief Returns true if bucket has no entries.
+///
+static bool bucket_empty(SList bucket) {
+  return bucket == NULL || slist_size(bucket) == 0;
+}
+
+/// @brief Returns the node of bucket with key equivalent to key, or MAP_EOF if
+/// there is none.
+///
+/// @param hash Hash of key.
+///
+static MapNode bucket_find(Map map, SList bucket, void *key,
+                           unsigned int hash) {
+  if (bucket == NULL)
+    return MAP_EOF;
+
+  for (SListNode entry = slist_first(bucket); entry != SLIST_EOF;
+       entry = slist_next(bucket, entry)) {
+    MapNode node = (MapNode)slist_node_value(bucket, entry);
+
+    // Equivalent keys have equal hashes.
+    if (node->hash != hash) {
+      savings_add(&map->savings.compare_calls, 1);
+      continue;
+    }
+
+    if (stats_compare(map, node->key, key) == 0) {
+      return node; // FOUND IT
     }
   }
 
-  // Αν έχουμε εξαντλήσει όλους τους πρώτους, διπλασιάζουμε
-  if (map->capacity == old_capacity) // LCOV_EXCL_LINE
-    map->capacity *= 2;              // LCOV_EXCL_LINE
+  return MAP_EOF;
+}
 
-  // Δημιουργούμε ένα μεγαλύτερο hash table
-  map->array = malloc(map->capacity * sizeof(SList));
+/// @brief Returns the entry of a small map with key equivalent to key, or
+/// MAP_EOF if there is none.
+///
+/// @param hash Hash of key.
+///
+static MapNode small_find(Map map, void *key, unsigned int hash) {
+  for (int i = 0; i < map->size; i++) {
+    MapNode node = &map->small[i];
+
+    // Equivalent keys have equal hashes.
+    if (node->hash != hash) {
+      savings_add(&map->savings.compare_calls, 1);
+      continue;
+    }
 
-  // Αρχικοποιούμε τους κόμβους που έχουμε σαν διαθέσιμους.
-  for (int i = 0; i < map->capacity; i++)
-    map->array[i] = slist_create(NULL);
+    if (stats_compare(map, node->key, key) == 0)
+      return node;
+  }
 
-  // Τοποθετούμε τα entries
-  map->size = 0;
-  for (int i = 0; i < old_capacity; i++) {
-    if (slist_size(old_array[i]) != 0) {
-      for (SListNode entry = slist_first(old_array[i]); entry != SLIST_EOF;
-           entry = slist_next(old_array[i], entry)) {
-        MapNode node = (MapNode)slist_node_value(old_array[i], entry);
-        // printf("REHASH: node(%p) key(%p) value(%p)\n", node, node->key,
-        // node->value);
-        map_insert(map, node->key, node->value);
-      }
+  return MAP_EOF;
+}
+
+/// @brief Returns the node with key equivalent to key, or MAP_EOF if there is
+/// none, whether map is small or not.
+///
+/// @param hash Hash of key.
+///
+static MapNode node_find(Map map, void *key, unsigned int hash) {
+  if (is_small(map))
+    return small_find(map, key, hash);
+
+  return bucket_find(map, *bucket_of(map, hash), key, hash);
+}
+
+/// @brief Moves the entries of the next bucket of old_array to array.
+///
+/// When every bucket is migrated, the old table is deallocated.
+///
+static void migrate_bucket(Map map) {
+  SList old_bucket = map->old_array[map->migrate_pos];
+
+  if (old_bucket != NULL) {
+    while (slist_size(old_bucket) != 0) {
+      MapNode node = slist_node_value(old_bucket, slist_first(old_bucket));
+      SList bucket =
+          bucket_create(&map->array[bucket_index(node->hash, map->capacity)]);
+      map->savings.hash_calls++;
+
+      slist_insert_next(bucket, slist_last(bucket), node);
+      slist_remove_next(old_bucket, SLIST_BOF); // MapNode is not destroyed.
     }
 
-    slist_set_destroy_value(old_array[i], free);
-    slist_destroy(old_array[i]);
+    slist_destroy(old_bucket);
+  }
+  map->migrate_pos++;
+
+  if (map->migrate_pos == map->old_capacity) {
+    free(map->old_array);
+    map->old_array = NULL;
+    map->old_capacity = 0;
+    map->migrate_pos = 0;
+  }
+}
+
+/// @brief Migrates at most MIGRATE_BUCKETS buckets, if the table is being
+/// resized.
+///
+static void migrate_step(Map map) {
+  if (map->old_array == NULL)
+    return;
+
+  double start = stats_clock();
+  for (int i = 0; i < MIGRATE_BUCKETS && map->old_array != NULL; i++)
+    migrate_bucket(map);
+  stats_resized(map, start);
+}
+
+// Συνάρτηση για την επέκταση του Hash Table σε περίπτωση που ο load factor
+// μεγαλώσει πολύ. (Or for its shrinking, if new_capacity is smaller.)
+//
+// The entries are not moved here: the current table becomes the old table and
+// every following operation migrates a few of its buckets, so that no single
+// operation pays for the whole resize.
+static void rehash(Map map, int new_capacity) {
+  double start = stats_clock();
+
+  // A resize can not start while another one is in progress. This only happens
+  // if map_reserve() or map_shrink_to_fit() is called during a migration.
+  while (map->old_array != NULL)
+    migrate_bucket(map);
+
+  // Αποθήκευση των παλιών δεδομένων
+  int old_capacity = map->capacity;
+  SList *old_array = map->array;
+
+  map->capacity = new_capacity;
+
+  // Δημιουργούμε ένα μεγαλύτερο hash table, with empty buckets.
+  SList *array = calloc(map->capacity, sizeof(SList));
+  if (array == NULL) {
+    map->capacity = old_capacity; // Keep the current table.
+    stats_resized(map, start);
+    return;
   }
+  map->array = array;
 
-  //Αποδεσμεύουμε τον παλιό πίνακα ώστε να μήν έχουμε leaks
-  free(old_array);
+  // The entries are migrated by the following operations.
+  map->old_array = old_array;
+  map->old_capacity = old_capacity;
+  map->migrate_pos = 0;
+
+  stats_rehashed(map);
+  stats_resized(map, start);
 }
 
 // Creates a bucket node
-static MapNode map_node_create(void *key, void *value) {
+static MapNode map_node_create(void *key, void *value, unsigned int hash) {
   MapNode node = malloc(sizeof(*node));
+  if (node == NULL)
+    return NULL;
 
   node->key = key;
   node->value = value;
+  node->hash = hash;
 
   return node;
 }
 
-// Εισαγωγή στο hash table του ζευγαριού (key, item).
+/// @brief Appends a new node of key, value and hash to the bucket at given
+/// array element.
+///
+/// @return The new node, or MAP_EOF if out of memory.
+///
+static MapNode node_append(SList *slot, void *key, void *value,
+                           unsigned int hash) {
+  SList bucket = bucket_create(slot);
+  MapNode node = map_node_create(key, value, hash);
+  if (bucket == NULL || node == NULL) {
+    free(node);
+    return MAP_EOF;
+  }
+
+  size_t size = slist_size(bucket);
+  slist_insert_next(bucket, slist_last(bucket), node);
+  if (slist_size(bucket) == size) {
+    free(node); // The list node could not be allocated.
+    return MAP_EOF;
+  }
+
+  return node;
+}
+
+/// @brief Moves the entries of a small map to a new table of capacity buckets.
+///
+/// The entries keep their cached hashes, and the table is not resized
+/// incrementally: there are at most SMALL_CAPACITY of them.
+///
+/// @return true, if the map has a table, otherwise false (out of memory) and
+/// the map is left small.
+///
+static bool promote(Map map, int capacity) {
+  double start = stats_clock();
+  SList *array = calloc(capacity, sizeof(*array));
+  if (array == NULL)
+    return false;
+
+  for (int i = 0; i < map->size; i++) {
+    MapNode small = &map->small[i];
+    SList *slot = &array[bucket_index(small->hash, capacity)];
+    if (node_append(slot, small->key, small->value, small->hash) == MAP_EOF) {
+      // Free the copies made so far, and keep the map small.
+      for (int b = 0; b < capacity; b++) {
+        if (array[b] != NULL) {
+          slist_set_destroy_value(array[b], free);
+          slist_destroy(array[b]);
+        }
+      }
+      free(array);
+      return false;
+    }
+  }
+  map->savings.hash_calls += map->size;
+
+  map->array = array;
+  map->capacity = capacity;
+
+  stats_rehashed(map);
+  stats_resized(map, start);
+  return true;
+}
+
+/// @brief Moves the entries of the table, at most SMALL_CAPACITY, inline, and
+/// deallocates the table.
+///
+static void demote(Map map) {
+  double start = stats_clock();
+  while (map->old_array != NULL)
+    migrate_bucket(map);
+
+  int size = 0;
+  for (int i = 0; i < map->capacity; i++) {
+    SList bucket = map->array[i];
+    if (bucket == NULL)
+      continue;
+
+    for (SListNode entry = slist_first(bucket); entry != SLIST_EOF;
+         entry = slist_next(bucket, entry))
+      map->small[size++] = *(MapNode)slist_node_value(bucket, entry);
+
+    slist_set_destroy_value(bucket, free);
+    slist_destroy(bucket);
+  }
+  map->savings.hash_calls += size;
+
+  free(map->array);
+  map->array = NULL;
+  map->capacity = 0;
+
+  stats_rehashed(map);
+  stats_resized(map, start);
+}
+
+/// @brief Returns the node of key, inserting it with value NULL if key is not
+/// part of the map.
+///
+/// Walks the bucket of key once.
+///
+/// @param hash Hash of key, as returned by hash_key().
+/// @param inserted Set to true, if key was inserted, otherwise false.
+///
+/// @return Node of key, or MAP_EOF if key could not be inserted (out of
+/// memory).
+///
+static MapNode node_find_or_insert(Map map, void *key, unsigned int hash,
+                                   bool *inserted) {
+  if (is_small(map)) {
+    MapNode node = small_find(map, key, hash);
+    if (node != MAP_EOF) {
+      *inserted = false;
+      return node;
+    }
+
+    if (map->size < SMALL_CAPACITY) {
+      node = &map->small[map->size++];
+      *node = (struct map_node){key, NULL, hash};
+      *inserted = true;
+      return node;
+    }
+
+    // Outgrew the inline entries. key is not part of the map, but is looked
+    // up in the table once more, which is cheap.
+    if (!promote(map, capacity_for(map->size + 1))) {
+      *inserted = false;
+      return MAP_EOF;
+    }
+  }
+
+  migrate_step(map);
+
+  // The bucket of insertion
+  SList *slot = bucket_of(map, hash);
 
-void map_insert(Map map, void *key, void *value) {
   // Check if given key is already in map:
-  MapNode in_map = map_find_node(map, key);
+  MapNode node = bucket_find(map, *slot, key, hash);
+  if (node != MAP_EOF) {
+    *inserted = false;
+    return node;
+  }
+
+  node = node_append(slot, key, NULL, hash);
+  if (node == MAP_EOF) {
+    *inserted = false;
+    return MAP_EOF;
+  }
+
+  // Νέο στοιχείο, αυξάνουμε τα συνολικά στοιχεία του map
+  map->size++;
 
-  if (in_map) {
-    void *old_key = in_map->key;
-    void *old_value = in_map->value;
+  // Αν με την νέα εισαγωγή ξεπερνάμε το μέγιστο load factor, πρέπει να
+  // κάνουμε rehash. (Nodes are not moved by a resize.)
+  float load_factor = (float)map->size / map->capacity;
+  if (load_factor > MAX_LOAD_FACTOR)
+    rehash(map, capacity_for(map->size));
 
+  *inserted = true;
+  return node;
+}
+
+/// @brief Resizes the table to new_capacity and migrates every entry at once.
+///
+static void resize_now(Map map, int new_capacity) {
+  rehash(map, new_capacity);
+
+  double start = stats_clock();
+  while (map->old_array != NULL)
+    migrate_bucket(map);
+  stats_resized(map, start);
+}
+
+void map_reserve(Map map, size_t n) {
+  if (is_small(map)) {
+    if (n > SMALL_CAPACITY)
+      promote(map, capacity_for(n));
+    return;
+  }
+
+  int capacity = capacity_for(n);
+  if (capacity > map->capacity)
+    resize_now(map, capacity);
+}
+
+void map_shrink_to_fit(Map map) {
+  if (is_small(map))
+    return;
+  if (map->size <= SMALL_CAPACITY) {
+    demote(map);
+    return;
+  }
+
+  int capacity = capacity_for(map->size);
+  if (capacity < map->capacity)
+    resize_now(map, capacity);
+}
+
+/// @brief Associates node, returned by node_find_or_insert(), with key and
+/// value.
+///
+/// @param inserted true, if node was inserted, otherwise its previous key and
+/// value are destroyed.
+///
+static void node_set(Map map, MapNode node, bool inserted, void *key,
+                     void *value) {
+  if (!inserted) {
     // Destroy old key, value pair
     if (map->destroy_key != NULL)
-      map->destroy_key(old_key);
+      map->destroy_key(node->key);
     if (map->destroy_value != NULL)
-      map->destroy_value(old_value);
+      map->destroy_value(node->value);
 
-    // Update key and value
-    in_map->key = key;
-    in_map->value = value;
-  } else {
-    assert(map->hash_function != NULL && key != NULL &&
-           "Expected key and hash function");
+    // Update key
+    node->key = key;
+  }
 
-    // Hash key to find the position of insertion
-    unsigned int pos = map->hash_function(key) % map->capacity;
+  node->value = value;
+}
 
-    MapNode new = map_node_create(key, value);
+// Εισαγωγή στο hash table του ζευγαριού (key, item).
 
-    // printf("INSERT: node(%p) key(%p) value(%p)\n", new, new->key,
-    // new->value);
+void map_insert(Map map, void *key, void *value) {
+  assert(map->hash_function != NULL && key != NULL &&
+         "Expected key and hash function");
 
-    slist_insert_next(map->array[pos], slist_last(map->array[pos]),
-                      (void *)new);
+  bool inserted;
+  MapNode node = node_find_or_insert(map, key, hash_key(map, key), &inserted);
+  if (node != MAP_EOF)
+    node_set(map, node, inserted, key, value);
+}
 
-    // Νέο στοιχείο, αυξάνουμε τα συνολικά στοιχεία του map
-    map->size++;
+void **map_find_or_insert(Map map, void *key, bool *inserted) {
+  assert(map->hash_function != NULL && key != NULL &&
+         "Expected key and hash function");
 
-    // Αν με την νέα εισαγωγή ξεπερνάμε το μέγιστο load factor, πρέπει να
-    // κάνουμε rehash
-    float load_factor = (float)map->size / map->capacity;
-    if (load_factor > MAX_LOAD_FACTOR)
-      rehash(map);
-  }
+  MapNode node = node_find_or_insert(map, key, hash_key(map, key), inserted);
+  return node != MAP_EOF ? &node->value : NULL;
+}
+
+bool map_update(Map map, void *key, MapUpdateFunc update, void *context) {
+  assert(map->hash_function != NULL && key != NULL &&
+         "Expected key and hash function");
+
+  bool inserted;
+  MapNode node = node_find_or_insert(map, key, hash_key(map, key), &inserted);
+  if (node == MAP_EOF)
+    return false; // Out of memory, key was not inserted.
+
+  update(&node->value, context);
+
+  return inserted;
 }
 
 // Διαργραφή απο το Hash Table του κλειδιού με τιμή key
@@ -184,17 +721,43 @@ bool map_remove(Map map, void *key) {
   assert(map->hash_function != NULL && key != NULL &&
          "Expected key and hash function");
 
-  // Hash key to find the position of insertion
-  unsigned int pos = map->hash_function(key) % map->capacity;
+  migrate_step(map);
+
+  // Hash key to find its bucket
+  unsigned int hash = hash_key(map, key);
+
+  if (is_small(map)) {
+    MapNode node = small_find(map, key, hash);
+    if (node == MAP_EOF)
+      return false;
+
+    if (map->destroy_key != NULL)
+      map->destroy_key(node->key);
+    if (map->destroy_value != NULL)
+      map->destroy_value(node->value);
+
+    // Keep the remaining entries in insertion order.
+    MapNode end = &map->small[map->size];
+    memmove(node, node + 1, (end - node - 1) * sizeof(*node));
+    map->size--;
+
+    return true;
+  }
+
+  SList bucket = *bucket_of(map, hash);
+  if (bucket == NULL)
+    return false;
 
   // Store previous bucket entry of entry
   SListNode previous = SLIST_BOF;
 
-  for (SListNode entry = slist_first(map->array[pos]); entry != SLIST_EOF;
-       entry = slist_next(map->array[pos], entry)) {
-    MapNode node = (MapNode)slist_node_value(map->array[pos], entry);
+  for (SListNode entry = slist_first(bucket); entry != SLIST_EOF;
+       entry = slist_next(bucket, entry)) {
+    MapNode node = (MapNode)slist_node_value(bucket, entry);
 
-    if (map->compare(node->key, key) == 0) {
+    if (node->hash != hash) {
+      map->savings.compare_calls++;
+    } else if (stats_compare(map, node->key, key) == 0) {
       // Destroy node key, value
       if (map->destroy_key != NULL)
         map->destroy_key(node->key);
@@ -202,9 +765,9 @@ bool map_remove(Map map, void *key) {
         map->destroy_value(node->value);
 
       // Destroy node and bucket entry
-      slist_set_destroy_value(map->array[pos], free);
-      slist_remove_next(map->array[pos], previous);
-      slist_set_destroy_value(map->array[pos], NULL);
+      slist_set_destroy_value(bucket, free);
+      slist_remove_next(bucket, previous);
+      slist_set_destroy_value(bucket, NULL);
 
       map->size--;
 
@@ -240,28 +803,50 @@ DestroyFunc map_set_destroy_value(Map map, DestroyFunc destroy_value) {
   return old;
 }
 
+/// @brief Destroys bucket and every entry in it.
+///
+static void bucket_destroy(Map map, SList bucket) {
+  if (bucket == NULL)
+    return;
+
+  // Traverse each entry in a bucket
+  for (SListNode entry = slist_first(bucket); entry != SLIST_EOF;
+       entry = slist_next(bucket, entry)) {
+    MapNode node = (MapNode)slist_node_value(bucket, entry);
+
+    // Destroy MapNode key, value pairs
+    if (map->destroy_key != NULL)
+      map->destroy_key(node->key);
+    if (map->destroy_value != NULL)
+      map->destroy_value(node->value);
+  }
+
+  // Set slist destroy value to destroy MapNode structs and the whole slist
+  slist_set_destroy_value(bucket, free);
+  slist_destroy(bucket);
+}
+
 // Απελευθέρωση μνήμης που δεσμεύει το map
 void map_destroy(Map map) {
-  // Traverse each bucket of map array
-  for (int i = 0; i < map->capacity; i++) {
-    // Traverse only the buckets that contain entries
-    if (slist_size(map->array[i]) != 0) {
-      // Traverse each entry in a bucket
-      for (SListNode entry = slist_first(map->array[i]); entry != SLIST_EOF;
-           entry = slist_next(map->array[i], entry)) {
-        MapNode node = (MapNode)slist_node_value(map->array[i], entry);
-
-        // Destroy MapNode key, value pairs
-        if (map->destroy_key != NULL)
-          map->destroy_key(node->key);
-        if (map->destroy_value != NULL)
-          map->destroy_value(node->value);
-      }
+  // Entries of a small map.
+  if (is_small(map)) {
+    for (int i = 0; i < map->size; i++) {
+      if (map->destroy_key != NULL)
+        map->destroy_key(map->small[i].key);
+      if (map->destroy_value != NULL)
+        map->destroy_value(map->small[i].value);
     }
+  }
+
+  // Traverse each bucket of map array
+  for (int i = 0; i < map->capacity; i++)
+    bucket_destroy(map, map->array[i]);
 
-    // Set slist destroy value to destroy MapNode structs and the whole slist
-    slist_set_destroy_value(map->array[i], free);
-    slist_destroy(map->array[i]);
+  // Buckets of the old table that are not migrated yet.
+  if (map->old_array != NULL) {
+    for (int i = map->migrate_pos; i < map->old_capacity; i++)
+      bucket_destroy(map, map->old_array[i]);
+    free(map->old_array);
   }
 
   free(map->array);
@@ -270,51 +855,156 @@ void map_destroy(Map map) {
 
 /////////////////////// Διάσχιση του map μέσω κόμβων ///////////////////////////
 
-MapNode map_first(Map map) {
-  for (int i = 0; i < map->capacity; i++) {
-    if (slist_first(map->array[i]) != SLIST_EOF)
-      return (MapNode)slist_node_value(map->array[i],
-                                       slist_first(map->array[i]));
+// While the table is being resized, the traversal visits the buckets of the
+// old table that are not migrated yet, and then the buckets of the new table.
+// Positions [0, old_capacity - migrate_pos) of the traversal refer to the
+// buckets of the old table that are not migrated yet, the following ones to
+// the buckets of the new table.
+//
+// A small map is traversed in insertion order, and positions refer to its
+// entries instead.
+
+/// @brief Returns the bucket at position pos of the traversal.
+///
+static SList bucket_at(Map map, int pos) {
+  int old_buckets = map->old_capacity - map->migrate_pos; // 0, if no old table.
+
+  return pos < old_buckets ? map->old_array[map->migrate_pos + pos]
+                           : map->array[pos - old_buckets];
+}
+
+/// @brief Returns the position of the first non empty bucket at or after
+/// position pos of the traversal, or -1 if there is none.
+///
+static int bucket_next_occupied(Map map, int pos) {
+  int end = map->old_capacity - map->migrate_pos + map->capacity;
+
+  for (; pos < end; pos++) {
+    if (!bucket_empty(bucket_at(map, pos)))
+      return pos;
   }
 
-  return MAP_EOF;
+  return -1;
 }
 
-MapNode map_next(Map map, MapNode node) {
-  assert(map->hash_function != NULL && node != NULL &&
-         "Expected key and hash function");
+MapNode map_first(Map map) {
+  if (is_small(map))
+    return map->size != 0 ? &map->small[0] : MAP_EOF;
 
-  // Hash key to find the position of insertion
-  unsigned int pos = map->hash_function(node->key) % map->capacity;
-
-  for (SListNode entry = slist_first(map->array[pos]); entry != SLIST_EOF;
-       entry = slist_next(map->array[pos], entry)) {
-    MapNode current = (MapNode)slist_node_value(map->array[pos], entry);
-
-    if (map->compare(current->key, node->key) == 0) {
-      // Check if current node is the last in the bucket
-      if (slist_next(map->array[pos], entry) == SLIST_EOF) {
-        // Iterate array to find a slist that is not empty
-        for (pos += 1; pos < map->capacity; pos++) {
-          if (slist_size(map->array[pos]) != 0) {
-            // Return first bucket entry node
-            return (MapNode)slist_node_value(map->array[pos],
-                                             slist_first(map->array[pos]));
-          }
-        }
+  int pos = bucket_next_occupied(map, 0);
+  if (pos == -1)
+    return MAP_EOF;
+
+  SList bucket = bucket_at(map, pos);
+  return (MapNode)slist_node_value(bucket, slist_first(bucket));
+}
+
+MapNode map_next(Map map, MapNode node) {
+  assert(node != NULL);
+
+  if (is_small(map))
+    return node + 1 < &map->small[map->size] ? node + 1 : MAP_EOF;
+
+  // Find the bucket of node, and its position in the traversal.
+  unsigned int hash = node->hash;
+  savings_add(&map->savings.hash_calls, 1);
+  SList *slot = bucket_of(map, hash);
+  SList bucket = *slot;
+  if (bucket == NULL)
+    return MAP_EOF; // node was not found in the map
+
+  int pos;
+  if (map->old_array != NULL &&
+      slot == &map->old_array[bucket_index(hash, map->old_capacity)])
+    pos = bucket_index(hash, map->old_capacity) - map->migrate_pos;
+  else
+    pos = map->old_capacity - map->migrate_pos +
+          bucket_index(hash, map->capacity);
+
+  for (SListNode entry = slist_first(bucket); entry != SLIST_EOF;
+       entry = slist_next(bucket, entry)) {
+    if (slist_node_value(bucket, entry) == node) {
+      // Return next bucket entry node, or the first entry of the next non
+      // empty bucket.
+      SListNode next = slist_next(bucket, entry);
+      if (next != SLIST_EOF)
+        return (MapNode)slist_node_value(bucket, next);
+
+      pos = bucket_next_occupied(map, pos + 1);
+      if (pos == -1)
         return MAP_EOF; // Reached end of array
 
-      } else {
-        // Return next bucket entry node
-        return (MapNode)slist_node_value(map->array[pos],
-                                         slist_next(map->array[pos], entry));
-      }
+      bucket = bucket_at(map, pos);
+      return (MapNode)slist_node_value(bucket, slist_first(bucket));
     }
   }
 
   return MAP_EOF; // node was not found in the map
 }
 
+/// @brief Points iter to the first entry of the bucket at position pos of the
+/// traversal, or marks it as invalid if pos is -1.
+///
+static void iter_set_bucket(Map map, MapIterator *iter, int pos) {
+  iter->position = pos;
+
+  if (pos == -1) {
+    iter->cursor = SLIST_EOF;
+    iter->node = MAP_EOF;
+    return;
+  }
+
+  SList bucket = bucket_at(map, pos);
+  iter->cursor = slist_first(bucket);
+  iter->node = slist_node_value(bucket, iter->cursor);
+}
+
+/// @brief Points iter to the entry at position pos of a small map, or marks it
+/// as invalid if there is none.
+///
+static void iter_set_small(Map map, MapIterator *iter, int pos) {
+  iter->position = pos;
+  iter->cursor = SLIST_EOF;
+  iter->node = pos < map->size ? &map->small[pos] : MAP_EOF;
+}
+
+MapIterator map_iter_begin(Map map) {
+  MapIterator iter;
+  if (is_small(map)) {
+    iter_set_small(map, &iter, 0);
+    return iter;
+  }
+
+  iter_set_bucket(map, &iter, bucket_next_occupied(map, 0));
+  return iter;
+}
+
+bool map_iter_valid(Map map, MapIterator *iter) {
+  return iter->node != MAP_EOF;
+}
+
+void map_iter_next(Map map, MapIterator *iter) {
+  assert(iter->node != MAP_EOF);
+
+  if (is_small(map)) {
+    iter_set_small(map, iter, iter->position + 1);
+    return;
+  }
+
+  // Next entry of the chain, without looking the current one up again.
+  SList bucket = bucket_at(map, iter->position);
+  SListNode next = slist_next(bucket, iter->cursor);
+  if (next != SLIST_EOF) {
+    iter->cursor = next;
+    iter->node = slist_node_value(bucket, next);
+    return;
+  }
+
+  iter_set_bucket(map, iter, bucket_next_occupied(map, iter->position + 1));
+}
+
+MapNode map_iter_node(Map map, MapIterator *iter) { return iter->node; }
+
 void *map_node_key(Map map, MapNode node) { return node->key; }
 
 void *map_node_value(Map map, MapNode node) { return node->value; }
@@ -323,25 +1013,138 @@ MapNode map_find_node(Map map, void *key) {
   assert(map->hash_function != NULL && key != NULL &&
          "Expected key and hash function");
 
-  unsigned int pos = map->hash_function(key) % map->capacity;
+  unsigned int hash = hash_key(map, key);
+  return node_find(map, key, hash);
+}
+
+//////////////////////////////// Batches ///////////////////////////////////////
+
+// A batch is pipelined: while key i is looked up, the array element of the
+// bucket of key i + 2 * BATCH_DISTANCE is prefetched, and, since that element
+// was prefetched BATCH_DISTANCE keys ago, the slist of the bucket of key
+// i + BATCH_DISTANCE too. The entries of a chain can not be prefetched before
+// the slist is read, so lookups still miss on them. A small map has nothing to
+// prefetch.
+
+/// @brief Keys between the two prefetches of a key, and between the second
+/// prefetch and the lookup.
+///
+#define BATCH_DISTANCE 8
+
+/// @brief Hashes of the keys in flight, indexed by position % BATCH_WINDOW.
+///
+#define BATCH_WINDOW (2 * BATCH_DISTANCE)
+
+/// @brief First prefetch of a batch: the array element of the bucket.
+///
+static inline void prefetch_bucket_of(Map map, unsigned int hash) {
+  if (!is_small(map))
+    __builtin_prefetch(bucket_of(map, hash));
+}
 
-  for (SListNode entry = slist_first(map->array[pos]); entry != SLIST_EOF;
-       entry = slist_next(map->array[pos], entry)) {
-    MapNode node = (MapNode)slist_node_value(map->array[pos], entry);
+/// @brief Second prefetch of a batch: the slist of the bucket, if any.
+///
+static inline void prefetch_bucket(Map map, unsigned int hash) {
+  if (is_small(map))
+    return;
 
-    if (map->compare(node->key, key) == 0) {
-      return node; // FOUND IT
+  SList bucket = *bucket_of(map, hash);
+  if (bucket != NULL)
+    __builtin_prefetch(bucket);
+}
+
+void map_find_batch(Map map, void **keys, size_t n, void **values) {
+  assert(map->hash_function != NULL && "Expected hash function");
+
+  unsigned int hashes[BATCH_WINDOW];
+  for (size_t i = 0; i < n + BATCH_WINDOW; i++) {
+    // The oldest key first, as the newest one takes its place in hashes.
+    if (i >= BATCH_WINDOW) {
+      size_t k = i - BATCH_WINDOW;
+      unsigned int hash = hashes[k % BATCH_WINDOW];
+      MapNode node = node_find(map, keys[k], hash);
+      values[k] = node != MAP_EOF ? node->value : NULL;
+    }
+
+    if (i >= BATCH_DISTANCE && i - BATCH_DISTANCE < n)
+      prefetch_bucket(map, hashes[(i - BATCH_DISTANCE) % BATCH_WINDOW]);
+
+    if (i < n) {
+      assert(keys[i] != NULL && "Expected key");
+      hashes[i % BATCH_WINDOW] = hash_key(map, keys[i]);
+      prefetch_bucket_of(map, hashes[i % BATCH_WINDOW]);
     }
   }
+}
 
-  return MAP_EOF;
+void map_insert_batch(Map map, void **keys, size_t n, void **values) {
+  assert(map->hash_function != NULL && "Expected hash function");
+
+  // Same pipeline as map_find_batch(). A resize in the middle of the batch
+  // only makes the prefetches of the keys in flight useless.
+  unsigned int hashes[BATCH_WINDOW];
+  for (size_t i = 0; i < n + BATCH_WINDOW; i++) {
+    if (i >= BATCH_WINDOW) {
+      size_t k = i - BATCH_WINDOW;
+      bool inserted;
+      MapNode node = node_find_or_insert(map, keys[k],
+                                         hashes[k % BATCH_WINDOW], &inserted);
+      if (node != MAP_EOF)
+        node_set(map, node, inserted, keys[k], values[k]);
+    }
+
+    if (i >= BATCH_DISTANCE && i - BATCH_DISTANCE < n)
+      prefetch_bucket(map, hashes[(i - BATCH_DISTANCE) % BATCH_WINDOW]);
+
+    if (i < n) {
+      assert(keys[i] != NULL && "Expected key");
+      hashes[i % BATCH_WINDOW] = hash_key(map, keys[i]);
+      prefetch_bucket_of(map, hashes[i % BATCH_WINDOW]);
+    }
+  }
 }
 
+void map_savings(Map map, MapSavings *savings) { *savings = map->savings; }
+
 // Αρχικοποίηση της συνάρτησης κατακερματισμού του συγκεκριμένου map.
 void map_set_hash_function(Map map, HashFunc func) {
   map->hash_function = func;
 }
 
+#ifdef MAP_STATS
+
+/// @brief Adds a chain of length elements to the shape of the table in stats.
+///
+static void stats_add_chain(MapStats *stats, size_t length) {
+  size_t last = MAP_STATS_CHAINS - 1;
+  stats->chain_lengths[length < last ? length : last]++;
+  stats->occupied += length != 0;
+  if (length > stats->max_chain)
+    stats->max_chain = length;
+}
+
+void map_stats(Map map, MapStats *stats) {
+  *stats = map->stats; // Counters. The shape of the table is still zero.
+
+  if (is_small(map)) {
+    // Scanned as a single chain.
+    stats->capacity = 1;
+    stats_add_chain(stats, map->size);
+  } else {
+    // The buckets of the old table that are not migrated yet too.
+    int end = map->old_capacity - map->migrate_pos + map->capacity;
+    for (int pos = 0; pos < end; pos++) {
+      SList bucket = bucket_at(map, pos);
+      stats_add_chain(stats, bucket != NULL ? slist_size(bucket) : 0);
+    }
+    stats->capacity = end;
+  }
+
+  stats->load = (double)map->size / stats->capacity;
+}
+
+#endif // MAP_STATS
+
 unsigned int hash_string(void *value) {
   // djb2 hash function, απλή, γρήγορη, και σε γενικές γραμμές αποδοτική
   unsigned int hash = 5381;
@@ -0,0 +1,539 @@
+/// @file map.c
+///
+/// Implementation of Map Abstract Data Type using an insertion ordered hash
+/// table, with the layout of the dict of Python.
+///
+/// Entries are appended to a dense array, in insertion order. The hash table
+/// itself is a sparse index: an array of 32-bit positions in the entries
+/// array, probed linearly. Only the index has empty slots, and they take 4
+/// bytes instead of the size of an entry, so the map takes less memory than a
+/// table of entries. A traversal is a scan of the packed entries array, in the
+/// order they were inserted, whatever the resizes.
+///
+/// A removed entry leaves a hole in the entries array, skipped by traversals,
+/// until the next resize packs the entries again.
+///
+/// @note A MapNode points inside the entries array, so it is invalidated by
+/// map_insert() and map_remove().
+
+#include "map.h"
+
+#include <assert.h>  // assert
+#include <stdbool.h> // bool
+#include <stdint.h>  // uint32_t, UINT32_MAX
+#include <stdlib.h>  // malloc, realloc, free, size_t
+#include <string.h>  // memset
+
+/// @brief Smallest number of slots of the index.
+///
+#define MIN_CAPACITY 8
+
+/// @brief Slot of the index that refers to no entry.
+///
+#define EMPTY_SLOT UINT32_MAX
+
+/// An entry of the map. A removed entry, a hole, has key NULL.
+struct map_node {
+  void *key;
+  void *value;
+  uint32_t hash; // Cached (mixed) hash of key, avoids calling hash_function on
+                 // resize and most calls of compare on lookup.
+};
+
+struct map {
+  MapNode entries;    // Entries [0, entry_count), in insertion order.
+  size_t entry_count; // Entries appended since the last resize, holes too.
+  size_t size;        // Entries that are not holes.
+  uint32_t *index;    // Position in entries of each key, or EMPTY_SLOT.
+  size_t capacity;    // Slots of the index, a power of two.
+
+  CompareFunc compare;
+  HashFunc hash_function;
+  DestroyFunc destroy_key;
+  DestroyFunc destroy_value;
+
+  MapSavings savings; // Calls of hash_function and compare avoided, thanks to
+                      // the cached hashes.
+};
+
+/// @brief Mixes the bits of a user provided hash.
+///
+/// The index keeps the lowest bits of a hash, so every bit of the hash is
+/// spread over the whole word first. (Finalizer of MurmurHash3.) The mix is a
+/// bijection, so equal mixed hashes still imply equal hashes.
+///
+static uint32_t hash_mix(unsigned int hash) {
+  uint32_t h = hash;
+  h ^= h >> 16;
+  h *= 0x85ebca6b;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35;
+  h ^= h >> 16;
+  return h;
+}
+
+/// @brief Returns the number of entries an index of capacity slots holds: two
+/// thirds of its slots, as in Python.
+///
+static inline size_t usable(size_t capacity) { return capacity * 2 / 3; }
+
+/// @brief Returns the smallest capacity of an index that holds size entries.
+///
+static size_t capacity_for(size_t size) {
+  size_t capacity = MIN_CAPACITY;
+  while (usable(capacity) < size)
+    capacity *= 2;
+  return capacity;
+}
+
+Map map_create(CompareFunc compare, DestroyFunc destroy_key,
+               DestroyFunc destroy_value) {
+  return map_create_with_capacity(compare, destroy_key, destroy_value, 0);
+}
+
+Map map_create_with_capacity(CompareFunc compare, DestroyFunc destroy_key,
+                             DestroyFunc destroy_value, size_t expected) {
+  Map map = malloc(sizeof(*map));
+  if (map == NULL)
+    return NULL;
+
+  map->capacity = capacity_for(expected);
+  map->entry_count = 0;
+  map->size = 0;
+
+  map->index = malloc(map->capacity * sizeof(*map->index));
+  map->entries = malloc(usable(map->capacity) * sizeof(*map->entries));
+  if (map->index == NULL || map->entries == NULL) {
+    free(map->index);
+    free(map->entries);
+    free(map);
+    return NULL;
+  }
+  memset(map->index, 0xff, map->capacity * sizeof(*map->index)); // EMPTY_SLOT
+
+  map->compare = compare;
+  map->hash_function = NULL;
+  map->destroy_key = destroy_key;
+  map->destroy_value = destroy_value;
+
+  map->savings.hash_calls = 0;
+  map->savings.compare_calls = 0;
+
+  return map;
+}
+
+void map_destroy(Map map) {
+  for (size_t i = 0; i < map->entry_count; i++) {
+    if (map->entries[i].key != NULL) {
+      if (map->destroy_key != NULL)
+        map->destroy_key(map->entries[i].key);
+      if (map->destroy_value != NULL)
+        map->destroy_value(map->entries[i].value);
+    }
+  }
+
+  free(map->entries);
+  free(map->index);
+  free(map);
+}
+
+DestroyFunc map_set_destroy_key(Map map, DestroyFunc destroy_key) {
+  DestroyFunc old = map->destroy_key;
+  map->destroy_key = destroy_key;
+  return old;
+}
+
+DestroyFunc map_set_destroy_value(Map map, DestroyFunc destroy_value) {
+  DestroyFunc old = map->destroy_value;
+  map->destroy_value = destroy_value;
+  return old;
+}
+
+size_t map_size(Map map) { return map->size; }
+
+/// @brief Resizes the index to new_capacity slots, packs the entries, without
+/// holes, and indexes them again.
+///
+/// Uses the cached hashes, so hash_function is not called.
+///
+static void resize(Map map, size_t new_capacity) {
+  // On failure, keep the current index and entries.
+  uint32_t *index = malloc(new_capacity * sizeof(*index));
+  if (index == NULL)
+    return;
+
+  MapNode entries;
+  bool pack = map->entry_count != map->size;
+  if (pack)
+    entries = malloc(usable(new_capacity) * sizeof(*entries));
+  else // No holes, the entries stay where they are.
+    entries = realloc(map->entries, usable(new_capacity) * sizeof(*entries));
+  if (entries == NULL) {
+    free(index);
+    return;
+  }
+  memset(index, 0xff, new_capacity * sizeof(*index)); // EMPTY_SLOT
+
+  if (pack) {
+    size_t count = 0;
+    for (size_t i = 0; i < map->entry_count; i++) {
+      if (map->entries[i].key != NULL)
+        entries[count++] = map->entries[i];
+    }
+    free(map->entries);
+  }
+  map->entries = entries;
+  map->entry_count = map->size;
+
+  size_t mask = new_capacity - 1;
+  for (size_t i = 0; i < map->size; i++) {
+    size_t pos = entries[i].hash & mask;
+    while (index[pos] != EMPTY_SLOT)
+      pos = (pos + 1) & mask;
+    index[pos] = i;
+  }
+  map->savings.hash_calls += map->size;
+
+  free(map->index);
+  map->index = index;
+  map->capacity = new_capacity;
+}
+
+/// @brief Adds n to a counter of the map's savings.
+///
+/// Lookups may run concurrently (see map_find()), so the counter is read and
+/// written atomically, to not cause a data race. It is not incremented
+/// atomically, which would slow lookups down: concurrent additions may be lost.
+///
+static inline void savings_add(size_t *counter, size_t n) {
+  size_t value = __atomic_load_n(counter, __ATOMIC_RELAXED);
+  __atomic_store_n(counter, value + n, __ATOMIC_RELAXED);
+}
+
+/// @brief Returns the slot of the index that refers to key, or the empty slot
+/// where the probe sequence of key ends if key is not part of the map.
+///
+/// @param hash Mixed hash of key.
+///
+static size_t slot_find(Map map, void *key, uint32_t hash) {
+  size_t mask = map->capacity - 1;
+  for (size_t pos = hash & mask;; pos = (pos + 1) & mask) {
+    uint32_t i = map->index[pos];
+    if (i == EMPTY_SLOT)
+      return pos;
+
+    MapNode entry = &map->entries[i];
+    if (entry->hash != hash)
+      savings_add(&map->savings.compare_calls, 1);
+    else if (map->compare(entry->key, key) == 0)
+      return pos;
+  }
+}
+
+/// @brief Returns the entry of key, or MAP_EOF if key is not part of the map.
+///
+static MapNode entry_find(Map map, void *key, uint32_t hash) {
+  uint32_t i = map->index[slot_find(map, key, hash)];
+  return i != EMPTY_SLOT ? &map->entries[i] : MAP_EOF;
+}
+
+/// @brief Returns the entry of key, appending key with value NULL if it is not
+/// part of the map.
+///
+/// @param hash Mixed hash of key.
+/// @param inserted Set to true, if key was appended, otherwise false.
+///
+static MapNode entry_find_or_append(Map map, void *key, uint32_t hash,
+                                    bool *inserted) {
+  // Make room before probing, so that the slot found is still the right one.
+  // (At worst one insertion too early.) Packing the holes may be enough, and
+  // the index never shrinks on its own.
+  if (map->entry_count == usable(map->capacity)) {
+    size_t capacity = capacity_for(map->size + map->size / 2 + 1);
+    resize(map, capacity > map->capacity ? capacity : map->capacity);
+  }
+
+  size_t pos = slot_find(map, key, hash);
+  if (map->index[pos] != EMPTY_SLOT) {
+    *inserted = false;
+    return &map->entries[map->index[pos]];
+  }
+
+  MapNode entry = &map->entries[map->entry_count];
+  entry->key = key;
+  entry->value = NULL;
+  entry->hash = hash;
+  map->index[pos] = map->entry_count++;
+  map->size++;
+
+  *inserted = true;
+  return entry;
+}
+
+void map_reserve(Map map, size_t n) {
+  size_t capacity = capacity_for(n);
+  if (capacity > map->capacity)
+    resize(map, capacity);
+}
+
+void map_shrink_to_fit(Map map) {
+  // Also packs the holes left by removals.
+  size_t capacity = capacity_for(map->size);
+  if (capacity < map->capacity || map->entry_count != map->size)
+    resize(map, capacity);
+}
+
+/// @brief Associates entry, returned by entry_find_or_append(), with key and
+/// value.
+///
+/// @param inserted true, if entry was appended, otherwise its previous key and
+/// value are destroyed. The entry keeps its position in the order.
+///
+static void entry_set(Map map, MapNode entry, bool inserted, void *key,
+                      void *value) {
+  if (!inserted) {
+    // Destroy old key, value pair
+    if (map->destroy_key != NULL)
+      map->destroy_key(entry->key);
+    if (map->destroy_value != NULL)
+      map->destroy_value(entry->value);
+
+    entry->key = key;
+  }
+
+  entry->value = value;
+}
+
+void map_insert(Map map, void *key, void *value) {
+  assert(map->hash_function != NULL && key != NULL &&
+         "Expected key and hash function");
+
+  bool inserted;
+  MapNode entry = entry_find_or_append(
+      map, key, hash_mix(map->hash_function(key)), &inserted);
+  entry_set(map, entry, inserted, key, value);
+}
+
+void **map_find_or_insert(Map map, void *key, bool *inserted) {
+  assert(map->hash_function != NULL && key != NULL &&
+         "Expected key and hash function");
+
+  return &entry_find_or_append(map, key, hash_mix(map->hash_function(key)),
+                               inserted)
+              ->value;
+}
+
+bool map_update(Map map, void *key, MapUpdateFunc update, void *context) {
+  assert(map->hash_function != NULL && key != NULL &&
+         "Expected key and hash function");
+
+  bool inserted;
+  MapNode entry = entry_find_or_append(
+      map, key, hash_mix(map->hash_function(key)), &inserted);
+
+  update(&entry->value, context);
+
+  return inserted;
+}
+
+bool map_remove(Map map, void *key) {
+  assert(map->hash_function != NULL && key != NULL &&
+         "Expected key and hash function");
+
+  size_t pos = slot_find(map, key, hash_mix(map->hash_function(key)));
+  uint32_t i = map->index[pos];
+  if (i == EMPTY_SLOT)
+    return false;
+
+  MapNode entry = &map->entries[i];
+  if (map->destroy_key != NULL)
+    map->destroy_key(entry->key);
+  if (map->destroy_value != NULL)
+    map->destroy_value(entry->value);
+
+  // Leave a hole, or drop the entry if it is the last one, with the holes
+  // before it.
+  entry->key = NULL;
+  entry->value = NULL;
+  while (map->entry_count > 0 &&
+         map->entries[map->entry_count - 1].key == NULL)
+    map->entry_count--;
+  map->size--;
+
+  // Backward shift deletion: move back the following slots of the cluster
+  // that may take the free one, instead of leaving a tombstone in the index.
+  size_t mask = map->capacity - 1;
+  for (size_t next = (pos + 1) & mask; map->index[next] != EMPTY_SLOT;
+       next = (next + 1) & mask) {
+    size_t home = map->entries[map->index[next]].hash & mask;
+    if (((next - home) & mask) >= ((next - pos) & mask)) {
+      map->index[pos] = map->index[next];
+      pos = next;
+    }
+  }
+  map->index[pos] = EMPTY_SLOT;
+
+  return true;
+}
+
+void *map_find(Map map, void *key) {
+  MapNode node = map_find_node(map, key);
+  return node != MAP_EOF ? node->value : NULL;
+}
+
+MapNode map_find_node(Map map, void *key) {
+  assert(map->hash_function != NULL && key != NULL &&
+         "Expected key and hash function");
+
+  return entry_find(map, key, hash_mix(map->hash_function(key)));
+}
+
+//////////////////////////////// Batches ///////////////////////////////////////
+
+// A batch is pipelined: while key i is looked up, the home slot of the index
+// of key i + 2 * BATCH_DISTANCE is prefetched, and, since the home slot of key
+// i + BATCH_DISTANCE was prefetched BATCH_DISTANCE keys ago, the entry it
+// refers to too. Most lookups then find both in cache.
+
+/// @brief Keys between the two prefetches of a key, and between the second
+/// prefetch and the lookup.
+///
+#define BATCH_DISTANCE 8
+
+/// @brief Hashes of the keys in flight, indexed by position % BATCH_WINDOW.
+///
+#define BATCH_WINDOW (2 * BATCH_DISTANCE)
+
+/// @brief First prefetch of a batch: the home slot of hash.
+///
+static inline void prefetch_slot(Map map, uint32_t hash) {
+  __builtin_prefetch(&map->index[hash & (map->capacity - 1)]);
+}
+
+/// @brief Second prefetch of a batch: the entry the home slot of hash refers
+/// to, if any.
+///
+static inline void prefetch_entry(Map map, uint32_t hash) {
+  uint32_t i = map->index[hash & (map->capacity - 1)];
+  if (i != EMPTY_SLOT)
+    __builtin_prefetch(&map->entries[i]);
+}
+
+void map_find_batch(Map map, void **keys, size_t n, void **values) {
+  assert(map->hash_function != NULL && "Expected hash function");
+
+  uint32_t hashes[BATCH_WINDOW];
+  for (size_t i = 0; i < n + BATCH_WINDOW; i++) {
+    // The oldest key first, as the newest one takes its place in hashes.
+    if (i >= BATCH_WINDOW) {
+      size_t k = i - BATCH_WINDOW;
+      MapNode entry = entry_find(map, keys[k], hashes[k % BATCH_WINDOW]);
+      values[k] = entry != MAP_EOF ? entry->value : NULL;
+    }
+
+    if (i >= BATCH_DISTANCE && i - BATCH_DISTANCE < n)
+      prefetch_entry(map, hashes[(i - BATCH_DISTANCE) % BATCH_WINDOW]);
+
+    if (i < n) {
+      assert(keys[i] != NULL && "Expected key");
+      hashes[i % BATCH_WINDOW] = hash_mix(map->hash_function(keys[i]));
+      prefetch_slot(map, hashes[i % BATCH_WINDOW]);
+    }
+  }
+}
+
+void map_insert_batch(Map map, void **keys, size_t n, void **values) {
+  assert(map->hash_function != NULL && "Expected hash function");
+
+  // Same pipeline as map_find_batch(). A resize in the middle of the batch
+  // only makes the prefetches of the keys in flight useless.
+  uint32_t hashes[BATCH_WINDOW];
+  for (size_t i = 0; i < n + BATCH_WINDOW; i++) {
+    if (i >= BATCH_WINDOW) {
+      size_t k = i - BATCH_WINDOW;
+      bool inserted;
+      MapNode entry = entry_find_or_append(
+          map, keys[k], hashes[k % BATCH_WINDOW], &inserted);
+      entry_set(map, entry, inserted, keys[k], values[k]);
+    }
+
+    if (i >= BATCH_DISTANCE && i - BATCH_DISTANCE < n)
+      prefetch_entry(map, hashes[(i - BATCH_DISTANCE) % BATCH_WINDOW]);
+
+    if (i < n) {
+      assert(keys[i] != NULL && "Expected key");
+      hashes[i % BATCH_WINDOW] = hash_mix(map->hash_function(keys[i]));
+      prefetch_slot(map, hashes[i % BATCH_WINDOW]);
+    }
+  }
+}
+
+void *map_node_key(Map map, MapNode node) { return node->key; }
+
+void *map_node_value(Map map, MapNode node) { return node->value; }
+
+/////////////////////// Traversal in insertion order ///////////////////////////
+
+/// @brief Returns the first entry at or after position pos that is not a hole,
+/// or MAP_EOF if there is none.
+///
+static MapNode entry_next_present(Map map, size_t pos) {
+  for (; pos < map->entry_count; pos++) {
+    if (map->entries[pos].key != NULL)
+      return &map->entries[pos];
+  }
+
+  return MAP_EOF;
+}
+
+MapNode map_first(Map map) { return entry_next_present(map, 0); }
+
+MapNode map_next(Map map, MapNode node) {
+  assert(node != NULL);
+  return entry_next_present(map, (node - map->entries) + 1);
+}
+
+/// @brief Points iter to the first entry at or after position pos that is not
+/// a hole.
+///
+static void iter_seek(Map map, MapIterator *iter, size_t pos) {
+  iter->node = entry_next_present(map, pos);
+  iter->position = iter->node != MAP_EOF ? (size_t)(iter->node - map->entries)
+                                         : map->entry_count;
+  iter->cursor = NULL;
+}
+
+MapIterator map_iter_begin(Map map) {
+  MapIterator iter;
+  iter_seek(map, &iter, 0);
+  return iter;
+}
+
+bool map_iter_valid(Map map, MapIterator *iter) {
+  return iter->node != MAP_EOF;
+}
+
+void map_iter_next(Map map, MapIterator *iter) {
+  assert(iter->node != MAP_EOF);
+  iter_seek(map, iter, iter->position + 1);
+}
+
+MapNode map_iter_node(Map map, MapIterator *iter) { return iter->node; }
+
+void map_savings(Map map, MapSavings *savings) { *savings = map->savings; }
+
+void map_set_hash_function(Map map, HashFunc func) {
+  map->hash_function = func;
+}
+
+unsigned int hash_string(void *value) {
+  // djb2 hash function, simple, fast, and generally efficient.
+  unsigned int hash = 5381;
+  for (char *s = value; *s != '\0'; s++)
+    hash = (hash << 5) + hash + *s; // hash * 33 + *s
+  return hash;
+}
+
+unsigned int hash_int(void *value) { return *(int *)value; }
+
+unsigned int hash_pointer(void *value) { return (size_t)value; }
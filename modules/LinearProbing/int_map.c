@@ -0,0 +1,12 @@
+/// @file int_map.c
+///
+/// Implementation of the maps of int_map.h, with linear probing.
+///
+/// The maps are generated by INT_MAP_DEFINE(), see int_map.h for the layout of
+/// the table.
+
+#include "int_map.h"
+
+INT_MAP_DEFINE(IntMap, int_map, int, int, 0, int_map_hash)
+
+INT_MAP_DEFINE(U64Map, u64_map, uint64_t, uint64_t, 0, int_map_hash)
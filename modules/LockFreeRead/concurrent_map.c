@@ -0,0 +1,401 @@
+/// @file concurrent_map.c
+///
+/// Implementation of Concurrent Map Abstract Data Type with lock-free lookups.
+///
+/// The map is split into shards, each one a hash table with separate chaining
+/// and a mutex for its writers. Lookups take no lock and write no shared
+/// memory: they only enter a critical section of the map's epoch domain
+/// (see epoch.h) while they walk a chain.
+///
+/// Writers never modify a node that readers can reach. A node is linked with a
+/// release store after it is fully initialized, replaced by a new node to
+/// change its value, and unlinked with a release store to remove it. Unlinked
+/// nodes, and the keys and values they own, are destroyed by epoch_defer().
+/// Growing a shard builds a new table of new nodes and publishes it at once.
+
+#include "concurrent_map.h"
+
+#include <pthread.h> // pthread_mutex_t
+#include <stdint.h>  // uint32_t, uint64_t
+#include <stdlib.h>  // malloc, calloc, aligned_alloc, free
+
+#include "epoch.h"
+
+/// @brief Number of shards, when concurrent_map_create() is given 0.
+///
+#define DEFAULT_SHARDS 64
+
+/// @brief Size of a cache line.
+///
+#define CACHE_LINE 64
+
+/// @brief Buckets of the table of a new shard. Always a power of two.
+///
+#define MIN_BUCKETS 16
+
+/// @brief Immutable once reachable by readers, except for next.
+///
+struct node {
+  void *key;
+  void *value;
+  uint32_t hash;
+  struct node *next; // Accessed atomically.
+};
+
+/// @brief Table of a shard. Replaced as a whole when the shard grows.
+///
+struct table {
+  size_t mask;            // Buckets - 1.
+  struct node *buckets[]; // Accessed atomically.
+};
+
+/// @brief A part of the map, with its own writer lock.
+///
+struct shard {
+  pthread_mutex_t lock; // Serializes the writers of the shard.
+  struct table *table;  // Accessed atomically.
+  size_t size;          // Accessed atomically.
+} __attribute__((aligned(CACHE_LINE)));
+
+struct concurrent_map {
+  struct shard *shards;
+  size_t shard_count;
+  EpochDomain domain;
+
+  CompareFunc compare;
+  HashFunc hash;
+  DestroyFunc destroy_key;
+  DestroyFunc destroy_value;
+};
+
+/// @brief Mixes a hash (finalizer of murmur3), so that all of its bits affect
+/// both the shard and the bucket.
+///
+static uint32_t hash_mix(uint32_t hash) {
+  hash ^= hash >> 16;
+  hash *= 0x85ebca6b;
+  hash ^= hash >> 13;
+  hash *= 0xc2b2ae35;
+  hash ^= hash >> 16;
+  return hash;
+}
+
+/// @brief Allocates a table with the given number of empty buckets.
+///
+static struct table *table_create(size_t buckets) {
+  struct table *table =
+      calloc(1, sizeof(*table) + buckets * sizeof(*table->buckets));
+  if (table != NULL)
+    table->mask = buckets - 1;
+  return table;
+}
+
+/// @brief Frees table and its nodes, but not the keys and values they share
+/// with another table.
+///
+static void table_free(struct table *table) {
+  for (size_t b = 0; b <= table->mask; b++) {
+    struct node *node = table->buckets[b];
+    while (node != NULL) {
+      struct node *next = node->next;
+      free(node);
+      node = next;
+    }
+  }
+  free(table);
+}
+
+ConcurrentMap concurrent_map_create(CompareFunc compare, DestroyFunc destroy_key,
+                                    DestroyFunc destroy_value, HashFunc hash,
+                                    size_t shards) {
+  ConcurrentMap map = malloc(sizeof(*map));
+  if (map == NULL)
+    return NULL;
+
+  map->shard_count = shards != 0 ? shards : DEFAULT_SHARDS;
+  map->compare = compare;
+  map->hash = hash;
+  map->destroy_key = destroy_key;
+  map->destroy_value = destroy_value;
+
+  map->domain = epoch_domain_create();
+  map->shards =
+      aligned_alloc(CACHE_LINE, map->shard_count * sizeof(*map->shards));
+  if (map->domain == NULL || map->shards == NULL) {
+    if (map->domain != NULL)
+      epoch_domain_destroy(map->domain);
+    free(map->shards);
+    free(map);
+    return NULL;
+  }
+
+  for (size_t i = 0; i < map->shard_count; i++) {
+    map->shards[i].table = table_create(MIN_BUCKETS);
+    if (map->shards[i].table == NULL) {
+      // Unwind the shards created so far.
+      while (i-- > 0) {
+        free(map->shards[i].table);
+        pthread_mutex_destroy(&map->shards[i].lock);
+      }
+      epoch_domain_destroy(map->domain);
+      free(map->shards);
+      free(map);
+      return NULL;
+    }
+    pthread_mutex_init(&map->shards[i].lock, NULL);
+    map->shards[i].size = 0;
+  }
+
+  return map;
+}
+
+void concurrent_map_destroy(ConcurrentMap map) {
+  // Replaced and removed nodes first, then the nodes still in the map.
+  epoch_domain_destroy(map->domain);
+
+  for (size_t i = 0; i < map->shard_count; i++) {
+    struct table *table = map->shards[i].table;
+    for (size_t b = 0; b <= table->mask; b++) {
+      struct node *node = table->buckets[b];
+      while (node != NULL) {
+        struct node *next = node->next;
+        if (map->destroy_key != NULL)
+          map->destroy_key(node->key);
+        if (map->destroy_value != NULL)
+          map->destroy_value(node->value);
+        free(node);
+        node = next;
+      }
+    }
+    free(table);
+    pthread_mutex_destroy(&map->shards[i].lock);
+  }
+
+  free(map->shards);
+  free(map);
+}
+
+/// @brief Returns the shard of a mixed hash, picked by its high bits.
+///
+static struct shard *shard_of(ConcurrentMap map, uint32_t hash) {
+  // (hash / 2^32) * shard_count, without a division.
+  return &map->shards[((uint64_t)hash * map->shard_count) >> 32];
+}
+
+size_t concurrent_map_size(ConcurrentMap map) {
+  size_t size = 0;
+  for (size_t i = 0; i < map->shard_count; i++)
+    size += __atomic_load_n(&map->shards[i].size, __ATOMIC_RELAXED);
+
+  return size;
+}
+
+void *concurrent_map_find(ConcurrentMap map, void *key) {
+  uint32_t hash = hash_mix(map->hash(key));
+  struct shard *shard = shard_of(map, hash);
+  void *value = NULL;
+
+  epoch_enter(map->domain);
+
+  // Acquire loads pair with the release stores that published each node, so
+  // its fields are seen initialized.
+  struct table *table = __atomic_load_n(&shard->table, __ATOMIC_ACQUIRE);
+  struct node *node =
+      __atomic_load_n(&table->buckets[hash & table->mask], __ATOMIC_ACQUIRE);
+  for (; node != NULL; node = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE)) {
+    if (node->hash == hash && map->compare(node->key, key) == 0) {
+      value = node->value;
+      break;
+    }
+  }
+
+  epoch_exit(map->domain);
+
+  return value;
+}
+
+/// @brief Returns the address of the link to the node with key, or of the
+/// NULL link at the end of its chain if key is not part of the shard.
+///
+/// Called by writers, under shard->lock.
+///
+static struct node **link_find(ConcurrentMap map, struct shard *shard,
+                               void *key, uint32_t hash) {
+  struct node **link = &shard->table->buckets[hash & shard->table->mask];
+  for (; *link != NULL; link = &(*link)->next) {
+    if ((*link)->hash == hash && map->compare((*link)->key, key) == 0)
+      break;
+  }
+
+  return link;
+}
+
+/// @brief Returns a new node, or NULL if out of memory.
+///
+static struct node *node_create(void *key, void *value, uint32_t hash,
+                                struct node *next) {
+  struct node *node = malloc(sizeof(*node));
+  if (node == NULL)
+    return NULL;
+
+  node->key = key;
+  node->value = value;
+  node->hash = hash;
+  node->next = next;
+  return node;
+}
+
+/// @brief Doubles the buckets of shard, if it is fuller than one node per
+/// bucket.
+///
+/// Readers may be walking the current table, so its nodes are copied into a
+/// new table, which is published at once. The old table and nodes are freed
+/// by epoch_defer(), without destroying the keys and values they share with
+/// the new nodes.
+///
+/// Called by writers, under shard->lock.
+///
+static void shard_grow(ConcurrentMap map, struct shard *shard) {
+  struct table *old = shard->table;
+  if (shard->size <= old->mask + 1)
+    return;
+
+  struct table *table = table_create(2 * (old->mask + 1));
+  if (table == NULL)
+    return; // Keep the current table, with longer chains.
+
+  for (size_t b = 0; b <= old->mask; b++) {
+    for (struct node *node = old->buckets[b]; node != NULL;
+         node = node->next) {
+      struct node **head = &table->buckets[node->hash & table->mask];
+      struct node *copy =
+          node_create(node->key, node->value, node->hash, *head);
+      if (copy == NULL) {
+        table_free(table);
+        return; // Keep the current table, with longer chains.
+      }
+      *head = copy;
+    }
+  }
+
+  __atomic_store_n(&shard->table, table, __ATOMIC_RELEASE);
+
+  // This thread is not in a critical section, so other writers may free a
+  // node as soon as it is deferred: read its next node first.
+  for (size_t b = 0; b <= old->mask; b++) {
+    struct node *node = old->buckets[b];
+    while (node != NULL) {
+      struct node *next = node->next;
+      epoch_defer(map->domain, free, node);
+      node = next;
+    }
+  }
+  epoch_defer(map->domain, free, old);
+}
+
+/// @brief Replaces the node at link with node, or, if link is the end of a
+/// chain, appends it.
+///
+/// node is allocated before, so that running out of memory leaves the chain
+/// as it is.
+///
+/// @return The node replaced, or NULL if the node was appended.
+///
+/// Called by writers, under shard->lock.
+///
+static struct node *link_set(struct node **link, struct node *node) {
+  struct node *old = *link;
+  node->next = old != NULL ? old->next : NULL;
+
+  __atomic_store_n(link, node, __ATOMIC_RELEASE);
+
+  return old;
+}
+
+bool concurrent_map_insert(ConcurrentMap map, void *key, void *value) {
+  uint32_t hash = hash_mix(map->hash(key));
+  struct shard *shard = shard_of(map, hash);
+
+  struct node *node = node_create(key, value, hash, NULL);
+  if (node == NULL)
+    return false;
+
+  pthread_mutex_lock(&shard->lock);
+
+  struct node *old = link_set(link_find(map, shard, key, hash), node);
+  if (old != NULL) {
+    // Readers may still use the previous key and value.
+    if (map->destroy_key != NULL)
+      epoch_defer(map->domain, map->destroy_key, old->key);
+    if (map->destroy_value != NULL)
+      epoch_defer(map->domain, map->destroy_value, old->value);
+    epoch_defer(map->domain, free, old);
+  } else {
+    __atomic_store_n(&shard->size, shard->size + 1, __ATOMIC_RELAXED);
+    shard_grow(map, shard);
+  }
+
+  pthread_mutex_unlock(&shard->lock);
+
+  return true;
+}
+
+bool concurrent_map_update(ConcurrentMap map, void *key, MapUpdateFunc update,
+                           void *context) {
+  uint32_t hash = hash_mix(map->hash(key));
+  struct shard *shard = shard_of(map, hash);
+
+  // Key and value are set once known, before the node is linked.
+  struct node *node = node_create(NULL, NULL, hash, NULL);
+  if (node == NULL)
+    return false;
+
+  pthread_mutex_lock(&shard->lock);
+
+  struct node **link = link_find(map, shard, key, hash);
+  struct node *old = *link;
+
+  // The node keeps its key, so the caller keeps key if it is already present.
+  void *value = old != NULL ? old->value : NULL;
+  update(&value, context);
+  node->key = old != NULL ? old->key : key;
+  node->value = value;
+  link_set(link, node);
+
+  if (old != NULL) {
+    if (value != old->value && old->value != NULL && map->destroy_value != NULL)
+      epoch_defer(map->domain, map->destroy_value, old->value);
+    epoch_defer(map->domain, free, old);
+  } else {
+    __atomic_store_n(&shard->size, shard->size + 1, __ATOMIC_RELAXED);
+    shard_grow(map, shard);
+  }
+
+  pthread_mutex_unlock(&shard->lock);
+
+  return old == NULL;
+}
+
+bool concurrent_map_remove(ConcurrentMap map, void *key) {
+  uint32_t hash = hash_mix(map->hash(key));
+  struct shard *shard = shard_of(map, hash);
+
+  pthread_mutex_lock(&shard->lock);
+
+  struct node **link = link_find(map, shard, key, hash);
+  struct node *old = *link;
+  if (old != NULL) {
+    __atomic_store_n(link, old->next, __ATOMIC_RELEASE);
+    __atomic_store_n(&shard->size, shard->size - 1, __ATOMIC_RELAXED);
+
+    if (map->destroy_key != NULL)
+      epoch_defer(map->domain, map->destroy_key, old->key);
+    if (map->destroy_value != NULL)
+      epoch_defer(map->domain, map->destroy_value, old->value);
+    epoch_defer(map->domain, free, old);
+  }
+
+  pthread_mutex_unlock(&shard->lock);
+
+  return old != NULL;
+}
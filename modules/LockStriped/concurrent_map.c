@@ -0,0 +1,181 @@
+/// @file concurrent_map.c
+///
+/// Implementation of Concurrent Map Abstract Data Type using lock striping.
+///
+/// The map is split into shards, each one a Map with its own reader-writer
+/// lock. A key always lives in the same shard, picked by the high bits of its
+/// hash, so operations on keys of different shards never wait for each other,
+/// and lookups of keys of the same shard share its lock.
+///
+/// Any implementation of map.h can be linked as the shards.
+
+#include "concurrent_map.h"
+
+#include <pthread.h> // pthread_rwlock_t
+#include <stdint.h>  // uint32_t, uint64_t
+#include <stdlib.h>  // aligned_alloc, free
+
+/// @brief Number of shards, when concurrent_map_create() is given 0.
+///
+#define DEFAULT_SHARDS 64
+
+/// @brief Size of a cache line.
+///
+#define CACHE_LINE 64
+
+/// @brief A part of the map, with its own lock.
+///
+/// Each shard takes whole cache lines, so that threads locking neighbouring
+/// shards do not invalidate each other's caches.
+///
+struct shard {
+  pthread_rwlock_t lock;
+  Map map;
+} __attribute__((aligned(CACHE_LINE)));
+
+struct concurrent_map {
+  struct shard *shards;
+  size_t shard_count;
+  HashFunc hash;
+  DestroyFunc destroy_value;
+};
+
+ConcurrentMap concurrent_map_create(CompareFunc compare, DestroyFunc destroy_key,
+                                    DestroyFunc destroy_value, HashFunc hash,
+                                    size_t shards) {
+  ConcurrentMap map = malloc(sizeof(*map));
+  if (map == NULL)
+    return NULL;
+
+  map->shard_count = shards != 0 ? shards : DEFAULT_SHARDS;
+  map->hash = hash;
+  map->destroy_value = destroy_value;
+
+  map->shards =
+      aligned_alloc(CACHE_LINE, map->shard_count * sizeof(*map->shards));
+  if (map->shards == NULL) {
+    free(map);
+    return NULL;
+  }
+
+  for (size_t i = 0; i < map->shard_count; i++) {
+    map->shards[i].map = map_create(compare, destroy_key, destroy_value);
+    if (map->shards[i].map == NULL) {
+      // Destroy the shards created so far.
+      while (i-- > 0) {
+        map_destroy(map->shards[i].map);
+        pthread_rwlock_destroy(&map->shards[i].lock);
+      }
+      free(map->shards);
+      free(map);
+      return NULL;
+    }
+    map_set_hash_function(map->shards[i].map, hash);
+    pthread_rwlock_init(&map->shards[i].lock, NULL);
+  }
+
+  return map;
+}
+
+void concurrent_map_destroy(ConcurrentMap map) {
+  for (size_t i = 0; i < map->shard_count; i++) {
+    map_destroy(map->shards[i].map);
+    pthread_rwlock_destroy(&map->shards[i].lock);
+  }
+
+  free(map->shards);
+  free(map);
+}
+
+/// @brief Returns the shard of key.
+///
+/// The hash is mixed first (finalizer of murmur3), so that weak hash functions
+/// with constant high bits, e.g. hash_int on small ints, still spread over all
+/// the shards. Its high bits then pick the shard, while the shard's Map uses
+/// the low bits of the original hash.
+///
+static struct shard *shard_of(ConcurrentMap map, void *key) {
+  uint32_t hash = map->hash(key);
+  hash ^= hash >> 16;
+  hash *= 0x85ebca6b;
+  hash ^= hash >> 13;
+  hash *= 0xc2b2ae35;
+  hash ^= hash >> 16;
+
+  // (hash / 2^32) * shard_count, without a division.
+  return &map->shards[((uint64_t)hash * map->shard_count) >> 32];
+}
+
+size_t concurrent_map_size(ConcurrentMap map) {
+  size_t size = 0;
+  for (size_t i = 0; i < map->shard_count; i++) {
+    struct shard *shard = &map->shards[i];
+    pthread_rwlock_rdlock(&shard->lock);
+    size += map_size(shard->map);
+    pthread_rwlock_unlock(&shard->lock);
+  }
+
+  return size;
+}
+
+bool concurrent_map_insert(ConcurrentMap map, void *key, void *value) {
+  struct shard *shard = shard_of(map, key);
+
+  pthread_rwlock_wrlock(&shard->lock);
+
+  // map_insert() does not report running out of memory, so a new key is
+  // inserted with map_find_or_insert(). A present key is replaced in place.
+  bool inserted;
+  void **slot = map_find_or_insert(shard->map, key, &inserted);
+  if (slot != NULL && inserted)
+    *slot = value;
+  else if (slot != NULL)
+    map_insert(shard->map, key, value);
+
+  pthread_rwlock_unlock(&shard->lock);
+
+  return slot != NULL;
+}
+
+bool concurrent_map_update(ConcurrentMap map, void *key, MapUpdateFunc update,
+                           void *context) {
+  struct shard *shard = shard_of(map, key);
+
+  pthread_rwlock_wrlock(&shard->lock);
+
+  bool inserted;
+  void **value = map_find_or_insert(shard->map, key, &inserted);
+  if (value == NULL) {
+    pthread_rwlock_unlock(&shard->lock);
+    return false; // Out of memory, key was not inserted.
+  }
+
+  void *previous = *value;
+  update(value, context);
+  if (*value != previous && previous != NULL && map->destroy_value != NULL)
+    map->destroy_value(previous);
+
+  pthread_rwlock_unlock(&shard->lock);
+
+  return inserted;
+}
+
+bool concurrent_map_remove(ConcurrentMap map, void *key) {
+  struct shard *shard = shard_of(map, key);
+
+  pthread_rwlock_wrlock(&shard->lock);
+  bool removed = map_remove(shard->map, key);
+  pthread_rwlock_unlock(&shard->lock);
+
+  return removed;
+}
+
+void *concurrent_map_find(ConcurrentMap map, void *key) {
+  struct shard *shard = shard_of(map, key);
+
+  pthread_rwlock_rdlock(&shard->lock);
+  void *value = map_find(shard->map, key);
+  pthread_rwlock_unlock(&shard->lock);
+
+  return value;
+}
@@ -0,0 +1,289 @@
+/// @file mapped_map.c
+///
+/// Implementation of Mapped Map Abstract Data Type using an open addressing
+/// hash table stored in a file.
+///
+/// Layout of the file, all offsets from the start of the file:
+///
+///   struct file_header
+///   struct file_slot[slot_count]   linear probing, at most half full
+///   records                        each one aligned to 8 bytes
+///
+/// A record is a struct file_record, followed by the bytes of the key, padding
+/// to 8 bytes, and the bytes of the value. A slot holds the hash of the bytes
+/// of a key, so that most keys that are not equal are told apart without
+/// reading their record, and the offset of the record, 0 if the slot is empty.
+
+#include "mapped_map.h"
+
+#include <fcntl.h>    // open
+#include <stdint.h>   // uint32_t, uint64_t
+#include <stdio.h>    // FILE, fopen, fwrite, fseek, fclose, rename, remove
+#include <stdlib.h>   // malloc, calloc, realloc, free
+#include <string.h>   // memcmp, strlen, memcpy
+#include <sys/mman.h> // mmap, munmap
+#include <sys/stat.h> // fstat
+#include <unistd.h>   // close
+
+#include "hash.h"
+
+/// @brief Identifies the files saved by map_save(), and their version.
+///
+#define FILE_MAGIC "CTBXMAP1"
+
+/// @brief Alignment of records and values.
+///
+#define ALIGNMENT 8
+
+struct file_header {
+  char magic[8];
+  uint64_t size;       // Number of elements.
+  uint64_t slot_count; // Power of two.
+  uint64_t seed;       // Seed of the hashes of the keys.
+  uint64_t file_size;
+};
+
+struct file_slot {
+  uint64_t hash;
+  uint64_t offset; // Offset of the record, 0 if empty.
+};
+
+struct file_record {
+  uint32_t key_size;
+  uint32_t value_size;
+};
+
+struct mapped_map {
+  const unsigned char *base; // Start of the mapped file.
+  size_t file_size;
+  const struct file_slot *slots;
+  uint64_t mask; // slot_count - 1.
+  uint64_t seed;
+  size_t size;
+};
+
+/// @brief Returns size rounded up to the alignment of records.
+///
+static inline uint64_t align(uint64_t size) {
+  return (size + ALIGNMENT - 1) & ~(uint64_t)(ALIGNMENT - 1);
+}
+
+/// @brief Serializes value into *buffer, growing *buffer as needed.
+///
+/// @return Size of the bytes of value, or SIZE_MAX if out of memory.
+///
+static size_t serialize(SerializeFunc serialize_value, void *value,
+                        void **buffer, size_t *capacity) {
+  size_t size = serialize_value(value, *buffer, *capacity);
+  if (size > *capacity) {
+    void *grown = realloc(*buffer, size);
+    if (grown == NULL)
+      return SIZE_MAX;
+    *buffer = grown;
+    *capacity = size;
+    serialize_value(value, *buffer, *capacity);
+  }
+  return size;
+}
+
+/// @brief Writes the records of the elements of map to file, from offset on.
+///
+/// @param slots Filled with the hash and offset of each record, in any order.
+///
+/// @return true, if every record was written, otherwise false.
+///
+static bool records_write(Map map, FILE *file, uint64_t offset, uint64_t seed,
+                          SerializeFunc serialize_key,
+                          SerializeFunc serialize_value,
+                          struct file_slot *slots) {
+  static const char padding[ALIGNMENT] = {0};
+  void *key = NULL, *value = NULL;
+  size_t key_capacity = 0, value_capacity = 0;
+  bool written = true;
+
+  size_t i = 0;
+  for (MapIterator iter = map_iter_begin(map);
+       written && map_iter_valid(map, &iter); map_iter_next(map, &iter)) {
+    MapNode node = map_iter_node(map, &iter);
+    size_t key_size = serialize(serialize_key, map_node_key(map, node), &key,
+                                &key_capacity);
+    size_t value_size = serialize(serialize_value, map_node_value(map, node),
+                                  &value, &value_capacity);
+    if (key_size > UINT32_MAX || value_size > UINT32_MAX) {
+      written = false; // Out of memory, or too large for a record.
+      break;
+    }
+
+    struct file_record record = {key_size, value_size};
+    uint64_t key_end = sizeof(record) + key_size;
+    uint64_t value_end = align(key_end) + value_size;
+    written = fwrite(&record, sizeof(record), 1, file) == 1 &&
+              fwrite(key, 1, key_size, file) == key_size &&
+              fwrite(padding, 1, align(key_end) - key_end, file) ==
+                  align(key_end) - key_end &&
+              fwrite(value, 1, value_size, file) == value_size &&
+              fwrite(padding, 1, align(value_end) - value_end, file) ==
+                  align(value_end) - value_end;
+
+    slots[i++] = (struct file_slot){hash_bytes(key, key_size, seed), offset};
+    offset += align(value_end);
+  }
+
+  free(key);
+  free(value);
+  return written;
+}
+
+bool map_save(Map map, const char *path, SerializeFunc serialize_key,
+              SerializeFunc serialize_value) {
+  struct file_header header = {.size = map_size(map), .seed = hash_seed()};
+  memcpy(header.magic, FILE_MAGIC, sizeof(header.magic));
+
+  // At most half full, so that misses stop at an empty slot quickly.
+  header.slot_count = 2;
+  while (header.slot_count < 2 * header.size)
+    header.slot_count *= 2;
+
+  size_t length = strlen(path);
+  char *temporary = malloc(length + sizeof(".tmp"));
+  struct file_slot *records = malloc(header.size * sizeof(*records));
+  struct file_slot *slots = calloc(header.slot_count, sizeof(*slots));
+  FILE *file = NULL;
+  bool saved = false;
+  if (temporary == NULL || (records == NULL && header.size > 0) ||
+      slots == NULL)
+    goto out;
+
+  memcpy(temporary, path, length);
+  memcpy(temporary + length, ".tmp", sizeof(".tmp"));
+  file = fopen(temporary, "wb");
+  if (file == NULL)
+    goto out;
+
+  // Records first, after room for the header and the slots.
+  uint64_t start = sizeof(header) + header.slot_count * sizeof(*slots);
+  if (fseek(file, start, SEEK_SET) != 0 ||
+      !records_write(map, file, start, header.seed, serialize_key,
+                     serialize_value, records))
+    goto out;
+  header.file_size = ftell(file);
+
+  uint64_t mask = header.slot_count - 1;
+  for (size_t i = 0; i < header.size; i++) {
+    uint64_t pos = records[i].hash & mask;
+    while (slots[pos].offset != 0)
+      pos = (pos + 1) & mask;
+    slots[pos] = records[i];
+  }
+
+  saved = fseek(file, 0, SEEK_SET) == 0 &&
+          fwrite(&header, sizeof(header), 1, file) == 1 &&
+          fwrite(slots, sizeof(*slots), header.slot_count, file) ==
+              header.slot_count;
+
+out:
+  if (file != NULL) {
+    saved = fclose(file) == 0 && saved;
+    if (saved)
+      saved = rename(temporary, path) == 0;
+    if (!saved)
+      remove(temporary);
+  }
+  free(temporary);
+  free(records);
+  free(slots);
+  return saved;
+}
+
+MappedMap map_open_mmap(const char *path) {
+  int fd = open(path, O_RDONLY);
+  if (fd == -1)
+    return NULL;
+
+  struct stat st;
+  void *base = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(struct file_header))
+    base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd); // The mapping keeps the file open.
+  if (base == MAP_FAILED)
+    return NULL;
+
+  // Check the header, so that the slots are inside the file. Records are
+  // checked by mapped_map_find().
+  const struct file_header *header = base;
+  size_t file_size = st.st_size;
+  uint64_t max_slots =
+      (file_size - sizeof(*header)) / sizeof(struct file_slot);
+  if (memcmp(header->magic, FILE_MAGIC, sizeof(header->magic)) != 0 ||
+      header->file_size != file_size || header->slot_count == 0 ||
+      (header->slot_count & (header->slot_count - 1)) != 0 ||
+      header->slot_count > max_slots || header->size >= header->slot_count) {
+    munmap(base, file_size);
+    return NULL;
+  }
+
+  MappedMap map = malloc(sizeof(*map));
+  if (map == NULL) {
+    munmap(base, file_size);
+    return NULL;
+  }
+  map->base = base;
+  map->file_size = file_size;
+  map->slots = (const struct file_slot *)(header + 1);
+  map->mask = header->slot_count - 1;
+  map->seed = header->seed;
+  map->size = header->size;
+
+  return map;
+}
+
+void mapped_map_close(MappedMap map) {
+  munmap((void *)map->base, map->file_size);
+  free(map);
+}
+
+size_t mapped_map_size(MappedMap map) { return map->size; }
+
+/// @brief Returns the record at offset, or NULL if it is not aligned or does
+/// not fit in the file, with its key and value.
+///
+static const struct file_record *record_at(MappedMap map, uint64_t offset) {
+  if (offset % ALIGNMENT != 0 ||
+      offset > map->file_size - sizeof(struct file_record))
+    return NULL;
+
+  const struct file_record *record =
+      (const struct file_record *)(map->base + offset);
+  uint64_t size =
+      align(sizeof(*record) + record->key_size) + record->value_size;
+  return size <= map->file_size - offset ? record : NULL;
+}
+
+const void *mapped_map_find(MappedMap map, const void *key, size_t key_size,
+                            size_t *value_size) {
+  uint64_t hash = hash_bytes(key, key_size, map->seed);
+
+  // At most slot_count probes, in case a corrupt file has no empty slot.
+  uint64_t pos = hash & map->mask;
+  for (uint64_t probe = 0; probe <= map->mask; probe++) {
+    const struct file_slot *slot = &map->slots[pos];
+    pos = (pos + 1) & map->mask;
+    if (slot->offset == 0)
+      return NULL; // Reached an empty slot, key is not in the map.
+    if (slot->hash != hash)
+      continue;
+
+    const struct file_record *record = record_at(map, slot->offset);
+    if (record == NULL)
+      continue; // Corrupt slot.
+
+    const unsigned char *bytes = (const unsigned char *)(record + 1);
+    if (record->key_size == key_size && memcmp(bytes, key, key_size) == 0) {
+      *value_size = record->value_size;
+      return map->base + slot->offset +
+             align(sizeof(*record) + record->key_size);
+    }
+  }
+
+  return NULL;
+}
@@ -0,0 +1,554 @@
+/// @file map.c
+///
+/// Implementation of Map Abstract Data Type using an open addressing hash
+/// table.
+///
+/// Entries are stored directly in a flat array of slots, so a lookup touches
+/// one or two cache lines instead of chasing bucket, list and node pointers.
+/// Collisions are resolved with linear probing and Robin Hood hashing: an entry
+/// that is far from its home slot takes the place of an entry that is closer to
+/// its own, which keeps every probe sequence short.
+///
+/// @note A MapNode points inside the slot array, so it is invalidated by
+/// map_insert() and map_remove().
+
+#include "map.h"
+
+#include <assert.h>  // assert
+#include <stdbool.h> // bool
+#include <stdint.h>  // uint32_t
+#include <stdlib.h>  // malloc, calloc, free, size_t
+
+/// @brief Table sizes used on each rehash.
+///
+/// Prime sizes spread the entries of weak hash functions (e.g. hash_int on
+/// strided keys) across the table. After the last prime, capacity doubles.
+///
+static size_t prime_sizes[] = {
+    53,        97,        193,       389,       769,       1543,     3079,
+    6151,      12289,     24593,     49157,     98317,     196613,   393241,
+    786433,    1572869,   3145739,   6291469,   12582917,  25165843, 50331653,
+    100663319, 201326611, 402653189, 805306457, 1610612741};
+
+/// @brief Maximum load factor before the table grows.
+///
+/// Robin Hood hashing keeps the probe length variance low, so the table can be
+/// filled higher than plain linear probing allows.
+///
+#define MAX_LOAD_FACTOR 0.8
+
+/// A slot of the table. A slot is empty when its key is NULL.
+struct map_node {
+  void *key;
+  void *value;
+  uint32_t hash;         // Cached (mixed) hash of key, avoids calling
+                         // hash_function on rehash and most calls of
+                         // compare on lookup.
+  unsigned int distance; // Distance from the home slot (hash % capacity).
+};
+
+struct map {
+  MapNode slots;   // Flat array of capacity slots.
+  size_t capacity; // Number of slots.
+  size_t size;     // Number of occupied slots.
+
+  CompareFunc compare;
+  HashFunc hash_function;
+  DestroyFunc destroy_key;
+  DestroyFunc destroy_value;
+
+  MapSavings savings; // Calls of hash_function and compare avoided, thanks to
+                      // the cached hashes.
+};
+
+/// @brief Mixes the bits of a user provided hash.
+///
+/// Linear probing suffers from weak hash functions that map similar keys to
+/// neighbouring slots (e.g. hash_string on "key:1", "key:2", ...), so every bit
+/// of the hash is spread over the whole word first. (Finalizer of MurmurHash3.)
+/// The mix is a bijection, so equal mixed hashes still imply equal hashes.
+///
+static uint32_t hash_mix(unsigned int hash) {
+  uint32_t h = hash;
+  h ^= h >> 16;
+  h *= 0x85ebca6b;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35;
+  h ^= h >> 16;
+  return h;
+}
+
+/// @brief Returns the smallest capacity that holds size entries within
+/// MAX_LOAD_FACTOR.
+///
+static size_t capacity_for(size_t size) {
+  // Find the first prime that fits. If all primes are exhausted, double.
+  size_t prime_no = sizeof(prime_sizes) / sizeof(*prime_sizes);
+  for (size_t i = 0; i < prime_no; i++) {
+    if ((double)size / prime_sizes[i] <= MAX_LOAD_FACTOR)
+      return prime_sizes[i];
+  }
+
+  size_t capacity = prime_sizes[prime_no - 1];
+  while ((double)size / capacity > MAX_LOAD_FACTOR)
+    capacity *= 2;
+  return capacity;
+}
+
+Map map_create(CompareFunc compare, DestroyFunc destroy_key,
+               DestroyFunc destroy_value) {
+  return map_create_with_capacity(compare, destroy_key, destroy_value, 0);
+}
+
+Map map_create_with_capacity(CompareFunc compare, DestroyFunc destroy_key,
+                             DestroyFunc destroy_value, size_t expected) {
+  Map map = malloc(sizeof(*map));
+  if (map == NULL)
+    return NULL;
+
+  map->capacity = capacity_for(expected);
+  map->size = 0;
+
+  map->slots = calloc(map->capacity, sizeof(*map->slots)); // All slots empty.
+  if (map->slots == NULL) {
+    free(map);
+    return NULL;
+  }
+
+  map->compare = compare;
+  map->hash_function = NULL;
+  map->destroy_key = destroy_key;
+  map->destroy_value = destroy_value;
+
+  map->savings.hash_calls = 0;
+  map->savings.compare_calls = 0;
+
+  return map;
+}
+
+void map_destroy(Map map) {
+  for (size_t i = 0; i < map->capacity; i++) {
+    if (map->slots[i].key != NULL) {
+      if (map->destroy_key != NULL)
+        map->destroy_key(map->slots[i].key);
+      if (map->destroy_value != NULL)
+        map->destroy_value(map->slots[i].value);
+    }
+  }
+
+  free(map->slots);
+  free(map);
+}
+
+DestroyFunc map_set_destroy_key(Map map, DestroyFunc destroy_key) {
+  DestroyFunc old = map->destroy_key;
+  map->destroy_key = destroy_key;
+  return old;
+}
+
+DestroyFunc map_set_destroy_value(Map map, DestroyFunc destroy_value) {
+  DestroyFunc old = map->destroy_value;
+  map->destroy_value = destroy_value;
+  return old;
+}
+
+size_t map_size(Map map) { return map->size; }
+
+/// @brief Places entry into the table, starting at slot pos.
+///
+/// The key of entry must not already be part of the map, entry.distance must
+/// be the distance of pos from the home slot of entry, and there must be at
+/// least one empty slot.
+///
+static void slot_place(Map map, struct map_node entry, size_t pos) {
+  while (true) {
+    MapNode slot = &map->slots[pos];
+
+    if (slot->key == NULL) {
+      *slot = entry;
+      return;
+    }
+
+    // Robin Hood: steal the slot from an entry closer to its home slot, and
+    // continue placing the evicted entry instead.
+    if (slot->distance < entry.distance) {
+      struct map_node evicted = *slot;
+      *slot = entry;
+      entry = evicted;
+    }
+
+    pos = pos + 1 == map->capacity ? 0 : pos + 1;
+    entry.distance++;
+  }
+}
+
+/// @brief Resizes the table to new_capacity slots and places every entry
+/// again.
+///
+/// Uses the cached hashes, so hash_function is not called.
+///
+static void rehash(Map map, size_t new_capacity) {
+  size_t old_capacity = map->capacity;
+  MapNode old_slots = map->slots;
+
+  map->capacity = new_capacity;
+  map->slots = calloc(map->capacity, sizeof(*map->slots));
+  if (map->slots == NULL) {
+    // Keep the old table, the map remains usable at a higher load factor.
+    map->slots = old_slots;
+    map->capacity = old_capacity;
+    return;
+  }
+
+  for (size_t i = 0; i < old_capacity; i++) {
+    if (old_slots[i].key != NULL) {
+      struct map_node entry = old_slots[i];
+      entry.distance = 0;
+      slot_place(map, entry, entry.hash % map->capacity);
+      map->savings.hash_calls++;
+    }
+  }
+
+  free(old_slots);
+}
+
+/// @brief Adds n to a counter of the map's savings.
+///
+/// Lookups may run concurrently (see map_find()), so the counter is read and
+/// written atomically, to not cause a data race. It is not incremented
+/// atomically, which would slow lookups down: concurrent additions may be lost.
+///
+static inline void savings_add(size_t *counter, size_t n) {
+  size_t value = __atomic_load_n(counter, __ATOMIC_RELAXED);
+  __atomic_store_n(counter, value + n, __ATOMIC_RELAXED);
+}
+
+/// @brief Returns the slot holding key with given hash, or NULL if key is not
+/// part of the map.
+///
+static MapNode slot_find(Map map, void *key, uint32_t hash) {
+  size_t pos = hash % map->capacity;
+  for (unsigned int distance = 0;; distance++) {
+    MapNode slot = &map->slots[pos];
+
+    // An empty slot, or an entry closer to its home than we are to ours, ends
+    // the probe sequence: Robin Hood would have placed key before it.
+    if (slot->key == NULL || slot->distance < distance)
+      return MAP_EOF;
+
+    if (slot->hash != hash)
+      savings_add(&map->savings.compare_calls, 1);
+    else if (map->compare(slot->key, key) == 0)
+      return slot;
+
+    pos = pos + 1 == map->capacity ? 0 : pos + 1;
+  }
+}
+
+/// @brief Returns the slot of key, placing key with value NULL if it is not
+/// part of the map.
+///
+/// Walks the probe sequence of key once: the slot where the lookup stops is
+/// the slot where key belongs.
+///
+/// @param hash Mixed hash of key.
+/// @param inserted Set to true, if key was placed, otherwise false.
+///
+static MapNode slot_find_or_place(Map map, void *key, uint32_t hash,
+                                  bool *inserted) {
+  // Grow before probing, so that the slot found is still the right one, and
+  // there is always an empty slot. (At worst one insertion too early.)
+  if ((double)(map->size + 1) / map->capacity > MAX_LOAD_FACTOR)
+    rehash(map, capacity_for(map->size + 1));
+
+  size_t pos = hash % map->capacity;
+  for (unsigned int distance = 0;; distance++) {
+    MapNode slot = &map->slots[pos];
+
+    if (slot->key == NULL || slot->distance < distance) {
+      // key is not part of the map, and Robin Hood places it here. The entry
+      // that was here, if any, is placed further.
+      size_t next = pos + 1 == map->capacity ? 0 : pos + 1;
+      if (slot->key != NULL) {
+        struct map_node evicted = *slot;
+        evicted.distance++;
+        slot_place(map, evicted, next);
+      }
+
+      slot->key = key;
+      slot->value = NULL;
+      slot->hash = hash;
+      slot->distance = distance;
+
+      map->size++;
+
+      *inserted = true;
+      return slot;
+    }
+
+    if (slot->hash != hash) {
+      map->savings.compare_calls++;
+    } else if (map->compare(slot->key, key) == 0) {
+      *inserted = false;
+      return slot;
+    }
+
+    pos = pos + 1 == map->capacity ? 0 : pos + 1;
+  }
+}
+
+void map_reserve(Map map, size_t n) {
+  size_t capacity = capacity_for(n);
+  if (capacity > map->capacity)
+    rehash(map, capacity);
+}
+
+void map_shrink_to_fit(Map map) {
+  size_t capacity = capacity_for(map->size);
+  if (capacity < map->capacity)
+    rehash(map, capacity);
+}
+
+/// @brief Associates slot, returned by slot_find_or_place(), with key and
+/// value.
+///
+/// @param inserted true, if slot was placed, otherwise its previous key and
+/// value are destroyed.
+///
+static void slot_set(Map map, MapNode slot, bool inserted, void *key,
+                     void *value) {
+  if (!inserted) {
+    // Destroy old key, value pair
+    if (map->destroy_key != NULL)
+      map->destroy_key(slot->key);
+    if (map->destroy_value != NULL)
+      map->destroy_value(slot->value);
+
+    slot->key = key;
+  }
+
+  slot->value = value;
+}
+
+void map_insert(Map map, void *key, void *value) {
+  assert(map->hash_function != NULL && key != NULL &&
+         "Expected key and hash function");
+
+  bool inserted;
+  MapNode slot = slot_find_or_place(map, key, hash_mix(map->hash_function(key)),
+                                    &inserted);
+  slot_set(map, slot, inserted, key, value);
+}
+
+void **map_find_or_insert(Map map, void *key, bool *inserted) {
+  assert(map->hash_function != NULL && key != NULL &&
+         "Expected key and hash function");
+
+  return &slot_find_or_place(map, key, hash_mix(map->hash_function(key)),
+                             inserted)
+              ->value;
+}
+
+bool map_update(Map map, void *key, MapUpdateFunc update, void *context) {
+  assert(map->hash_function != NULL && key != NULL &&
+         "Expected key and hash function");
+
+  bool inserted;
+  MapNode slot = slot_find_or_place(map, key, hash_mix(map->hash_function(key)),
+                                    &inserted);
+
+  update(&slot->value, context);
+
+  return inserted;
+}
+
+bool map_remove(Map map, void *key) {
+  assert(map->hash_function != NULL && key != NULL &&
+         "Expected key and hash function");
+
+  MapNode slot = slot_find(map, key, hash_mix(map->hash_function(key)));
+  if (slot == MAP_EOF)
+    return false;
+
+  if (map->destroy_key != NULL)
+    map->destroy_key(slot->key);
+  if (map->destroy_value != NULL)
+    map->destroy_value(slot->value);
+
+  // Backward shift deletion: move the following entries of the cluster one
+  // slot back, instead of leaving a tombstone.
+  size_t pos = slot - map->slots;
+  size_t next = pos + 1 == map->capacity ? 0 : pos + 1;
+  while (map->slots[next].key != NULL && map->slots[next].distance > 0) {
+    map->slots[pos] = map->slots[next];
+    map->slots[pos].distance--;
+
+    pos = next;
+    next = next + 1 == map->capacity ? 0 : next + 1;
+  }
+  map->slots[pos].key = NULL;
+  map->slots[pos].value = NULL;
+
+  map->size--;
+
+  return true;
+}
+
+void *map_find(Map map, void *key) {
+  MapNode node = map_find_node(map, key);
+  return node != MAP_EOF ? node->value : NULL;
+}
+
+MapNode map_find_node(Map map, void *key) {
+  assert(map->hash_function != NULL && key != NULL &&
+         "Expected key and hash function");
+
+  return slot_find(map, key, hash_mix(map->hash_function(key)));
+}
+
+//////////////////////////////// Batches ///////////////////////////////////////
+
+// A batch is pipelined: while key i is looked up, the home slot of key
+// i + 2 * BATCH_DISTANCE is prefetched, and, since the home slot of key
+// i + BATCH_DISTANCE was prefetched BATCH_DISTANCE keys ago, the key stored
+// in it too, if its hash matches. Most lookups then find their key in cache.
+
+/// @brief Keys between the two prefetches of a key, and between the second
+/// prefetch and the lookup.
+///
+#define BATCH_DISTANCE 8
+
+/// @brief Hashes of the keys in flight, indexed by position % BATCH_WINDOW.
+///
+#define BATCH_WINDOW (2 * BATCH_DISTANCE)
+
+/// @brief First prefetch of a batch: the home slot of hash.
+///
+static inline void prefetch_slot(Map map, uint32_t hash) {
+  __builtin_prefetch(&map->slots[hash % map->capacity]);
+}
+
+/// @brief Second prefetch of a batch: the key of the home slot of hash, if
+/// it is probably the key looked up.
+///
+static inline void prefetch_key(Map map, uint32_t hash) {
+  MapNode slot = &map->slots[hash % map->capacity];
+  if (slot->key != NULL && slot->hash == hash)
+    __builtin_prefetch(slot->key);
+}
+
+void map_find_batch(Map map, void **keys, size_t n, void **values) {
+  assert(map->hash_function != NULL && "Expected hash function");
+
+  uint32_t hashes[BATCH_WINDOW];
+  for (size_t i = 0; i < n + BATCH_WINDOW; i++) {
+    // The oldest key first, as the newest one takes its place in hashes.
+    if (i >= BATCH_WINDOW) {
+      size_t k = i - BATCH_WINDOW;
+      MapNode slot = slot_find(map, keys[k], hashes[k % BATCH_WINDOW]);
+      values[k] = slot != MAP_EOF ? slot->value : NULL;
+    }
+
+    if (i >= BATCH_DISTANCE && i - BATCH_DISTANCE < n)
+      prefetch_key(map, hashes[(i - BATCH_DISTANCE) % BATCH_WINDOW]);
+
+    if (i < n) {
+      assert(keys[i] != NULL && "Expected key");
+      hashes[i % BATCH_WINDOW] = hash_mix(map->hash_function(keys[i]));
+      prefetch_slot(map, hashes[i % BATCH_WINDOW]);
+    }
+  }
+}
+
+void map_insert_batch(Map map, void **keys, size_t n, void **values) {
+  assert(map->hash_function != NULL && "Expected hash function");
+
+  // Same pipeline as map_find_batch(). A rehash in the middle of the batch
+  // only makes the prefetches of the keys in flight useless.
+  uint32_t hashes[BATCH_WINDOW];
+  for (size_t i = 0; i < n + BATCH_WINDOW; i++) {
+    if (i >= BATCH_WINDOW) {
+      size_t k = i - BATCH_WINDOW;
+      bool inserted;
+      MapNode slot = slot_find_or_place(map, keys[k], hashes[k % BATCH_WINDOW],
+                                        &inserted);
+      slot_set(map, slot, inserted, keys[k], values[k]);
+    }
+
+    if (i >= BATCH_DISTANCE && i - BATCH_DISTANCE < n)
+      prefetch_key(map, hashes[(i - BATCH_DISTANCE) % BATCH_WINDOW]);
+
+    if (i < n) {
+      assert(keys[i] != NULL && "Expected key");
+      hashes[i % BATCH_WINDOW] = hash_mix(map->hash_function(keys[i]));
+      prefetch_slot(map, hashes[i % BATCH_WINDOW]);
+    }
+  }
+}
+
+void *map_node_key(Map map, MapNode node) { return node->key; }
+
+void *map_node_value(Map map, MapNode node) { return node->value; }
+
+/// @brief Returns the first occupied slot at or after position pos, or
+/// MAP_EOF if there is none.
+///
+static MapNode slot_next_occupied(Map map, size_t pos) {
+  for (; pos < map->capacity; pos++) {
+    if (map->slots[pos].key != NULL)
+      return &map->slots[pos];
+  }
+
+  return MAP_EOF;
+}
+
+MapNode map_first(Map map) { return slot_next_occupied(map, 0); }
+
+MapNode map_next(Map map, MapNode node) {
+  assert(node != NULL);
+  return slot_next_occupied(map, (node - map->slots) + 1);
+}
+
+/// @brief Points iter to the first occupied slot at or after position pos.
+///
+static void iter_seek(Map map, MapIterator *iter, size_t pos) {
+  iter->node = slot_next_occupied(map, pos);
+  iter->position = iter->node != MAP_EOF ? (size_t)(iter->node - map->slots)
+                                         : map->capacity;
+  iter->cursor = NULL;
+}
+
+MapIterator map_iter_begin(Map map) {
+  MapIterator iter;
+  iter_seek(map, &iter, 0);
+  return iter;
+}
+
+bool map_iter_valid(Map map, MapIterator *iter) {
+  return iter->node != MAP_EOF;
+}
+
+void map_iter_next(Map map, MapIterator *iter) {
+  assert(iter->node != MAP_EOF);
+  iter_seek(map, iter, iter->position + 1);
+}
+
+MapNode map_iter_node(Map map, MapIterator *iter) { return iter->node; }
+
+void map_savings(Map map, MapSavings *savings) { *savings = map->savings; }
+
+void map_set_hash_function(Map map, HashFunc func) {
+  map->hash_function = func;
+}
+
+unsigned int hash_string(void *value) {
+  // djb2 hash function, simple, fast, and generally efficient.
+  unsigned int hash = 5381;
+  for (char *s = value; *s != '\0'; s++)
+    hash = (hash << 5) + hash + *s; // hash * 33 + *s
+  return hash;
+}
+
+unsigned int hash_int(void *value) { return *(int *)value; }
+
+unsigned int hash_pointer(void *value) { return (size_t)value; }
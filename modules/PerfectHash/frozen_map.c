@@ -0,0 +1,367 @@
+/// @file frozen_map.c
+///
+/// Implementation of Frozen Map Abstract Data Type using a minimal perfect hash
+/// function, built in the style of PTHash.
+///
+/// The hashes of the keys are split into buckets of LAMBDA hashes on average.
+/// Each bucket gets a pilot, a small number that, mixed with a hash of the
+/// bucket, gives its position in the table. Pilots are searched bucket by
+/// bucket, the largest buckets first, until every hash of the bucket lands on
+/// a free position. The table has slightly more positions than hashes, so that
+/// the last buckets still find free ones; the few hashes that land past the
+/// end are remapped to the positions left free before it.
+///
+/// The result is an array with exactly one slot per distinct hash, and a
+/// lookup hashes the key once and checks one slot. Keys with the same hash,
+/// which no function of the hash can tell apart, share a slot and are compared
+/// one by one.
+
+#include "frozen_map.h"
+
+#include <stdbool.h> // bool
+#include <stdint.h>  // uint16_t, uint32_t, uint64_t
+#include <stdlib.h>  // malloc, calloc, free, qsort
+
+/// @brief Average number of hashes per bucket.
+///
+/// Larger buckets need fewer pilots, but pilots that are harder to find.
+///
+#define LAMBDA 4
+
+/// @brief Hashes per position of the table, before remapping.
+///
+#define ALPHA 0.99
+
+/// @brief Seeds tried before giving up. A seed fails when a bucket finds no
+/// pilot up to UINT16_MAX, which practically never happens.
+///
+#define MAX_SEEDS 64
+
+/// @brief A key and its value.
+///
+struct frozen_entry {
+  void *key;
+  void *value;
+};
+
+/// @brief Slot of a distinct hash.
+///
+struct frozen_slot {
+  uint32_t hash;
+  uint32_t count; // Keys with this hash. Almost always 1.
+  union {
+    struct frozen_entry entry;    // If count is 1.
+    struct frozen_entry *entries; // If count is more than 1.
+  };
+};
+
+struct frozen_map {
+  struct frozen_slot *slots; // One slot per distinct hash.
+  size_t slot_count;
+  size_t size; // Number of keys.
+
+  uint64_t seed;
+  uint16_t *pilots; // One pilot per bucket.
+  size_t bucket_count;
+  size_t table_size; // Positions of the table, before remapping.
+  uint32_t *remap;   // Slot of each position past slot_count.
+
+  struct frozen_entry *shared; // Entries of hashes shared by several keys.
+
+  CompareFunc compare;
+  HashFunc hash;
+};
+
+/// @brief Mixes 64 bits. (Finalizer of splitmix64.)
+///
+static inline uint64_t hash_mix(uint64_t h) {
+  h ^= h >> 30;
+  h *= 0xbf58476d1ce4e5b9;
+  h ^= h >> 27;
+  h *= 0x94d049bb133111eb;
+  h ^= h >> 31;
+  return h;
+}
+
+/// @brief Returns (x / 2^32) * range, an unbiased enough reduction of 32 bits
+/// without a division.
+///
+static inline size_t reduce(uint64_t x, size_t range) {
+  return ((x >> 32) * range) >> 32;
+}
+
+/// @brief Returns the bucket of hash.
+///
+static inline size_t bucket_of(FrozenMap map, uint32_t hash) {
+  return reduce(hash_mix(hash ^ map->seed), map->bucket_count);
+}
+
+/// @brief Returns the mix of a pilot, that moves the positions of its bucket.
+///
+static inline uint64_t pilot_mix(FrozenMap map, uint16_t pilot) {
+  return hash_mix(map->seed ^ ((uint64_t)pilot << 32 | pilot));
+}
+
+/// @brief Returns the position of hash, given the mix of the pilot of its
+/// bucket. Positions are less than table_size.
+///
+static inline size_t position_of(FrozenMap map, uint32_t hash, uint64_t mix) {
+  return reduce(hash_mix(hash ^ mix), map->table_size);
+}
+
+/// @brief Returns the slot of hash.
+///
+static inline size_t slot_of(FrozenMap map, uint32_t hash) {
+  size_t bucket = bucket_of(map, hash);
+  size_t pos = position_of(map, hash, pilot_mix(map, map->pilots[bucket]));
+  return pos < map->slot_count ? pos : map->remap[pos - map->slot_count];
+}
+
+/// @brief Searches the pilots of the distinct hashes, with the current seed of
+/// map, and fills the remap table.
+///
+/// @return true, if every bucket found a pilot, otherwise false.
+///
+static bool pilots_search(FrozenMap map, uint32_t *hashes) {
+  size_t n = map->slot_count;
+  bool found = false;
+
+  // Hashes grouped by bucket, with a counting sort: the hashes of bucket b
+  // are hashes[order[start[b]]], ..., hashes[order[start[b + 1] - 1]].
+  size_t *start = calloc(map->bucket_count + 1, sizeof(*start));
+  size_t *order = malloc(n * sizeof(*order));
+  size_t *buckets = malloc(map->bucket_count * sizeof(*buckets));
+  bool *taken = calloc(map->table_size, sizeof(*taken));
+  if (start == NULL || order == NULL || buckets == NULL || taken == NULL)
+    goto out;
+
+  for (size_t i = 0; i < n; i++)
+    start[bucket_of(map, hashes[i]) + 1]++;
+  size_t max_size = 0;
+  for (size_t b = 0; b < map->bucket_count; b++) {
+    if (start[b + 1] > max_size)
+      max_size = start[b + 1];
+    start[b + 1] += start[b];
+  }
+  size_t *next = malloc(map->bucket_count * sizeof(*next));
+  size_t *positions = malloc(max_size * sizeof(*positions));
+  size_t *by_size = calloc(max_size + 2, sizeof(*by_size));
+  if (next == NULL || positions == NULL || by_size == NULL) {
+    free(next);
+    free(positions);
+    free(by_size);
+    goto out;
+  }
+  for (size_t b = 0; b < map->bucket_count; b++)
+    next[b] = start[b];
+  for (size_t i = 0; i < n; i++)
+    order[next[bucket_of(map, hashes[i])]++] = i;
+
+  // Buckets by decreasing size, with a counting sort too.
+  for (size_t b = 0; b < map->bucket_count; b++)
+    by_size[max_size - (start[b + 1] - start[b]) + 1]++;
+  for (size_t s = 0; s <= max_size; s++)
+    by_size[s + 1] += by_size[s];
+  for (size_t b = 0; b < map->bucket_count; b++)
+    buckets[by_size[max_size - (start[b + 1] - start[b])]++] = b;
+  free(next);
+  free(by_size);
+
+  found = true;
+  for (size_t i = 0; i < map->bucket_count && found; i++) {
+    size_t b = buckets[i];
+    size_t size = start[b + 1] - start[b];
+
+    found = false;
+    for (uint32_t pilot = 0; pilot <= UINT16_MAX && !found; pilot++) {
+      uint64_t mix = pilot_mix(map, pilot);
+
+      // Take the positions of the bucket, undoing them on a collision.
+      size_t taken_count = 0;
+      for (; taken_count < size; taken_count++) {
+        size_t pos =
+            position_of(map, hashes[order[start[b] + taken_count]], mix);
+        if (taken[pos])
+          break;
+        taken[pos] = true;
+        positions[taken_count] = pos;
+      }
+
+      if (taken_count == size) {
+        map->pilots[b] = pilot;
+        found = true;
+      } else {
+        for (size_t j = 0; j < taken_count; j++)
+          taken[positions[j]] = false;
+      }
+    }
+  }
+  free(positions);
+
+  // Positions past the last slot take the slots left free before it. Missing
+  // keys may land on the others, which point at slot 0, whose hash or key
+  // does not match them.
+  if (found) {
+    size_t free_pos = 0;
+    for (size_t pos = n; pos < map->table_size; pos++) {
+      if (!taken[pos]) {
+        map->remap[pos - n] = 0;
+        continue;
+      }
+      while (taken[free_pos])
+        free_pos++;
+      map->remap[pos - n] = free_pos++;
+    }
+  }
+
+out:
+  free(start);
+  free(order);
+  free(buckets);
+  free(taken);
+  return found;
+}
+
+/// @brief An element of the map being frozen.
+///
+struct build_entry {
+  uint32_t hash;
+  struct frozen_entry entry;
+};
+
+static int compare_build_entries(const void *a, const void *b) {
+  uint32_t x = ((const struct build_entry *)a)->hash;
+  uint32_t y = ((const struct build_entry *)b)->hash;
+  return (x > y) - (x < y);
+}
+
+/// @brief Fills the slots of map, once its pilots are found.
+///
+/// @param entries Elements sorted by hash.
+///
+static void slots_fill(FrozenMap map, struct build_entry *entries) {
+  struct frozen_entry *shared = map->shared;
+
+  for (size_t i = 0; i < map->size;) {
+    size_t count = 1;
+    while (i + count < map->size && entries[i + count].hash == entries[i].hash)
+      count++;
+
+    struct frozen_slot *slot = &map->slots[slot_of(map, entries[i].hash)];
+    slot->hash = entries[i].hash;
+    slot->count = count;
+    if (count == 1) {
+      slot->entry = entries[i].entry;
+    } else {
+      slot->entries = shared;
+      for (size_t j = 0; j < count; j++)
+        *shared++ = entries[i + j].entry;
+    }
+
+    i += count;
+  }
+}
+
+FrozenMap frozen_map_build(Map source, CompareFunc compare, HashFunc hash) {
+  FrozenMap map = calloc(1, sizeof(*map));
+  if (map == NULL)
+    return NULL;
+
+  map->compare = compare;
+  map->hash = hash;
+  map->size = map_size(source);
+  if (map->size == 0)
+    return map; // Lookups find no slot to check.
+
+  struct build_entry *entries = malloc(map->size * sizeof(*entries));
+  if (entries == NULL)
+    goto fail;
+
+  // Hash every key once, and group equal hashes.
+  size_t i = 0;
+  for (MapIterator iter = map_iter_begin(source); map_iter_valid(source, &iter);
+       map_iter_next(source, &iter)) {
+    MapNode node = map_iter_node(source, &iter);
+    void *key = map_node_key(source, node);
+    void *value = map_node_value(source, node);
+    entries[i++] = (struct build_entry){hash(key), {key, value}};
+  }
+  qsort(entries, map->size, sizeof(*entries), compare_build_entries);
+
+  size_t shared_count = 0;
+  for (size_t j = 0; j < map->size; j++) {
+    bool first = j == 0 || entries[j].hash != entries[j - 1].hash;
+    bool last = j + 1 == map->size || entries[j].hash != entries[j + 1].hash;
+    map->slot_count += first;
+    shared_count += !(first && last);
+  }
+
+  size_t n = map->slot_count;
+  map->bucket_count = n / LAMBDA + 1;
+  map->table_size = (size_t)(n / ALPHA) + 1;
+
+  uint32_t *hashes = malloc(n * sizeof(*hashes));
+  map->slots = malloc(n * sizeof(*map->slots));
+  map->pilots = calloc(map->bucket_count, sizeof(*map->pilots));
+  map->remap = malloc((map->table_size - n) * sizeof(*map->remap));
+  map->shared = malloc(shared_count * sizeof(*map->shared));
+  if (hashes == NULL || map->slots == NULL || map->pilots == NULL ||
+      map->remap == NULL || (map->shared == NULL && shared_count > 0)) {
+    free(hashes);
+    goto fail;
+  }
+
+  for (size_t j = 0, k = 0; j < map->size; j++) {
+    if (j == 0 || entries[j].hash != entries[j - 1].hash)
+      hashes[k++] = entries[j].hash;
+  }
+
+  bool found = false;
+  for (uint64_t attempt = 0; attempt < MAX_SEEDS && !found; attempt++) {
+    map->seed = hash_mix(attempt + 0x9e3779b97f4a7c15);
+    found = pilots_search(map, hashes);
+  }
+  free(hashes);
+  if (!found)
+    goto fail;
+
+  slots_fill(map, entries);
+  free(entries);
+
+  return map;
+
+fail:
+  free(entries);
+  frozen_map_destroy(map);
+  return NULL;
+}
+
+void frozen_map_destroy(FrozenMap map) {
+  free(map->slots);
+  free(map->pilots);
+  free(map->remap);
+  free(map->shared);
+  free(map);
+}
+
+size_t frozen_map_size(FrozenMap map) { return map->size; }
+
+void *frozen_map_find(FrozenMap map, void *key) {
+  if (map->slot_count == 0)
+    return NULL;
+
+  uint32_t hash = map->hash(key);
+  struct frozen_slot *slot = &map->slots[slot_of(map, hash)];
+  if (slot->hash != hash)
+    return NULL; // Not one of the hashes of the keys.
+
+  if (slot->count == 1)
+    return map->compare(slot->entry.key, key) == 0 ? slot->entry.value : NULL;
+
+  for (uint32_t i = 0; i < slot->count; i++) {
+    if (map->compare(slot->entries[i].key, key) == 0)
+      return slot->entries[i].value;
+  }
+
+  return NULL;
+}
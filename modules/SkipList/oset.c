@@ -2,13 +2,12 @@
 
 #include <assert.h>  // assert
 #include <stdbool.h> // true, false
-#include <stdio.h>   // printf
+#include <stdint.h>  // uint32_t, uint64_t, intptr_t
 #include <stdlib.h>  // malloc, free, sizeof
 #include <string.h>
 #include <time.h> // time
 
-#include "pcg_basic.h" // pcg32_srandom, pcg32_boundedrand
-#include "vector.h"
+#include "pcg_basic.h" // pcg32_random_t, pcg32_srandom_r, pcg32_random_r
 
 /// @brief Levels of forward pointers a node can have.
 ///
@@ -18,6 +17,15 @@
 ///
 #define OSET_LEVELS 16
 
+/// @brief Upper bound of max_level, after it is doubled for 2^16 and 2^32
+/// elements.
+///
+/// Bounds the arrays of nodes that track a path through the levels, which live
+/// on the stack instead of being allocated for each operation, and the forward
+/// links of the header.
+///
+#define OSET_MAX_LEVELS 64
+
 /// @brief Precalculated sizes to used when oset->size needs to be doubled.
 ///
 ///
@@ -44,10 +52,23 @@ struct ordered_set {
   OrderedSetNode last;
 
   OrderedSetNode header;
+
+  pcg32_random_t rng; // Draws the levels of new nodes.
+};
+
+/// @brief Forward link of a node, at one level.
+///
+/// The span of a link is the number of positions from its node to next, where
+/// the header is at position 0, the elements at 1, ..., size, and OSET_EOF at
+/// size + 1. Adding up the spans followed by a search gives the position it
+/// reached, so positions are found in O(log n) like keys.
+///
+struct ordered_set_link {
+  OrderedSetNode next;
+  size_t span;
 };
 
 struct ordered_set_node {
-  OrderedSetNode *forward;
   OrderedSetNode previous;
 
   int levels;     // Number of forward links.
@@ -55,6 +76,8 @@ struct ordered_set_node {
 
   void *key;
   void *value;
+
+  struct ordered_set_link forward[]; // Allocated along with the node.
 };
 
 /// @brief Returns the maximum between two integers.
@@ -76,35 +99,16 @@ static void capacity_increase(OrderedSet oset) {
   }
 }
 
-/// @brief Determines if the Random Number Generator is seeeded.
-///
-/// true, if seeded, otherwise false.
-///
-static bool seeded = false;
-
-/// @brief Seeds the Random Number Generator.
-///
-/// @param initseq Selects the output sequence for the RNG, you can pass any
-/// 64-bit value, although
-///                only the low 63 bits are significant.
-///
-static void random_seed(int initseq) {
-  pcg32_srandom(time(NULL) ^ (intptr_t)&printf, (intptr_t)&initseq);
-  seeded = true;
-}
-
-/// @brief Choose a random level between 1 and max_level.
-///
-/// @param max_level Maximum level in an Ordered Set.
+/// @brief Choose a random level between 1 and max_level, from the Random
+/// Number Generator of oset.
 ///
-static int level_random(int max_level) {
-  int level = 1;
-
-  // "Flip coins". Increase level until tails(0).
-  while (pcg32_boundedrand(2) && level < max_level)
-    level++;
+static int level_random(OrderedSet oset) {
+  // "Flip coins", one per bit of a random word. Increase level until
+  // tails(1), so level is k with probability 1/2^k.
+  uint32_t coins = pcg32_random_r(&oset->rng);
+  int level = coins != 0 ? __builtin_ctz(coins) + 1 : 33;
 
-  return level;
+  return level < oset->max_level ? level : oset->max_level;
 }
 
 /// @brief Creates and returns an Ordered Set node.
@@ -114,16 +118,17 @@ static int level_random(int max_level) {
 ///
 static OrderedSetNode node_create(void *key, void *value, int levels,
                                   bool is_header) {
-  OrderedSetNode node = malloc(sizeof(*node));
+  // Allocate forward array in the same block, so that a traversal reads
+  // the links of a node from the same cache line as its key.
+  OrderedSetNode node =
+      malloc(sizeof(*node) + levels * sizeof(node->forward[0]));
   if (node == NULL) {
     return NULL;
   }
 
-  // Allocate forward array and initialize it to NULL.
-  node->forward = calloc(levels * sizeof(*node->forward), levels);
-  if (node->forward == NULL) {
-    return NULL;
-  }
+  // Link to OSET_EOF, as the last node of an empty set.
+  for (int i = 0; i < levels; i++)
+    node->forward[i] = (struct ordered_set_link){OSET_EOF, 1};
 
   node->levels = levels;
   node->previous = OSET_BOF;
@@ -140,20 +145,8 @@ static OrderedSetNode node_create(void *key, void *value, int levels,
 /// Any operation on the Ordered Set node after its destruction, results in
 /// undefined behaviour.
 ///
-/// @param update Contains nodes whose forward links need to be updated. If
-/// update == NULL,
-///               no link updates take place.
-///
 static void node_destroy(OrderedSetNode node, DestroyFunc destroy_key,
-                         DestroyFunc destroy_value, Vector update) {
-  // Link previous nodes to forward nodes.
-  if (update != NULL) {
-    for (int i = node->levels - 1; i >= 0; i--) {
-      OrderedSetNode prev_node = vector_get_at(update, i);
-      prev_node->forward[i] = node->forward[i];
-    }
-  }
-
+                         DestroyFunc destroy_value) {
   if (node->is_header == false) {
     if (destroy_key != NULL)
       destroy_key(node->key);
@@ -161,43 +154,92 @@ static void node_destroy(OrderedSetNode node, DestroyFunc destroy_key,
       destroy_value(node->value);
   }
 
-  free(node->forward);
   free(node);
 }
 
 /// @brief Finds and returns previous node of node with specified key.
 ///
-/// @param update Tracks the nodes traversed to previous node. If update ==
-/// NULL, traversed nodes
-///               are not tracked.
+/// @param inclusive If true, finds the previous node of the first node with a
+/// key greater than the specified key instead, skipping equal keys.
+/// @param update Tracks the nodes traversed to previous node, one per level
+/// of the header. If update == NULL, traversed nodes are not tracked.
+/// @param positions Tracks the positions of the nodes in update. If
+/// positions == NULL, positions are not tracked.
 ///
 /// @return Previous node of node with specified key.
 ///
 static OrderedSetNode node_find_previous(OrderedSet oset, void *key,
-                                         Vector update) {
+                                         bool inclusive,
+                                         OrderedSetNode *update,
+                                         size_t *positions) {
   assert(key != NULL);
 
   OrderedSetNode node = oset->header;
+  size_t position = 0;
+
+  // Pass keys with compare() < 0, or <= 0 if inclusive.
+  int bound = inclusive ? 1 : 0;
 
   // Traverse levels from top to bottom.
   for (int i = node->levels - 1; i >= 0; i--) {
     // Traverse forward links in level.
-    while (node->forward[i] != OSET_EOF &&
-           oset->compare(node->forward[i]->key, key) < 0) {
-      node = node->forward[i];
+    while (node->forward[i].next != OSET_EOF &&
+           oset->compare(node->forward[i].next->key, key) < bound) {
+      position += node->forward[i].span;
+      node = node->forward[i].next;
     }
 
     // Track traversed nodes.
-    if (update != NULL) {
-      vector_set_at(update, i, node);
-    }
+    if (update != NULL)
+      update[i] = node;
+    if (positions != NULL)
+      positions[i] = position;
   }
 
   return node;
 }
 
+/// @brief Sets the spans of the links of oset from scratch, in one pass over
+/// its elements.
+///
+static void spans_rebuild(OrderedSet oset) {
+  // Last node reached at each level, and its position.
+  OrderedSetNode last[OSET_MAX_LEVELS];
+  size_t last_position[OSET_MAX_LEVELS];
+  for (int i = 0; i < oset->header->levels; i++) {
+    last[i] = oset->header;
+    last_position[i] = 0;
+  }
+
+  size_t position = 1;
+  for (OrderedSetNode node = oset->header->forward[0].next; node != OSET_EOF;
+       node = node->forward[0].next, position++) {
+    for (int i = 0; i < node->levels; i++) {
+      last[i]->forward[i].span = position - last_position[i];
+      last[i] = node;
+      last_position[i] = position;
+    }
+  }
+
+  for (int i = 0; i < oset->header->levels; i++)
+    last[i]->forward[i].span = oset->size + 1 - last_position[i];
+}
+
 OrderedSet oset_create(CompareFunc compare, DestroyFunc destroy_key,
                        DestroyFunc destroy_value) {
+  OrderedSet oset =
+      oset_create_with_seed(compare, destroy_key, destroy_value, 0);
+
+  // Reseed from the time, and select the sequence of the generator from the
+  // address of the set, so that sets alive at the same time never share one.
+  if (oset != NULL)
+    pcg32_srandom_r(&oset->rng, time(NULL) ^ (intptr_t)oset, (intptr_t)oset);
+
+  return oset;
+}
+
+OrderedSet oset_create_with_seed(CompareFunc compare, DestroyFunc destroy_key,
+                                 DestroyFunc destroy_value, uint64_t seed) {
   OrderedSet oset = malloc(sizeof(*oset));
   if (oset == NULL)
     return NULL;
@@ -213,16 +255,15 @@ OrderedSet oset_create(CompareFunc compare, DestroyFunc destroy_key,
   oset->first = OSET_EOF;
   oset->last = OSET_EOF;
 
-  // Header nodes don't need to have neither keys nor values.
-  oset->header = node_create(OSET_BOF, OSET_BOF, oset->max_level, true);
+  // Header nodes don't need to have neither keys nor values. Allocate all the
+  // levels max_level can grow to, so that the header is never reallocated,
+  // but start at level 1.
+  oset->header = node_create(OSET_BOF, OSET_BOF, OSET_MAX_LEVELS, true);
   if (oset->header == NULL)
     return NULL;
-  oset->header->levels =
-      1; // Allocate all levels up to max_level, but start at level 1.
+  oset->header->levels = 1;
 
-  // Seed Pseudo Random Number Generator, if not yet seeded.
-  if (seeded == false)
-    random_seed(oset->max_level);
+  pcg32_srandom_r(&oset->rng, seed, 0);
 
   return oset;
 }
@@ -231,9 +272,9 @@ void oset_destroy(OrderedSet oset) {
   OrderedSetNode node = oset->header;
 
   while (node != OSET_EOF) {
-    OrderedSetNode next = node->forward[0];
+    OrderedSetNode next = node->forward[0].next;
 
-    node_destroy(node, oset->destroy_key, oset->destroy_value, NULL);
+    node_destroy(node, oset->destroy_key, oset->destroy_value);
 
     node = next;
   }
@@ -264,32 +305,40 @@ void oset_insert(OrderedSet oset, void *key, void *value) {
     oset->max_level *= 2;
   }
 
-  OrderedSetNode new_node =
-      node_create(key, value, level_random(oset->max_level), false);
+  OrderedSetNode new_node = node_create(key, value, level_random(oset), false);
 
-  // Increase header levels if needed.
-  if (oset->header->levels < new_node->levels)
-    oset->header->levels = new_node->levels;
+  // Increase header levels if needed. New levels link to OSET_EOF.
+  for (int i = oset->header->levels; i < new_node->levels; i++)
+    oset->header->forward[i] =
+        (struct ordered_set_link){OSET_EOF, oset->size + 1};
+  oset->header->levels = max(oset->header->levels, new_node->levels);
 
-  Vector update = vector_create(oset->max_level, NULL);
+  OrderedSetNode update[OSET_MAX_LEVELS];
+  size_t positions[OSET_MAX_LEVELS];
+  OrderedSetNode target =
+      node_find_previous(oset, key, false, update, positions);
 
-  OrderedSetNode target = node_find_previous(oset, key, update);
-
-  // Insert new_node after node.
+  // Insert new_node after node, at position positions[0] + 1.
   for (int i = new_node->levels - 1; i >= 0; i--) {
-    OrderedSetNode node = vector_get_at(update, i);
-    new_node->forward[i] = node->forward[i];
-    node->forward[i] = new_node;
+    size_t before = positions[0] - positions[i]; // From update[i] to target.
+    new_node->forward[i].next = update[i]->forward[i].next;
+    new_node->forward[i].span = update[i]->forward[i].span - before;
+    update[i]->forward[i].next = new_node;
+    update[i]->forward[i].span = before + 1;
   }
 
+  // Higher links now pass over new_node.
+  for (int i = new_node->levels; i < oset->header->levels; i++)
+    update[i]->forward[i].span++;
+
   // Update previous pointers.
   new_node->previous = target;
-  if (new_node->forward[0] != OSET_EOF)
-    new_node->forward[0]->previous = new_node;
+  if (new_node->forward[0].next != OSET_EOF)
+    new_node->forward[0].next->previous = new_node;
 
   // Update first pointer.
   if (oset->first == OSET_EOF ||
-      oset->compare(new_node->key, oset->first->key) < 0) {
+      oset->compare(new_node->key, oset->first->key) <= 0) {
     oset->first = new_node;
   }
 
@@ -301,46 +350,47 @@ void oset_insert(OrderedSet oset, void *key, void *value) {
 
   // Update size.
   oset->size++;
-
-  // Free memory allocated for the vector.
-  vector_destroy(update);
 }
 
 bool oset_remove(OrderedSet oset, void *key) {
   assert(key != NULL);
 
-  Vector update = vector_create(oset->max_level, NULL);
-
-  OrderedSetNode target = node_find_previous(oset, key, update);
-  if (target->forward[0] == OSET_EOF ||
-      oset->compare(target->forward[0]->key, key) != 0) {
-    // Free memory allocated for the vector.
-    vector_destroy(update);
-
+  OrderedSetNode update[OSET_MAX_LEVELS];
+  OrderedSetNode target = node_find_previous(oset, key, false, update, NULL);
+  if (target->forward[0].next == OSET_EOF ||
+      oset->compare(target->forward[0].next->key, key) != 0) {
     // Specified key was not found.
     return false;
   }
 
   // Update first pointer.
-  if (target->forward[0] == oset->first) {
-    oset->first = oset->first->forward[0];
+  if (target->forward[0].next == oset->first) {
+    oset->first = oset->first->forward[0].next;
   }
 
   // Update last pointer.
-  if (target->forward[0] == oset->last) {
+  if (target->forward[0].next == oset->last) {
     oset->last = target->is_header ? OSET_BOF : target;
   }
 
+  // Link previous nodes to forward nodes, over the node being removed.
+  OrderedSetNode node = target->forward[0].next;
+  if (node->forward[0].next != OSET_EOF)
+    node->forward[0].next->previous = target;
+  for (int i = oset->header->levels - 1; i >= 0; i--) {
+    if (update[i]->forward[i].next == node) {
+      update[i]->forward[i].next = node->forward[i].next;
+      update[i]->forward[i].span += node->forward[i].span;
+    }
+    update[i]->forward[i].span--;
+  }
+
   // Destroy node including its top levels.
-  node_destroy(target->forward[0], oset->destroy_key, oset->destroy_value,
-               update);
+  node_destroy(node, oset->destroy_key, oset->destroy_value);
 
   // Update size.
   oset->size--;
 
-  // Free memory allocated for the vector.
-  vector_destroy(update);
-
   return true;
 }
 
@@ -354,70 +404,76 @@ OrderedSet oset_split(OrderedSet oset, void *split_key) {
   if (oset->size == 0)
     return NULL;
 
+  // Seeded from oset, so that splitting a seeded set is reproducible too.
   OrderedSet split =
-      oset_create(oset->compare, oset->destroy_key, oset->destroy_value);
+      oset_create_with_seed(oset->compare, oset->destroy_key,
+                            oset->destroy_value, pcg32_random_r(&oset->rng));
   if (split == NULL)
     return NULL;
 
   // Initialize split Ordered Set from oset metadata.
-  if (split->max_level < oset->max_level) {
-    split->max_level = oset->max_level; // Update max_level of split.
-    // Reallocate and initialize to NULL the forward array of split header node.
-    free(split->header->forward);
-    split->header->forward = calloc(
-        split->max_level * sizeof(*split->header->forward), split->max_level);
-    if (split->header->forward == NULL)
-      return NULL;
-  }
+  split->max_level = oset->max_level;
   split->header->levels = oset->header->levels;
 
   OrderedSetNode node = oset->header;
+  size_t position = 0;
 
-  // Traverse levels from top to bottom.
+  // Traverse levels from top to bottom. At the bottom, position is the
+  // number of elements that stay in OSET.
+  OrderedSetNode update[OSET_MAX_LEVELS];
+  size_t positions[OSET_MAX_LEVELS];
   for (int i = node->levels - 1; i >= 0; i--) {
     // Traverse forward links in level.
-    while (node->forward[i] != OSET_EOF &&
-           oset->compare(node->forward[i]->key, split_key) <= 0) {
-      node = node->forward[i];
+    while (node->forward[i].next != OSET_EOF &&
+           oset->compare(node->forward[i].next->key, split_key) <= 0) {
+      position += node->forward[i].span;
+      node = node->forward[i].next;
     }
-    split->header->forward[i] = node->forward[i];
-    node->forward[i] = OSET_EOF;
+    update[i] = node;
+    positions[i] = position;
+  }
+
+  // Update sizes.
+  split->size = oset->size - position;
+  oset->size = position;
+
+  // Cut the links at each level. Positions in SPLIT start after the elements
+  // that stay in OSET.
+  for (int i = oset->header->levels - 1; i >= 0; i--) {
+    struct ordered_set_link *link = &update[i]->forward[i];
+    split->header->forward[i] = (struct ordered_set_link){
+        link->next, positions[i] + link->span - oset->size};
+    *link = (struct ordered_set_link){OSET_EOF, oset->size + 1 - positions[i]};
   }
 
   // Update SPLIT previous pointers.
-  if (split->header->forward[0] != OSET_EOF)
-    split->header->forward[0]->previous = split->header;
+  if (split->header->forward[0].next != OSET_EOF)
+    split->header->forward[0].next->previous = split->header;
 
   // Update first and last pointers of SPLIT.
-  split->first = split->header->forward[0];
+  split->first = split->header->forward[0].next;
   if (split->first != OSET_EOF)
     split->last = oset->last; // Atleast one element is in SPLIT.
 
   // Update first and last pointers of OSET.
   if (oset->first == split->first)
     oset->first = OSET_EOF;
-  oset->last = node;
+  oset->last = node->is_header ? OSET_EOF : node;
 
   // Decrease excess levels of original Ordered Set.
   node = oset->header;
-  while (node->forward[node->levels - 1] == OSET_EOF && node->levels - 1 > 0) {
+  while (node->forward[node->levels - 1].next == OSET_EOF &&
+         node->levels - 1 > 0) {
     node->levels--;
   }
 
   // Decrease excess levels of split Ordered Set.
   node = split->header;
-  while (node->forward[node->levels - 1] == OSET_EOF && node->levels - 1 > 0) {
+  while (node->forward[node->levels - 1].next == OSET_EOF &&
+         node->levels - 1 > 0) {
     node->levels--;
   }
 
-  // Update sizes.
-  size_t size = 0;
-  for (node = split->header->forward[0]; node != OSET_EOF;
-       node = node->forward[0])
-    size++;
-  split->size = size;
-  oset->size -= split->size;
-
   return split;
 }
 
@@ -425,39 +481,29 @@ OrderedSet oset_merge(OrderedSet a, OrderedSet b) {
   assert(a != b);
 
   // Hold the last nodes on each level of MERGED.
-  Vector last_nodes = vector_create(max(a->max_level, b->max_level), NULL);
+  OrderedSetNode last_nodes[OSET_MAX_LEVELS];
 
   // Create new Ordered Set.
-  OrderedSet merged = oset_create(a->compare, a->destroy_key, a->destroy_value);
-  if (a == NULL)
+  OrderedSet merged = oset_create_with_seed(a->compare, a->destroy_key,
+                                            a->destroy_value,
+                                            pcg32_random_r(&a->rng));
+  if (merged == NULL)
     return NULL;
 
   // Initialize new Ordered Set.
-  if (merged->max_level < max(a->max_level, b->max_level)) {
-    // Update max_level to reallocate the header node.
-    merged->max_level = max(a->max_level, b->max_level);
-
-    // Reallocate and initialize to NULL the forward array of MERGED header
-    // node.
-    free(merged->header->forward);
-    merged->header->forward =
-        calloc(merged->max_level * sizeof(*merged->header->forward),
-               merged->max_level);
-    if (merged->header->forward == NULL)
-      return NULL;
-  }
+  merged->max_level = max(a->max_level, b->max_level);
   merged->capacity = a->capacity > b->capacity ? a->capacity : b->capacity;
   merged->header->levels = max(a->header->levels, b->header->levels);
 
-  // Initialize last_nodes vector.
+  // Initialize last_nodes.
   for (int i = 0; i < merged->header->levels; i++)
-    vector_set_at(last_nodes, i, merged->header);
+    last_nodes[i] = merged->header;
 
   // Transfer nodes from A and B to MERGED.
-  while (a->header->forward[0] != OSET_EOF &&
-         b->header->forward[0] != OSET_EOF) {
-    void *key1 = a->header->forward[0]->key;
-    void *key2 = b->header->forward[0]->key;
+  while (a->header->forward[0].next != OSET_EOF &&
+         b->header->forward[0].next != OSET_EOF) {
+    void *key1 = a->header->forward[0].next->key;
+    void *key2 = b->header->forward[0].next->key;
 
     if (merged->compare(key1, key2) > 0) {
       // Exchange, key1 and key2, and Ordered Sets A and B.
@@ -474,63 +520,63 @@ OrderedSet oset_merge(OrderedSet a, OrderedSet b) {
     // Add elements to MERGED from A with keys <= key2.
     int lvl = 0;
     do {
-      OrderedSetNode node = vector_get_at(last_nodes, lvl);
-      node->forward[lvl] = a->header->forward[lvl];
-      if (lvl == 0 && node->forward[0] != OSET_EOF)
-        node->forward[0]->previous = node;
+      OrderedSetNode node = last_nodes[lvl];
+      node->forward[lvl].next = a->header->forward[lvl].next;
+      if (lvl == 0 && node->forward[0].next != OSET_EOF)
+        node->forward[0].next->previous = node;
       lvl++;
     } while (lvl < merged->header->levels &&
-             a->header->forward[lvl] != OSET_EOF &&
-             merged->compare(a->header->forward[lvl]->key, key2) < 0);
+             a->header->forward[lvl].next != OSET_EOF &&
+             merged->compare(a->header->forward[lvl].next->key, key2) <= 0);
     lvl--;
 
     // For each level attached to MERGED, find endpoint at that level and remove
     // it from A.
-    OrderedSetNode node = a->header->forward[lvl];
+    OrderedSetNode node = a->header->forward[lvl].next;
     for (int i = lvl; i >= 0; i--) {
-      while (node->forward[i] != OSET_EOF &&
-             merged->compare(node->forward[i]->key, key2) <= 0) {
-        node = node->forward[i];
+      while (node->forward[i].next != OSET_EOF &&
+             merged->compare(node->forward[i].next->key, key2) <= 0) {
+        node = node->forward[i].next;
       }
-      vector_set_at(last_nodes, i, node);
-      a->header->forward[i] = node->forward[i];
-      if (i == 0 && node->forward[i] != OSET_EOF) {
-        node->forward[i]->previous = a->header;
+      last_nodes[i] = node;
+      a->header->forward[i].next = node->forward[i].next;
+      if (i == 0 && node->forward[i].next != OSET_EOF) {
+        node->forward[i].next->previous = a->header;
       }
     }
   }
 
   // Connect left over nodes to MERGED.
-  OrderedSet left_over = b->header->forward[0] == OSET_EOF ? a : b;
+  OrderedSet left_over = b->header->forward[0].next == OSET_EOF ? a : b;
   for (int i = 0; i < left_over->header->levels; i++) {
-    OrderedSetNode node = vector_get_at(last_nodes, i);
-    node->forward[i] = left_over->header->forward[i];
-    if (i == 0 && node->forward[i] != OSET_EOF) {
-      node->forward[i]->previous = node;
+    OrderedSetNode node = last_nodes[i];
+    node->forward[i].next = left_over->header->forward[i].next;
+    if (i == 0 && node->forward[i].next != OSET_EOF) {
+      node->forward[i].next->previous = node;
     }
 
     // Traverse remaining nodes to find last node.
-    while (node->forward[i] != OSET_EOF) {
-      node = node->forward[i];
+    while (node->forward[i].next != OSET_EOF) {
+      node = node->forward[i].next;
     }
-    vector_set_at(last_nodes, i, node);
+    last_nodes[i] = node;
 
     // Disconnect B header from left over nodes.
-    b->header->forward[i] = OSET_EOF;
+    b->header->forward[i].next = OSET_EOF;
   }
 
   // Update first pointer.
-  merged->first = merged->header->forward[0];
+  merged->first = merged->header->forward[0].next;
 
   // Update last pointer.
-  merged->last = vector_get_at(last_nodes, 0);
+  merged->last = last_nodes[0];
 
-  // Update size.
+  // Update size, and the spans of the nodes that were interleaved.
   merged->size = a->size + b->size;
+  spans_rebuild(merged);
 
   oset_destroy(a);
   oset_destroy(b);
-  vector_destroy(last_nodes);
 
   return merged;
 }
@@ -538,41 +584,45 @@ OrderedSet oset_merge(OrderedSet a, OrderedSet b) {
 void oset_concat(OrderedSet a, OrderedSet b) {
   assert(a != b);
 
-  // Increase levels of  a  Ordered Set if needed.
-  if (a->header->levels < b->header->levels) {
-    for (int i = a->header->levels; i < b->header->levels; i++) {
-      a->header->forward[i] = OSET_EOF;
-    }
-
-    a->header->levels = b->header->levels;
-  }
+  // Increase levels of  a  Ordered Set if needed. New levels link to OSET_EOF.
+  for (int i = a->header->levels; i < b->header->levels; i++)
+    a->header->forward[i] = (struct ordered_set_link){OSET_EOF, a->size + 1};
+  a->header->levels = max(a->header->levels, b->header->levels);
 
   OrderedSetNode node = a->header;
+  size_t position = 0;
   // Traverse levels from top to bottom.
   for (int i = node->levels - 1; i >= 0; i--) {
     // Traverse forward links in level.
-    while (node->forward[i] != OSET_EOF)
-      node = node->forward[i];
-
-    if (i <= b->header->levels) {
-      node->forward[i] = b->header->forward[i];
+    while (node->forward[i].next != OSET_EOF) {
+      position += node->forward[i].span;
+      node = node->forward[i].next;
     }
+
+    // Link the last node of A at this level to the first node of B at it.
+    struct ordered_set_link link = {OSET_EOF, b->size + 1};
+    if (i < b->header->levels)
+      link = b->header->forward[i];
+    node->forward[i] = (struct ordered_set_link){
+        link.next, a->size - position + link.span};
   }
 
   // Connect previous pointer of first node of B to last node of A to be able to
-  // traverse A in descending order.
-  if (b->first != NULL)
-    b->first->previous = a->last;
-
-  // Update last pointer.
-  a->last = b->last;
+  // traverse A in descending order. Update first and last pointers, if B is
+  // not empty.
+  if (b->first != OSET_EOF) {
+    b->first->previous = a->last != OSET_EOF ? a->last : a->header;
+    if (a->first == OSET_EOF)
+      a->first = b->first;
+    a->last = b->last;
+  }
 
   // Update size.
   a->size += b->size;
 
   // Destroy  b  Ordered Set.
-  for (int i = b->header->levels; i >= 0; i--)
-    b->header->forward[i] = OSET_EOF;
+  for (int i = b->header->levels - 1; i >= 0; i--)
+    b->header->forward[i].next = OSET_EOF;
   oset_set_destroy_key(b, NULL);
   oset_set_destroy_value(b, NULL);
   oset_destroy(b);
@@ -581,16 +631,85 @@ void oset_concat(OrderedSet a, OrderedSet b) {
 OrderedSetNode oset_find_node(OrderedSet oset, void *key) {
   assert(key != NULL);
 
-  OrderedSetNode node = node_find_previous(oset, key, NULL);
+  OrderedSetNode node = node_find_previous(oset, key, false, NULL, NULL);
 
-  if (node->forward[0] != OSET_EOF &&
-      oset->compare(node->forward[0]->key, key) == 0) {
-    return node->forward[0];
+  if (node->forward[0].next != OSET_EOF &&
+      oset->compare(node->forward[0].next->key, key) == 0) {
+    return node->forward[0].next;
   }
 
   return OSET_EOF;
 }
 
+OrderedSetNode oset_get_at(OrderedSet oset, size_t index) {
+  if (index >= oset->size)
+    return OSET_EOF;
+
+  OrderedSetNode node = oset->header;
+  size_t position = 0;
+
+  // Traverse levels from top to bottom, without passing position index + 1.
+  for (int i = node->levels - 1; i >= 0; i--) {
+    while (node->forward[i].next != OSET_EOF &&
+           position + node->forward[i].span <= index + 1) {
+      position += node->forward[i].span;
+      node = node->forward[i].next;
+    }
+  }
+
+  return node;
+}
+
+size_t oset_rank(OrderedSet oset, void *key) {
+  size_t positions[OSET_MAX_LEVELS];
+  node_find_previous(oset, key, false, NULL, positions);
+  return positions[0];
+}
+
+size_t oset_count_range(OrderedSet oset, void *lo, void *hi) {
+  assert(lo != NULL && hi != NULL);
+
+  if (oset->compare(lo, hi) > 0)
+    return 0;
+
+  size_t first[OSET_MAX_LEVELS], last[OSET_MAX_LEVELS];
+  node_find_previous(oset, lo, false, NULL, first);
+  node_find_previous(oset, hi, true, NULL, last);
+
+  return last[0] - first[0];
+}
+
+OrderedSetNode oset_lower_bound(OrderedSet oset, void *key) {
+  return node_find_previous(oset, key, false, NULL, NULL)->forward[0].next;
+}
+
+OrderedSetNode oset_upper_bound(OrderedSet oset, void *key) {
+  return node_find_previous(oset, key, true, NULL, NULL)->forward[0].next;
+}
+
+size_t oset_range(OrderedSet oset, void *lo, void *hi,
+                  OrderedSetRangeFunc callback, void *context) {
+  assert(lo != NULL && hi != NULL);
+
+  if (oset->compare(lo, hi) > 0)
+    return 0;
+
+  // The positions of both ends tell how many nodes to visit, so the nodes in
+  // between are not compared to hi.
+  size_t first[OSET_MAX_LEVELS], last[OSET_MAX_LEVELS];
+  OrderedSetNode node =
+      node_find_previous(oset, lo, false, NULL, first)->forward[0].next;
+  node_find_previous(oset, hi, true, NULL, last);
+
+  size_t count = last[0] - first[0];
+  for (size_t i = 0; i < count; i++) {
+    callback(node->key, node->value, context);
+    node = node->forward[0].next;
+  }
+
+  return count;
+}
+
 void *oset_node_key(OrderedSet oset, OrderedSetNode node) {
   assert(node != NULL);
   return node->key;
@@ -607,7 +726,7 @@ OrderedSetNode oset_last(OrderedSet oset) { return oset->last; }
 
 OrderedSetNode oset_next(OrderedSet oset, OrderedSetNode node) {
   assert(node != NULL);
-  return node->forward[0];
+  return node->forward[0].next;
 }
 
 OrderedSetNode oset_previous(OrderedSet oset, OrderedSetNode node) {
@@ -0,0 +1,671 @@
+/// @file map.c
+///
+/// Implementation of Map Abstract Data Type using a "Swiss table".
+///
+/// Next to the slot array, the table keeps a separate array of control bytes,
+/// one per slot. A control byte is either EMPTY, DELETED, or, for an occupied
+/// slot, a 7-bit tag taken from the hash of its key. Slots are probed in groups
+/// of 16: the 16 control bytes of a group are compared against the tag at once,
+/// with SSE2 when available or with a scalar fallback otherwise, and
+/// compare is called only for the slots whose tag matched.
+///
+/// Define MAP_NO_SIMD to force the scalar fallback.
+///
+/// @note A MapNode points inside the slot array, so it is invalidated by
+/// map_insert() and map_remove().
+
+#include "map.h"
+
+#include <assert.h>  // assert
+#include <stdbool.h> // bool
+#include <stdint.h>  // uint16_t, uint32_t, int8_t
+#include <stdlib.h>  // malloc, free, size_t
+#include <string.h>  // memset
+
+#if defined(__SSE2__) && !defined(MAP_NO_SIMD)
+#include <emmintrin.h> // _mm_*
+#define MAP_SSE2
+#endif
+
+/// Number of slots probed at once.
+#define GROUP_WIDTH 16
+
+/// Control byte of a slot that was never used. Ends a probe sequence.
+#define CTRL_EMPTY ((int8_t)-128)
+
+/// Control byte of a slot whose entry was removed. Does not end a probe
+/// sequence.
+#define CTRL_DELETED ((int8_t)-2)
+
+/// Initial number of slots. Capacity is always a power of two multiple of
+/// GROUP_WIDTH, so that groups can be selected with a mask.
+#define MIN_CAPACITY GROUP_WIDTH
+
+/// The table grows when 7/8 of its slots are used, by entries or tombstones.
+#define MAX_LOAD(capacity) ((capacity) - (capacity) / 8)
+
+struct map_node {
+  void *key;
+  void *value;
+  unsigned int hash; // Hash of key, as returned by hash_function.
+};
+
+struct map {
+  int8_t *ctrl;    // capacity control bytes, one for each slot.
+  MapNode slots;   // capacity slots.
+  size_t capacity; // Number of slots.
+  size_t size;     // Number of entries.
+  size_t growth_left; // Number of EMPTY slots that can be used before the
+                      // table has to grow.
+
+  CompareFunc compare;
+  HashFunc hash_function;
+  DestroyFunc destroy_key;
+  DestroyFunc destroy_value;
+
+  MapSavings savings; // Calls of hash_function and compare avoided, thanks to
+                      // the control bytes and the stored hashes.
+};
+
+/// @brief Mixes the bits of a user provided hash.
+///
+/// Tags and group indices are taken from different bits of the hash, so every
+/// bit has to depend on every bit of the key's hash, even for weak hash
+/// functions like hash_int. (Finalizer of MurmurHash3.)
+///
+static uint32_t hash_mix(unsigned int hash) {
+  uint32_t h = hash;
+  h ^= h >> 16;
+  h *= 0x85ebca6b;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35;
+  h ^= h >> 16;
+  return h;
+}
+
+/// @brief Tag stored in the control byte of an occupied slot. (Lower 7 bits.)
+///
+static int8_t hash_tag(uint32_t h) { return (int8_t)(h & 0x7F); }
+
+/// @brief Index of the first group of the probe sequence. (Upper bits.)
+///
+static size_t hash_group(Map map, uint32_t h) {
+  return (h >> 7) & (map->capacity / GROUP_WIDTH - 1);
+}
+
+///////////////////////////// Group operations /////////////////////////////////
+
+// Each operation returns a bitmask with bit i set if control byte i of the
+// group satisfies the condition.
+
+#ifdef MAP_SSE2
+
+/// @brief Slots of group whose control byte equals tag.
+///
+static uint32_t group_match(const int8_t *group, int8_t tag) {
+  __m128i ctrl = _mm_loadu_si128((const __m128i *)group);
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(tag), ctrl));
+}
+
+/// @brief Slots of group that are EMPTY.
+///
+static uint32_t group_match_empty(const int8_t *group) {
+  return group_match(group, CTRL_EMPTY);
+}
+
+/// @brief Slots of group that are EMPTY or DELETED. (High bit set.)
+///
+static uint32_t group_match_empty_or_deleted(const int8_t *group) {
+  __m128i ctrl = _mm_loadu_si128((const __m128i *)group);
+  return _mm_movemask_epi8(ctrl);
+}
+
+#else // Scalar fallback.
+
+static uint32_t group_match(const int8_t *group, int8_t tag) {
+  uint32_t mask = 0;
+  for (int i = 0; i < GROUP_WIDTH; i++)
+    mask |= (uint32_t)(group[i] == tag) << i;
+  return mask;
+}
+
+static uint32_t group_match_empty(const int8_t *group) {
+  return group_match(group, CTRL_EMPTY);
+}
+
+static uint32_t group_match_empty_or_deleted(const int8_t *group) {
+  uint32_t mask = 0;
+  for (int i = 0; i < GROUP_WIDTH; i++)
+    mask |= (uint32_t)(group[i] < 0) << i;
+  return mask;
+}
+
+#endif // MAP_SSE2
+
+/// @brief Index of the lowest set bit of a non zero mask.
+///
+static int mask_first(uint32_t mask) { return __builtin_ctz(mask); }
+
+////////////////////////////////////////////////////////////////////////////////
+
+/// @brief Allocates capacity empty slots for map.
+///
+/// @return true, if the allocation succeeded, otherwise false.
+///
+static bool table_allocate(Map map, size_t capacity) {
+  int8_t *ctrl = malloc(capacity * sizeof(*ctrl));
+  MapNode slots = malloc(capacity * sizeof(*slots));
+  if (ctrl == NULL || slots == NULL) {
+    free(ctrl);
+    free(slots);
+    return false;
+  }
+  memset(ctrl, CTRL_EMPTY, capacity * sizeof(*ctrl));
+
+  map->ctrl = ctrl;
+  map->slots = slots;
+  map->capacity = capacity;
+  map->growth_left = MAX_LOAD(capacity) - map->size;
+
+  return true;
+}
+
+/// @brief Returns the position of the first EMPTY or DELETED slot in the probe
+/// sequence of h.
+///
+static size_t slot_find_free(Map map, uint32_t h) {
+  size_t group_mask = map->capacity / GROUP_WIDTH - 1;
+  size_t group = hash_group(map, h);
+
+  // Triangular probing visits every group when their number is a power of two.
+  for (size_t step = 1;; step++) {
+    uint32_t mask =
+        group_match_empty_or_deleted(&map->ctrl[group * GROUP_WIDTH]);
+    if (mask != 0)
+      return group * GROUP_WIDTH + mask_first(mask);
+
+    group = (group + step) & group_mask;
+  }
+}
+
+/// @brief Rebuilds the table with new_capacity slots, dropping tombstones.
+///
+/// Uses the stored hashes, so hash_function is not called.
+///
+/// @return true, if the table was rebuilt, otherwise false (out of memory) and
+/// the old table is kept.
+///
+static bool resize(Map map, size_t new_capacity) {
+  int8_t *old_ctrl = map->ctrl;
+  MapNode old_slots = map->slots;
+  size_t old_capacity = map->capacity;
+
+  if (!table_allocate(map, new_capacity))
+    return false;
+
+  for (size_t i = 0; i < old_capacity; i++) {
+    if (old_ctrl[i] >= 0) {
+      uint32_t h = hash_mix(old_slots[i].hash);
+      size_t pos = slot_find_free(map, h);
+      map->ctrl[pos] = hash_tag(h);
+      map->slots[pos] = old_slots[i];
+      map->savings.hash_calls++;
+    }
+  }
+
+  free(old_ctrl);
+  free(old_slots);
+  return true;
+}
+
+/// @brief Adds n to a counter of the map's savings.
+///
+/// Lookups may run concurrently (see map_find()), so the counter is read and
+/// written atomically, to not cause a data race. It is not incremented
+/// atomically, which would slow lookups down: concurrent additions may be lost.
+///
+static inline void savings_add(size_t *counter, size_t n) {
+  size_t value = __atomic_load_n(counter, __ATOMIC_RELAXED);
+  __atomic_store_n(counter, value + n, __ATOMIC_RELAXED);
+}
+
+/// @brief Returns the slot holding key, or MAP_EOF if key is not part of the
+/// map.
+///
+static MapNode slot_find(Map map, void *key, unsigned int hash) {
+  uint32_t h = hash_mix(hash);
+  int8_t tag = hash_tag(h);
+  size_t group_mask = map->capacity / GROUP_WIDTH - 1;
+  size_t group = hash_group(map, h);
+
+  for (size_t step = 1;; step++) {
+    const int8_t *ctrl = &map->ctrl[group * GROUP_WIDTH];
+    uint32_t match = group_match(ctrl, tag);
+
+    // Occupied slots of the group whose tag does not match are not compared.
+    uint32_t occupied = ~group_match_empty_or_deleted(ctrl) & 0xFFFF;
+    savings_add(&map->savings.compare_calls,
+                __builtin_popcount(occupied & ~match));
+
+    // Call compare only for the slots with a matching tag.
+    for (uint32_t mask = match; mask != 0; mask &= mask - 1) {
+      MapNode slot = &map->slots[group * GROUP_WIDTH + mask_first(mask)];
+      if (slot->hash != hash)
+        savings_add(&map->savings.compare_calls, 1);
+      else if (map->compare(slot->key, key) == 0)
+        return slot;
+    }
+
+    // An EMPTY slot means that key would have been placed in this group.
+    if (group_match_empty(ctrl) != 0)
+      return MAP_EOF;
+
+    group = (group + step) & group_mask;
+  }
+}
+
+/// @brief Returns the smallest capacity that holds size entries within
+/// MAX_LOAD.
+///
+static size_t capacity_for(size_t size) {
+  size_t capacity = MIN_CAPACITY;
+  while (MAX_LOAD(capacity) < size)
+    capacity *= 2;
+  return capacity;
+}
+
+Map map_create(CompareFunc compare, DestroyFunc destroy_key,
+               DestroyFunc destroy_value) {
+  return map_create_with_capacity(compare, destroy_key, destroy_value, 0);
+}
+
+Map map_create_with_capacity(CompareFunc compare, DestroyFunc destroy_key,
+                             DestroyFunc destroy_value, size_t expected) {
+  Map map = malloc(sizeof(*map));
+  if (map == NULL)
+    return NULL;
+
+  map->size = 0;
+  if (!table_allocate(map, capacity_for(expected))) {
+    free(map);
+    return NULL;
+  }
+
+  map->compare = compare;
+  map->hash_function = NULL;
+  map->destroy_key = destroy_key;
+  map->destroy_value = destroy_value;
+
+  map->savings.hash_calls = 0;
+  map->savings.compare_calls = 0;
+
+  return map;
+}
+
+void map_destroy(Map map) {
+  for (size_t i = 0; i < map->capacity; i++) {
+    if (map->ctrl[i] >= 0) {
+      if (map->destroy_key != NULL)
+        map->destroy_key(map->slots[i].key);
+      if (map->destroy_value != NULL)
+        map->destroy_value(map->slots[i].value);
+    }
+  }
+
+  free(map->ctrl);
+  free(map->slots);
+  free(map);
+}
+
+DestroyFunc map_set_destroy_key(Map map, DestroyFunc destroy_key) {
+  DestroyFunc old = map->destroy_key;
+  map->destroy_key = destroy_key;
+  return old;
+}
+
+DestroyFunc map_set_destroy_value(Map map, DestroyFunc destroy_value) {
+  DestroyFunc old = map->destroy_value;
+  map->destroy_value = destroy_value;
+  return old;
+}
+
+size_t map_size(Map map) { return map->size; }
+
+/// @brief Returns the slot of key, placing key with value NULL if it is not
+/// part of the map.
+///
+/// Walks the probe sequence of key once, remembering the first free slot on
+/// the way. The probe sequence is walked again only if the table has to grow.
+///
+/// @param hash Hash of key, as returned by hash_function.
+/// @param inserted Set to true, if key was placed, otherwise false.
+///
+/// @return Slot of key, or MAP_EOF if key could not be placed (out of memory).
+///
+static MapNode slot_find_or_place(Map map, void *key, unsigned int hash,
+                                  bool *inserted) {
+  uint32_t h = hash_mix(hash);
+  int8_t tag = hash_tag(h);
+  size_t group_mask = map->capacity / GROUP_WIDTH - 1;
+  size_t group = hash_group(map, h);
+
+  size_t pos = map->capacity; // First free slot of the probe sequence.
+
+  for (size_t step = 1;; step++) {
+    const int8_t *ctrl = &map->ctrl[group * GROUP_WIDTH];
+    uint32_t match = group_match(ctrl, tag);
+
+    uint32_t available = group_match_empty_or_deleted(ctrl);
+    map->savings.compare_calls +=
+        __builtin_popcount(~available & 0xFFFF & ~match);
+
+    for (uint32_t mask = match; mask != 0; mask &= mask - 1) {
+      MapNode slot = &map->slots[group * GROUP_WIDTH + mask_first(mask)];
+      if (slot->hash != hash) {
+        map->savings.compare_calls++;
+      } else if (map->compare(slot->key, key) == 0) {
+        *inserted = false;
+        return slot;
+      }
+    }
+
+    if (pos == map->capacity && available != 0)
+      pos = group * GROUP_WIDTH + mask_first(available);
+
+    // An EMPTY slot means that key is not part of the map.
+    if (group_match_empty(ctrl) != 0)
+      break;
+
+    group = (group + step) & group_mask;
+  }
+
+  // Using an EMPTY slot consumes growth. If none is left, either drop the
+  // tombstones, when they are at least half of the used slots, or double.
+  if (map->ctrl[pos] == CTRL_EMPTY && map->growth_left == 0) {
+    size_t capacity = map->size <= MAX_LOAD(map->capacity) / 2
+                          ? map->capacity
+                          : map->capacity * 2;
+    if (!resize(map, capacity)) {
+      // The table would fill up, and probes would never find an EMPTY slot.
+      *inserted = false;
+      return MAP_EOF;
+    }
+
+    pos = slot_find_free(map, h);
+  }
+
+  if (map->ctrl[pos] == CTRL_EMPTY)
+    map->growth_left--;
+
+  map->ctrl[pos] = tag;
+  map->slots[pos].key = key;
+  map->slots[pos].value = NULL;
+  map->slots[pos].hash = hash;
+
+  map->size++;
+
+  *inserted = true;
+  return &map->slots[pos];
+}
+
+void map_reserve(Map map, size_t n) {
+  // Tombstones use up growth too, so resize unless n entries fit in the
+  // EMPTY slots left.
+  if (n > map->size + map->growth_left)
+    resize(map, capacity_for(n));
+}
+
+void map_shrink_to_fit(Map map) {
+  size_t capacity = capacity_for(map->size);
+  if (capacity < map->capacity)
+    resize(map, capacity);
+}
+
+/// @brief Associates slot, returned by slot_find_or_place(), with key and
+/// value.
+///
+/// @param inserted true, if slot was placed, otherwise its previous key and
+/// value are destroyed.
+///
+static void slot_set(Map map, MapNode slot, bool inserted, void *key,
+                     void *value) {
+  if (!inserted) {
+    // Destroy old key, value pair
+    if (map->destroy_key != NULL)
+      map->destroy_key(slot->key);
+    if (map->destroy_value != NULL)
+      map->destroy_value(slot->value);
+
+    slot->key = key;
+  }
+
+  slot->value = value;
+}
+
+void map_insert(Map map, void *key, void *value) {
+  assert(map->hash_function != NULL && key != NULL &&
+         "Expected key and hash function");
+
+  bool inserted;
+  MapNode slot =
+      slot_find_or_place(map, key, map->hash_function(key), &inserted);
+  if (slot != MAP_EOF)
+    slot_set(map, slot, inserted, key, value);
+}
+
+void **map_find_or_insert(Map map, void *key, bool *inserted) {
+  assert(map->hash_function != NULL && key != NULL &&
+         "Expected key and hash function");
+
+  MapNode slot =
+      slot_find_or_place(map, key, map->hash_function(key), inserted);
+  return slot != MAP_EOF ? &slot->value : NULL;
+}
+
+bool map_update(Map map, void *key, MapUpdateFunc update, void *context) {
+  assert(map->hash_function != NULL && key != NULL &&
+         "Expected key and hash function");
+
+  bool inserted;
+  MapNode slot =
+      slot_find_or_place(map, key, map->hash_function(key), &inserted);
+  if (slot == MAP_EOF)
+    return false; // Out of memory, key was not inserted.
+
+  update(&slot->value, context);
+
+  return inserted;
+}
+
+bool map_remove(Map map, void *key) {
+  assert(map->hash_function != NULL && key != NULL &&
+         "Expected key and hash function");
+
+  MapNode slot = slot_find(map, key, map->hash_function(key));
+  if (slot == MAP_EOF)
+    return false;
+
+  if (map->destroy_key != NULL)
+    map->destroy_key(slot->key);
+  if (map->destroy_value != NULL)
+    map->destroy_value(slot->value);
+
+  // If the group still has an EMPTY slot, no probe sequence ever continued
+  // past it, so the slot can become EMPTY again instead of a tombstone.
+  size_t pos = slot - map->slots;
+  const int8_t *group = &map->ctrl[pos - pos % GROUP_WIDTH];
+  if (group_match_empty(group) != 0) {
+    map->ctrl[pos] = CTRL_EMPTY;
+    map->growth_left++;
+  } else {
+    map->ctrl[pos] = CTRL_DELETED;
+  }
+
+  map->size--;
+
+  return true;
+}
+
+void *map_find(Map map, void *key) {
+  MapNode node = map_find_node(map, key);
+  return node != MAP_EOF ? node->value : NULL;
+}
+
+MapNode map_find_node(Map map, void *key) {
+  assert(map->hash_function != NULL && key != NULL &&
+         "Expected key and hash function");
+
+  return slot_find(map, key, map->hash_function(key));
+}
+
+//////////////////////////////// Batches ///////////////////////////////////////
+
+// A batch is pipelined: while key i is looked up, the first group of key
+// i + 2 * BATCH_DISTANCE is prefetched, and, since the control bytes of the
+// first group of key i + BATCH_DISTANCE were prefetched BATCH_DISTANCE keys
+// ago, the slot whose tag matches in it too. Most lookups then find their
+// control bytes and slot in cache.
+
+/// @brief Keys between the two prefetches of a key, and between the second
+/// prefetch and the lookup.
+///
+#define BATCH_DISTANCE 8
+
+/// @brief Hashes of the keys in flight, indexed by position % BATCH_WINDOW.
+///
+#define BATCH_WINDOW (2 * BATCH_DISTANCE)
+
+/// @brief First prefetch of a batch: the control bytes of the first group of
+/// hash.
+///
+static inline void prefetch_group(Map map, unsigned int hash) {
+  __builtin_prefetch(&map->ctrl[hash_group(map, hash_mix(hash)) * GROUP_WIDTH]);
+}
+
+/// @brief Second prefetch of a batch: the first slot of the first group of
+/// hash whose tag matches, if any.
+///
+static inline void prefetch_slot(Map map, unsigned int hash) {
+  uint32_t h = hash_mix(hash);
+  size_t group = hash_group(map, h);
+  uint32_t match = group_match(&map->ctrl[group * GROUP_WIDTH], hash_tag(h));
+  if (match != 0)
+    __builtin_prefetch(&map->slots[group * GROUP_WIDTH + mask_first(match)]);
+}
+
+void map_find_batch(Map map, void **keys, size_t n, void **values) {
+  assert(map->hash_function != NULL && "Expected hash function");
+
+  unsigned int hashes[BATCH_WINDOW];
+  for (size_t i = 0; i < n + BATCH_WINDOW; i++) {
+    // The oldest key first, as the newest one takes its place in hashes.
+    if (i >= BATCH_WINDOW) {
+      size_t k = i - BATCH_WINDOW;
+      MapNode slot = slot_find(map, keys[k], hashes[k % BATCH_WINDOW]);
+      values[k] = slot != MAP_EOF ? slot->value : NULL;
+    }
+
+    if (i >= BATCH_DISTANCE && i - BATCH_DISTANCE < n)
+      prefetch_slot(map, hashes[(i - BATCH_DISTANCE) % BATCH_WINDOW]);
+
+    if (i < n) {
+      assert(keys[i] != NULL && "Expected key");
+      hashes[i % BATCH_WINDOW] = map->hash_function(keys[i]);
+      prefetch_group(map, hashes[i % BATCH_WINDOW]);
+    }
+  }
+}
+
+void map_insert_batch(Map map, void **keys, size_t n, void **values) {
+  assert(map->hash_function != NULL && "Expected hash function");
+
+  // Same pipeline as map_find_batch(). A resize in the middle of the batch
+  // only makes the prefetches of the keys in flight useless.
+  unsigned int hashes[BATCH_WINDOW];
+  for (size_t i = 0; i < n + BATCH_WINDOW; i++) {
+    if (i >= BATCH_WINDOW) {
+      size_t k = i - BATCH_WINDOW;
+      bool inserted;
+      MapNode slot = slot_find_or_place(map, keys[k], hashes[k % BATCH_WINDOW],
+                                        &inserted);
+      if (slot != MAP_EOF)
+        slot_set(map, slot, inserted, keys[k], values[k]);
+    }
+
+    if (i >= BATCH_DISTANCE && i - BATCH_DISTANCE < n)
+      prefetch_slot(map, hashes[(i - BATCH_DISTANCE) % BATCH_WINDOW]);
+
+    if (i < n) {
+      assert(keys[i] != NULL && "Expected key");
+      hashes[i % BATCH_WINDOW] = map->hash_function(keys[i]);
+      prefetch_group(map, hashes[i % BATCH_WINDOW]);
+    }
+  }
+}
+
+void *map_node_key(Map map, MapNode node) { return node->key; }
+
+void *map_node_value(Map map, MapNode node) { return node->value; }
+
+/// @brief Returns the first occupied slot at or after position pos, or
+/// MAP_EOF if there is none.
+///
+static MapNode slot_next_occupied(Map map, size_t pos) {
+  for (; pos < map->capacity; pos++) {
+    if (map->ctrl[pos] >= 0)
+      return &map->slots[pos];
+  }
+
+  return MAP_EOF;
+}
+
+MapNode map_first(Map map) { return slot_next_occupied(map, 0); }
+
+MapNode map_next(Map map, MapNode node) {
+  assert(node != NULL);
+  return slot_next_occupied(map, (node - map->slots) + 1);
+}
+
+/// @brief Points iter to the first occupied slot at or after position pos.
+///
+static void iter_seek(Map map, MapIterator *iter, size_t pos) {
+  iter->node = slot_next_occupied(map, pos);
+  iter->position = iter->node != MAP_EOF ? (size_t)(iter->node - map->slots)
+                                         : map->capacity;
+  iter->cursor = NULL;
+}
+
+MapIterator map_iter_begin(Map map) {
+  MapIterator iter;
+  iter_seek(map, &iter, 0);
+  return iter;
+}
+
+bool map_iter_valid(Map map, MapIterator *iter) {
+  return iter->node != MAP_EOF;
+}
+
+void map_iter_next(Map map, MapIterator *iter) {
+  assert(iter->node != MAP_EOF);
+  iter_seek(map, iter, iter->position + 1);
+}
+
+MapNode map_iter_node(Map map, MapIterator *iter) { return iter->node; }
+
+void map_savings(Map map, MapSavings *savings) { *savings = map->savings; }
+
+void map_set_hash_function(Map map, HashFunc func) {
+  map->hash_function = func;
+}
+
+unsigned int hash_string(void *value) {
+  // djb2 hash function, simple, fast, and generally efficient.
+  unsigned int hash = 5381;
+  for (char *s = value; *s != '\0'; s++)
+    hash = (hash << 5) + hash + *s; // hash * 33 + *s
+  return hash;
+}
+
+unsigned int hash_int(void *value) { return *(int *)value; }
+
+unsigned int hash_pointer(void *value) { return (size_t)value; }
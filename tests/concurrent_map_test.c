@@ -0,0 +1,131 @@
+#include "concurrent_map.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "acutest.h"
+
+#include "test_companion.h"
+
+#define THREADS 8
+
+void test_create(void) {
+  ConcurrentMap map =
+      concurrent_map_create(compare_ints, free, free, hash_int, 0);
+
+  TEST_CHECK(map != NULL);
+  TEST_CHECK(concurrent_map_size(map) == 0);
+
+  concurrent_map_destroy(map);
+}
+
+void test_insert_find_remove(void) {
+  int N = 1000;
+  ConcurrentMap map =
+      concurrent_map_create(compare_ints, free, free, hash_int, 4);
+
+  for (int i = 0; i < N; i++)
+    concurrent_map_insert(map, create_int(i), create_int(i));
+  TEST_CHECK(concurrent_map_size(map) == N);
+
+  // Overwrite the value of every other key.
+  for (int i = 0; i < N; i += 2)
+    concurrent_map_insert(map, create_int(i), create_int(-i));
+  TEST_CHECK(concurrent_map_size(map) == N);
+
+  for (int i = 0; i < N; i++) {
+    int *value = concurrent_map_find(map, &i);
+    TEST_CHECK(value != NULL && *value == (i % 2 == 0 ? -i : i));
+  }
+
+  for (int i = 0; i < N; i += 3)
+    TEST_CHECK(concurrent_map_remove(map, &i));
+  for (int i = 0; i < N; i++)
+    TEST_CHECK((concurrent_map_find(map, &i) == NULL) == (i % 3 == 0));
+
+  int missing = N;
+  TEST_CHECK(!concurrent_map_remove(map, &missing));
+  TEST_CHECK(concurrent_map_size(map) == N - (N + 2) / 3);
+
+  concurrent_map_destroy(map);
+}
+
+/// @brief Replaces the int value with a new one, incremented by 1.
+///
+static void increment(void **value, void *context) {
+  int *previous = *value;
+  *value = create_int(previous != NULL ? *previous + 1 : 1);
+}
+
+/// @brief Arguments of a test thread.
+///
+struct worker {
+  ConcurrentMap map;
+  int id;
+  int keys;   // Keys per thread.
+  int errors; // Failed checks. Checks run in the main thread only.
+};
+
+/// @brief Inserts keys of its own, counts keys shared by all threads, and
+/// looks everything up.
+///
+static void *work(void *argument) {
+  struct worker *worker = argument;
+  int first = (worker->id + 1) * worker->keys;
+
+  for (int i = first; i < first + worker->keys; i++) {
+    concurrent_map_insert(worker->map, create_int(i), create_int(i));
+
+    // Keys [0, keys) are counted by every thread.
+    int *shared = create_int(i % worker->keys);
+    if (!concurrent_map_update(worker->map, shared, increment, NULL))
+      free(shared);
+  }
+
+  for (int i = first; i < first + worker->keys; i++) {
+    int *value = concurrent_map_find(worker->map, &i);
+    worker->errors += value == NULL || *value != i;
+  }
+
+  for (int i = first; i < first + worker->keys; i += 2)
+    worker->errors += !concurrent_map_remove(worker->map, &i);
+
+  return NULL;
+}
+
+void test_threads(void) {
+  int keys = 2000;
+  ConcurrentMap map =
+      concurrent_map_create(compare_ints, free, free, hash_int, 0);
+
+  pthread_t threads[THREADS];
+  struct worker workers[THREADS];
+  for (int t = 0; t < THREADS; t++) {
+    workers[t] = (struct worker){map, t, keys, 0};
+    pthread_create(&threads[t], NULL, work, &workers[t]);
+  }
+  for (int t = 0; t < THREADS; t++) {
+    pthread_join(threads[t], NULL);
+    TEST_CHECK(workers[t].errors == 0);
+  }
+
+  // Shared keys, plus half of the keys of each thread.
+  TEST_CHECK(concurrent_map_size(map) == keys + THREADS * keys / 2);
+
+  // No increment was lost.
+  for (int i = 0; i < keys; i++) {
+    int *count = concurrent_map_find(map, &i);
+    TEST_CHECK(count != NULL && *count == THREADS);
+  }
+
+  concurrent_map_destroy(map);
+}
+
+TEST_LIST = {
+    {"concurrent_map_create", test_create},
+    {"concurrent_map_insert_find_remove", test_insert_find_remove},
+    {"concurrent_map_threads", test_threads},
+
+    {NULL, NULL} // End of tests.
+};
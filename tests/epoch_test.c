@@ -0,0 +1,123 @@
+#include "epoch.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+
+#include "acutest.h"
+
+/// @brief Destructions run so far, by count_destroy().
+///
+static int destroyed;
+
+static void count_destroy(void *pointer) {
+  __atomic_fetch_add(&destroyed, 1, __ATOMIC_RELAXED);
+}
+
+static int destroyed_so_far(void) {
+  return __atomic_load_n(&destroyed, __ATOMIC_RELAXED);
+}
+
+void test_create(void) {
+  EpochDomain domain = epoch_domain_create();
+  TEST_CHECK(domain != NULL);
+  epoch_domain_destroy(domain);
+}
+
+void test_defer(void) {
+  EpochDomain domain = epoch_domain_create();
+  destroyed = 0;
+
+  // Without readers, a synchronization runs every destruction.
+  for (int i = 0; i < 10; i++)
+    epoch_defer(domain, count_destroy, NULL);
+  epoch_synchronize(domain);
+  TEST_CHECK(destroyed_so_far() == 10);
+
+  // Destroying the domain runs the destructions still pending.
+  for (int i = 0; i < 10; i++)
+    epoch_defer(domain, count_destroy, NULL);
+  epoch_domain_destroy(domain);
+  TEST_CHECK(destroyed_so_far() == 20);
+}
+
+/// @brief A reader that stays in a critical section until told to exit.
+///
+struct reader {
+  EpochDomain domain;
+  bool entered; // Set by the reader.
+  bool exit;    // Set by the test.
+};
+
+static void *read_until_exit(void *argument) {
+  struct reader *reader = argument;
+
+  epoch_enter(reader->domain);
+  __atomic_store_n(&reader->entered, true, __ATOMIC_RELEASE);
+
+  while (!__atomic_load_n(&reader->exit, __ATOMIC_ACQUIRE))
+    sched_yield();
+
+  epoch_exit(reader->domain);
+  return NULL;
+}
+
+void test_reader_delays_destruction(void) {
+  EpochDomain domain = epoch_domain_create();
+  destroyed = 0;
+
+  struct reader reader = {domain, false, false};
+  pthread_t thread;
+  pthread_create(&thread, NULL, read_until_exit, &reader);
+  while (!__atomic_load_n(&reader.entered, __ATOMIC_ACQUIRE))
+    sched_yield();
+
+  // Enough destructions for the writer to try to advance the epoch a few times.
+  for (int i = 0; i < 1000; i++)
+    epoch_defer(domain, count_destroy, NULL);
+  TEST_CHECK(destroyed_so_far() == 0);
+
+  __atomic_store_n(&reader.exit, true, __ATOMIC_RELEASE);
+  pthread_join(thread, NULL);
+
+  epoch_synchronize(domain);
+  TEST_CHECK(destroyed_so_far() == 1000);
+
+  epoch_domain_destroy(domain);
+}
+
+static void *defer_many(void *domain) {
+  for (int i = 0; i < 1000; i++)
+    epoch_defer(domain, count_destroy, NULL);
+  return NULL;
+}
+
+void test_nesting(void) {
+  EpochDomain domain = epoch_domain_create();
+  destroyed = 0;
+
+  // Still in a critical section after the inner one exits.
+  epoch_enter(domain);
+  epoch_enter(domain);
+  epoch_exit(domain);
+
+  pthread_t thread;
+  pthread_create(&thread, NULL, defer_many, domain);
+  pthread_join(thread, NULL);
+  TEST_CHECK(destroyed_so_far() == 0);
+
+  epoch_exit(domain);
+  epoch_synchronize(domain);
+  TEST_CHECK(destroyed_so_far() == 1000);
+
+  epoch_domain_destroy(domain);
+}
+
+TEST_LIST = {
+    {"epoch_create", test_create},
+    {"epoch_defer", test_defer},
+    {"epoch_reader_delays_destruction", test_reader_delays_destruction},
+    {"epoch_nesting", test_nesting},
+
+    {NULL, NULL} // End of tests.
+};
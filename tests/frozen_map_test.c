@@ -0,0 +1,162 @@
+#include "frozen_map.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "acutest.h"
+
+static int compare_ints(const void *a, const void *b) {
+  return *(int *)a - *(int *)b;
+}
+
+static int compare_strings(const void *a, const void *b) {
+  return strcmp(a, b);
+}
+
+/// @brief Hash with only four values, so that most keys share their hash.
+///
+static unsigned int hash_colliding(void *value) {
+  return *(unsigned int *)value % 4;
+}
+
+/// @brief Returns a map of the keys 0, ..., N - 1 of \p keys, each mapped to
+/// the key after it.
+///
+static Map create_int_map(int *keys, int N, HashFunc hash) {
+  Map map = map_create(compare_ints, NULL, NULL);
+  map_set_hash_function(map, hash);
+  for (int i = 0; i < N; i++) {
+    keys[i] = i;
+    map_insert(map, &keys[i], &keys[(i + 1) % N]);
+  }
+  return map;
+}
+
+void test_build(void) {
+  Map map = map_create(compare_ints, NULL, NULL);
+  map_set_hash_function(map, hash_int);
+
+  FrozenMap frozen = frozen_map_build(map, compare_ints, hash_int);
+  TEST_CHECK(frozen != NULL);
+  TEST_CHECK(frozen_map_size(frozen) == 0);
+
+  int key = 0;
+  TEST_CHECK(frozen_map_find(frozen, &key) == NULL);
+
+  frozen_map_destroy(frozen);
+  map_destroy(map);
+}
+
+void test_find(void) {
+  int N = 10000;
+  int *keys = malloc(N * sizeof(*keys));
+  Map map = create_int_map(keys, N, hash_int);
+
+  FrozenMap frozen = frozen_map_build(map, compare_ints, hash_int);
+  TEST_ASSERT(frozen != NULL);
+  TEST_CHECK(frozen_map_size(frozen) == (size_t)N);
+
+  // The map may change afterwards, without changing the frozen map.
+  map_remove(map, &keys[0]);
+
+  for (int i = 0; i < N; i++) {
+    int *value = frozen_map_find(frozen, &i);
+    TEST_CHECK(value != NULL && *value == (i + 1) % N);
+  }
+  for (int i = N; i < 2 * N; i++)
+    TEST_CHECK(frozen_map_find(frozen, &i) == NULL);
+  for (int i = -N; i < 0; i++)
+    TEST_CHECK(frozen_map_find(frozen, &i) == NULL);
+
+  frozen_map_destroy(frozen);
+  map_destroy(map);
+  free(keys);
+}
+
+void test_colliding_hashes(void) {
+  int N = 200;
+  int *keys = malloc(N * sizeof(*keys));
+  Map map = create_int_map(keys, N, hash_colliding);
+
+  FrozenMap frozen = frozen_map_build(map, compare_ints, hash_colliding);
+  TEST_ASSERT(frozen != NULL);
+  TEST_CHECK(frozen_map_size(frozen) == (size_t)N);
+
+  for (int i = 0; i < N; i++) {
+    int *value = frozen_map_find(frozen, &i);
+    TEST_CHECK(value != NULL && *value == (i + 1) % N);
+  }
+  for (int i = N; i < 2 * N; i++)
+    TEST_CHECK(frozen_map_find(frozen, &i) == NULL);
+
+  frozen_map_destroy(frozen);
+  map_destroy(map);
+  free(keys);
+}
+
+void test_missing_keys(void) {
+  // Enough keys that missing ones land on positions past the last slot,
+  // taken or not.
+  int N = 100000;
+  int *keys = malloc(N * sizeof(*keys));
+  Map map = map_create(compare_ints, NULL, NULL);
+  map_set_hash_function(map, hash_int);
+  for (int i = 0; i < N; i++) {
+    keys[i] = 7 * i;
+    map_insert(map, &keys[i], &keys[i]);
+  }
+
+  FrozenMap frozen = frozen_map_build(map, compare_ints, hash_int);
+  TEST_ASSERT(frozen != NULL);
+  TEST_CHECK(frozen_map_size(frozen) == (size_t)N);
+
+  bool found = true, missing = true;
+  for (int i = 0; i < N; i++) {
+    int key = 7 * i;
+    found = found && frozen_map_find(frozen, &key) == &keys[i];
+    key = 7 * i + 3;
+    missing = missing && frozen_map_find(frozen, &key) == NULL;
+  }
+  TEST_CHECK(found);
+  TEST_CHECK(missing);
+
+  frozen_map_destroy(frozen);
+  map_destroy(map);
+  free(keys);
+}
+
+void test_strings(void) {
+  char *keys[] = {"alpha", "beta", "gamma", "delta", "epsilon"};
+  int count = sizeof(keys) / sizeof(*keys);
+
+  Map map = map_create(compare_strings, NULL, NULL);
+  map_set_hash_function(map, hash_string);
+  for (int i = 0; i < count; i++)
+    map_insert(map, keys[i], keys[(i + 1) % count]);
+
+  FrozenMap frozen = frozen_map_build(map, compare_strings, hash_string);
+  TEST_ASSERT(frozen != NULL);
+  TEST_CHECK(frozen_map_size(frozen) == (size_t)count);
+
+  // Found by value, not by pointer.
+  char key[16];
+  for (int i = 0; i < count; i++) {
+    strcpy(key, keys[i]);
+    TEST_CHECK(frozen_map_find(frozen, key) == keys[(i + 1) % count]);
+  }
+  TEST_CHECK(frozen_map_find(frozen, "zeta") == NULL);
+
+  frozen_map_destroy(frozen);
+  map_destroy(map);
+}
+
+TEST_LIST = {
+    {"frozen_map_build", test_build},
+    {"frozen_map_find", test_find},
+    {"frozen_map_colliding_hashes", test_colliding_hashes},
+    {"frozen_map_missing_keys", test_missing_keys},
+    {"frozen_map_strings", test_strings},
+
+    {NULL, NULL} // End of tests.
+};
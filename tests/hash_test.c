@@ -0,0 +1,192 @@
+#include "hash.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "acutest.h"
+
+#include "map.h" // hash_string, hash_int
+
+/// @brief Hash function under test: hashes size bytes at key.
+///
+typedef uint64_t (*TestHash)(const uint8_t *key, size_t size);
+
+static uint64_t bytes_hash(const uint8_t *key, size_t size) {
+  return hash_bytes(key, size, hash_seed());
+}
+
+static uint64_t u64_hash(const uint8_t *key, size_t size) {
+  uint64_t value;
+  memcpy(&value, key, sizeof(value));
+  return hash_u64(value, hash_seed());
+}
+
+static uint64_t int_seeded_hash(const uint8_t *key, size_t size) {
+  return hash_int_seeded((void *)key);
+}
+
+static uint64_t int_hash(const uint8_t *key, size_t size) {
+  return hash_int((void *)key);
+}
+
+/// @brief Returns the largest deviation from 1/2 of the probability that
+/// flipping an input bit flips an output bit.
+///
+/// @param size Bytes of input.
+/// @param bits Bits of output.
+///
+static double avalanche_bias(TestHash hash, size_t size, int bits) {
+  int samples = 4000;
+  int *flips = calloc(size * 8 * bits, sizeof(*flips));
+  uint8_t key[64];
+
+  for (int s = 0; s < samples; s++) {
+    for (size_t i = 0; i < size; i++)
+      key[i] = rand();
+    uint64_t hash0 = hash(key, size);
+
+    for (size_t i = 0; i < size * 8; i++) {
+      key[i / 8] ^= 1 << (i % 8);
+      uint64_t diff = hash0 ^ hash(key, size);
+      key[i / 8] ^= 1 << (i % 8);
+
+      for (int j = 0; j < bits; j++)
+        flips[i * bits + j] += (diff >> j) & 1;
+    }
+  }
+
+  double bias = 0;
+  for (size_t i = 0; i < size * 8 * bits; i++) {
+    double deviation = (double)flips[i] / samples - 0.5;
+    if (deviation < 0)
+      deviation = -deviation;
+    if (deviation > bias)
+      bias = deviation;
+  }
+
+  free(flips);
+  return bias;
+}
+
+/// @brief Returns the chi-squared statistic of the given hashes, reduced to
+/// 1024 buckets by their lowest bits.
+///
+/// For evenly distributed hashes it is close to 1023.
+///
+static double chi_squared(unsigned int *hashes, int size) {
+  int buckets = 1024;
+  int counts[1024] = {0};
+  for (int i = 0; i < size; i++)
+    counts[hashes[i] & (buckets - 1)]++;
+
+  double expected = (double)size / buckets;
+  double chi = 0;
+  for (int i = 0; i < buckets; i++)
+    chi += (counts[i] - expected) * (counts[i] - expected) / expected;
+  return chi;
+}
+
+void test_bytes(void) {
+  uint8_t buffer[128 + 1];
+  for (int i = 0; i < sizeof(buffer); i++)
+    buffer[i] = rand();
+
+  // Every prefix has a different hash.
+  uint64_t hashes[128];
+  for (int size = 0; size < 128; size++) {
+    hashes[size] = hash_bytes(buffer, size, 42);
+    for (int i = 0; i < size; i++)
+      TEST_CHECK(hashes[i] != hashes[size]);
+  }
+
+  // The hash depends on the bytes, not on their alignment, and on the seed.
+  for (int size = 0; size < 128; size++) {
+    uint8_t unaligned[128 + 1];
+    memcpy(unaligned + 1, buffer, size);
+    TEST_CHECK(hash_bytes(unaligned + 1, size, 42) == hashes[size]);
+    TEST_CHECK(hash_bytes(buffer, size, 43) != hashes[size]);
+  }
+}
+
+void test_seed(void) {
+  uint64_t seed = hash_seed();
+  int value = 42;
+
+  hash_set_seed(1);
+  TEST_CHECK(hash_seed() == 1);
+  unsigned int string1 = hash_string_seeded("key");
+  unsigned int int1 = hash_int_seeded(&value);
+  unsigned int pointer1 = hash_pointer_seeded(&value);
+
+  hash_set_seed(2);
+  TEST_CHECK(hash_string_seeded("key") != string1);
+  TEST_CHECK(hash_int_seeded(&value) != int1);
+  TEST_CHECK(hash_pointer_seeded(&value) != pointer1);
+
+  hash_set_seed(1);
+  TEST_CHECK(hash_string_seeded("key") == string1);
+
+  hash_set_seed(seed);
+}
+
+void test_avalanche(void) {
+  // 4000 samples per bit pair: a fair coin stays within 0.05 of 1/2.
+  double bias = 0.05;
+
+  TEST_CHECK(avalanche_bias(bytes_hash, 3, 64) < bias);
+  TEST_CHECK(avalanche_bias(bytes_hash, 8, 64) < bias);
+  TEST_CHECK(avalanche_bias(bytes_hash, 16, 64) < bias);
+  TEST_CHECK(avalanche_bias(bytes_hash, 40, 64) < bias);
+  TEST_CHECK(avalanche_bias(bytes_hash, 64, 64) < bias);
+  TEST_CHECK(avalanche_bias(u64_hash, 8, 64) < bias);
+  TEST_CHECK(avalanche_bias(int_seeded_hash, 4, 32) < bias);
+
+  // hash_int of map.c is the identity: a flipped bit flips only itself.
+  TEST_CHECK(avalanche_bias(int_hash, 4, 32) == 0.5);
+}
+
+void test_distribution(void) {
+  int N = 16384;
+  unsigned int *hashes = malloc(N * sizeof(*hashes));
+  unsigned int *identity = malloc(N * sizeof(*identity));
+
+  // Keys with a stride that is a power of two, e.g. ids of 64-byte records.
+  for (int i = 0; i < N; i++) {
+    int key = i * 64;
+    hashes[i] = hash_int_seeded(&key);
+    identity[i] = hash_int(&key);
+  }
+  // 1023 on average, with a standard deviation of 45.
+  TEST_CHECK(chi_squared(hashes, N) < 1300);
+  TEST_CHECK(chi_squared(identity, N) > 10 * 1023);
+
+  // Addresses of 16-byte aligned objects.
+  uint8_t *objects = malloc(N * 16);
+  for (int i = 0; i < N; i++) {
+    hashes[i] = hash_pointer_seeded(objects + i * 16);
+    identity[i] = (unsigned int)(size_t)(objects + i * 16);
+  }
+  TEST_CHECK(chi_squared(hashes, N) < 1300);
+  TEST_CHECK(chi_squared(identity, N) > 10 * 1023);
+
+  // Strings that differ in their last characters.
+  char string[32];
+  for (int i = 0; i < N; i++) {
+    snprintf(string, sizeof(string), "key:%d", i);
+    hashes[i] = hash_string_seeded(string);
+  }
+  TEST_CHECK(chi_squared(hashes, N) < 1300);
+
+  free(objects);
+  free(identity);
+  free(hashes);
+}
+
+TEST_LIST = {
+    {"hash_bytes", test_bytes},
+    {"hash_seed", test_seed},
+    {"hash_avalanche", test_avalanche},
+    {"hash_distribution", test_distribution},
+    {NULL, NULL} // End of tests
+};
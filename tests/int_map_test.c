@@ -0,0 +1,169 @@
+#include "int_map.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "acutest.h"
+
+void test_create(void) {
+  IntMap map = int_map_create();
+  TEST_CHECK(map != NULL);
+  TEST_CHECK(int_map_size(map) == 0);
+  TEST_CHECK(int_map_find(map, 1) == NULL);
+  int_map_destroy(map);
+}
+
+void test_insert(void) {
+  IntMap map = int_map_create();
+
+  // Enough keys for multiple resizes, negative ones too.
+  int N = 1000;
+  for (int i = -N; i < N; i++) {
+    int_map_insert(map, i, 2 * i);
+    TEST_CHECK(int_map_size(map) == (size_t)(i + N + 1));
+  }
+
+  for (int i = -N; i < N; i++) {
+    int *value = int_map_find(map, i);
+    TEST_CHECK(value != NULL && *value == 2 * i);
+  }
+  TEST_CHECK(int_map_find(map, N) == NULL);
+
+  // Overwrite.
+  int_map_insert(map, 7, -7);
+  TEST_CHECK(*int_map_find(map, 7) == -7);
+  TEST_CHECK(int_map_size(map) == (size_t)(2 * N));
+
+  int_map_destroy(map);
+}
+
+void test_empty_key(void) {
+  U64Map map = u64_map_create();
+
+  // The sentinel key of empty slots is a key like any other.
+  TEST_CHECK(u64_map_find(map, 0) == NULL);
+  u64_map_insert(map, 0, 10);
+  TEST_CHECK(u64_map_size(map) == 1);
+  TEST_CHECK(*u64_map_find(map, 0) == 10);
+
+  bool inserted;
+  (*u64_map_find_or_insert(map, 0, &inserted))++;
+  TEST_CHECK(!inserted);
+  TEST_CHECK(*u64_map_find(map, 0) == 11);
+
+  TEST_CHECK(u64_map_remove(map, 0));
+  TEST_CHECK(!u64_map_remove(map, 0));
+  TEST_CHECK(u64_map_find(map, 0) == NULL);
+  TEST_CHECK(u64_map_size(map) == 0);
+
+  u64_map_destroy(map);
+}
+
+void test_remove(void) {
+  U64Map map = u64_map_create();
+
+  // Keys spread over the whole range, checked against a plain array after
+  // each removal, so that every backward shift is verified.
+  uint64_t N = 2000;
+  bool *present = calloc(N, sizeof(*present));
+  for (uint64_t i = 0; i < N; i++) {
+    u64_map_insert(map, i * 0x9e3779b97f4a7c15, i);
+    present[i] = true;
+  }
+
+  for (uint64_t i = 0; i < N; i += 3) {
+    TEST_CHECK(u64_map_remove(map, i * 0x9e3779b97f4a7c15));
+    TEST_CHECK(!u64_map_remove(map, i * 0x9e3779b97f4a7c15));
+    present[i] = false;
+  }
+
+  size_t size = 0;
+  for (uint64_t i = 0; i < N; i++) {
+    uint64_t *value = u64_map_find(map, i * 0x9e3779b97f4a7c15);
+    if (present[i]) {
+      TEST_CHECK(value != NULL && *value == i);
+      size++;
+    } else {
+      TEST_CHECK(value == NULL);
+    }
+  }
+  TEST_CHECK(u64_map_size(map) == size);
+
+  u64_map_destroy(map);
+  free(present);
+}
+
+void test_find_or_insert(void) {
+  U64Map map = u64_map_create();
+
+  // Count the occurrences of each key, with every key appearing 3 times.
+  uint64_t N = 1000;
+  for (int round = 0; round < 3; round++) {
+    for (uint64_t i = 0; i < N; i++) {
+      bool inserted;
+      uint64_t *count = u64_map_find_or_insert(map, i, &inserted);
+      TEST_CHECK(inserted == (round == 0));
+      if (inserted)
+        TEST_CHECK(*count == 0);
+      (*count)++;
+    }
+  }
+
+  for (uint64_t i = 0; i < N; i++)
+    TEST_CHECK(*u64_map_find(map, i) == 3);
+
+  u64_map_destroy(map);
+}
+
+void test_next(void) {
+  U64Map map = u64_map_create();
+
+  uint64_t N = 1000;
+  for (uint64_t i = 0; i < N; i++)
+    u64_map_insert(map, i, i + 1);
+
+  // Every entry is visited once, the one of the sentinel key too.
+  bool *visited = calloc(N, sizeof(*visited));
+  size_t count = 0;
+  size_t position = 0;
+  uint64_t key, value;
+  while (u64_map_next(map, &position, &key, &value)) {
+    TEST_CHECK(key < N && !visited[key] && value == key + 1);
+    visited[key] = true;
+    count++;
+  }
+  TEST_CHECK(count == N);
+
+  u64_map_destroy(map);
+  free(visited);
+}
+
+void test_capacity(void) {
+  U64Map map = u64_map_create_with_capacity(1000);
+
+  // No resize: found addresses stay valid while inserting.
+  u64_map_insert(map, 1, 1);
+  uint64_t *first = u64_map_find(map, 1);
+  for (uint64_t i = 2; i <= 1000; i++)
+    u64_map_insert(map, i, i);
+  TEST_CHECK(u64_map_find(map, 1) == first);
+
+  u64_map_reserve(map, 100000);
+  for (uint64_t i = 1; i <= 1000; i++)
+    TEST_CHECK(*u64_map_find(map, i) == i);
+
+  u64_map_destroy(map);
+}
+
+TEST_LIST = {
+    {"int_map_create", test_create},
+    {"int_map_insert", test_insert},
+    {"int_map_empty_key", test_empty_key},
+    {"int_map_remove", test_remove},
+    {"int_map_find_or_insert", test_find_or_insert},
+    {"int_map_next", test_next},
+    {"int_map_capacity", test_capacity},
+
+    {NULL, NULL} // End of tests.
+};
@@ -0,0 +1,116 @@
+#include "map.h"
+
+#include <stdlib.h>
+
+#include "acutest.h"
+
+// Tests of the traversal order of an insertion ordered map, on top of the tests of map_test.c.
+
+static int compare_ints(const void* a, const void* b) { return *(int*)a - *(int*)b; }
+
+static int* create_int(int value) {
+    int* pointer = malloc(sizeof(int));
+    *pointer = value;
+    return pointer;
+}
+
+/// @brief Checks that both traversals of map visit the \p count keys of \p expected , in order.
+///
+static void check_order(Map map, int* expected, int count) {
+    TEST_CHECK(map_size(map) == (size_t)count);
+
+    int i = 0;
+    for (MapNode node = map_first(map); node != MAP_EOF; node = map_next(map, node), i++) {
+        TEST_CHECK(i < count && *(int*)map_node_key(map, node) == expected[i]);
+    }
+    TEST_CHECK(i == count);
+
+    i = 0;
+    for (MapIterator iter = map_iter_begin(map); map_iter_valid(map, &iter);
+         map_iter_next(map, &iter), i++) {
+        MapNode node = map_iter_node(map, &iter);
+        TEST_CHECK(i < count && *(int*)map_node_key(map, node) == expected[i]);
+    }
+    TEST_CHECK(i == count);
+}
+
+void test_insertion_order(void) {
+    Map map = map_create(compare_ints, free, free);
+    map_set_hash_function(map, hash_int);
+
+    // Keys in an order unrelated to their hashes, through many resizes.
+    int N = 10000;
+    int* expected = malloc(N * sizeof(*expected));
+    for (int i = 0; i < N; i++) {
+        expected[i] = (i * 7919) % N;
+        map_insert(map, create_int(expected[i]), create_int(i));
+    }
+    check_order(map, expected, N);
+
+    // Replacing the value of a key keeps its position.
+    map_insert(map, create_int(expected[0]), create_int(-1));
+    check_order(map, expected, N);
+    TEST_CHECK(*(int*)map_find(map, &expected[0]) == -1);
+
+    free(expected);
+    map_destroy(map);
+}
+
+void test_remove_order(void) {
+    Map map = map_create(compare_ints, free, free);
+    map_set_hash_function(map, hash_int);
+
+    int N = 1000;
+    for (int i = 0; i < N; i++) {
+        map_insert(map, create_int(i), create_int(i));
+    }
+
+    // Remove the odd keys, and insert some of them again: they go last.
+    for (int i = 1; i < N; i += 2) {
+        TEST_CHECK(map_remove(map, &i));
+    }
+    int* expected = malloc(2 * N * sizeof(*expected));
+    int count = 0;
+    for (int i = 0; i < N; i += 2) {
+        expected[count++] = i;
+    }
+    check_order(map, expected, count);
+
+    for (int i = N - 1; i > N / 2; i -= 2) {
+        map_insert(map, create_int(i), create_int(i));
+        expected[count++] = i;
+    }
+    check_order(map, expected, count);
+
+    // Neither packing the removed entries nor inserting many more keys changes the order.
+    map_shrink_to_fit(map);
+    check_order(map, expected, count);
+
+    for (int i = N; i < 2 * N; i++) {
+        map_insert(map, create_int(i), create_int(i));
+        expected[count++] = i;
+    }
+    check_order(map, expected, count);
+
+    // Removing and inserting the same key over and over, as a queue would.
+    for (int round = 0; round < 5 * N; round++) {
+        int key = expected[0];
+        TEST_CHECK(map_remove(map, &key));
+        map_insert(map, create_int(key), create_int(key));
+        for (int i = 1; i < count; i++) {
+            expected[i - 1] = expected[i];
+        }
+        expected[count - 1] = key;
+    }
+    check_order(map, expected, count);
+
+    free(expected);
+    map_destroy(map);
+}
+
+TEST_LIST = {
+    {"map_insertion_order", test_insertion_order},
+    {"map_remove_order", test_remove_order},
+
+    {NULL, NULL}  // End of tests.
+};
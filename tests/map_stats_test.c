@@ -0,0 +1,162 @@
+// map_stats() is declared only with MAP_STATS, as the map is compiled with.
+#ifndef MAP_STATS
+#define MAP_STATS
+#endif
+
+#include "map.h"
+
+#include <stdlib.h>
+
+#include "acutest.h"
+
+static int compare_ints(const void *a, const void *b) {
+  return *(int *)a - *(int *)b;
+}
+
+static int *create_int(int value) {
+  int *pointer = malloc(sizeof(int));
+  *pointer = value;
+  return pointer;
+}
+
+static size_t hash_calls = 0;
+static size_t compare_calls = 0;
+
+static unsigned int counting_hash_int(void *value) {
+  hash_calls++;
+  return hash_int(value);
+}
+
+static int counting_compare_ints(const void *a, const void *b) {
+  compare_calls++;
+  return compare_ints(a, b);
+}
+
+/// @brief Checks that the histogram of stats adds up to its capacity, and to
+/// size elements.
+///
+static void check_shape(MapStats *stats, size_t size) {
+  size_t buckets = 0, elements = 0;
+  for (size_t i = 0; i < MAP_STATS_CHAINS; i++) {
+    buckets += stats->chain_lengths[i];
+    elements += i * stats->chain_lengths[i];
+  }
+  TEST_CHECK(buckets == stats->capacity);
+  TEST_CHECK(buckets - stats->chain_lengths[0] == stats->occupied);
+  if (stats->max_chain < MAP_STATS_CHAINS - 1)
+    TEST_CHECK(elements == size);
+}
+
+void test_calls(void) {
+  Map map = map_create(counting_compare_ints, free, free);
+  map_set_hash_function(map, counting_hash_int);
+  hash_calls = compare_calls = 0;
+
+  int N = 1000;
+  for (int i = 0; i < N; i++)
+    map_insert(map, create_int(i % 500), create_int(i));
+  for (int i = 0; i < N; i++)
+    map_find(map, &i);
+  for (int i = 0; i < N; i += 2)
+    map_remove(map, &i);
+
+  MapStats stats;
+  map_stats(map, &stats);
+  TEST_CHECK(stats.hash_calls == hash_calls);
+  TEST_CHECK(stats.compare_calls == compare_calls);
+  TEST_CHECK(stats.hash_calls == (size_t)(N + N + N / 2));
+
+  map_destroy(map);
+}
+
+void test_shape(void) {
+  Map map = map_create(compare_ints, free, free);
+  map_set_hash_function(map, hash_int);
+
+  // hash_int spreads consecutive keys evenly.
+  int N = 1000;
+  for (int i = 0; i < N; i++)
+    map_insert(map, create_int(i), create_int(i));
+
+  MapStats stats;
+  map_stats(map, &stats);
+  TEST_CHECK(stats.max_chain == 1);
+  TEST_CHECK(stats.occupied == (size_t)N);
+  TEST_CHECK(stats.load > 0 && stats.load <= 1);
+  check_shape(&stats, N);
+
+  map_destroy(map);
+}
+
+void test_weak_hash(void) {
+  Map map = map_create(compare_ints, free, free);
+  map_set_hash_function(map, hash_int);
+
+  // Multiples of the final capacity of the table, all in one bucket.
+  int N = 1000, stride = 1543;
+  for (int i = 0; i < N; i++)
+    map_insert(map, create_int(i * stride), create_int(i));
+
+  MapStats stats;
+  map_stats(map, &stats);
+  TEST_CHECK(stats.capacity == (size_t)stride);
+  TEST_CHECK(stats.occupied == 1);
+  TEST_CHECK(stats.max_chain == (size_t)N);
+  TEST_CHECK(stats.chain_lengths[MAP_STATS_CHAINS - 1] == 1);
+  check_shape(&stats, N);
+
+  map_destroy(map);
+}
+
+void test_rehashes(void) {
+  int N = 1000;
+  Map map = map_create(compare_ints, free, free);
+  map_set_hash_function(map, hash_int);
+  for (int i = 0; i < N; i++)
+    map_insert(map, create_int(i), create_int(i));
+
+  MapStats stats;
+  map_stats(map, &stats);
+  TEST_CHECK(stats.rehashes > 0);
+  TEST_CHECK(stats.rehash_seconds >= 0);
+  map_destroy(map);
+
+  // A map sized for its elements never resizes.
+  map = map_create_with_capacity(compare_ints, free, free, N);
+  map_set_hash_function(map, hash_int);
+  for (int i = 0; i < N; i++)
+    map_insert(map, create_int(i), create_int(i));
+
+  map_stats(map, &stats);
+  TEST_CHECK(stats.rehashes == 0);
+  TEST_CHECK(stats.rehash_seconds == 0);
+  check_shape(&stats, N);
+  map_destroy(map);
+}
+
+void test_small_map(void) {
+  Map map = map_create(compare_ints, free, free);
+  map_set_hash_function(map, hash_int);
+
+  MapStats stats;
+  map_stats(map, &stats);
+  TEST_CHECK(stats.occupied == 0 && stats.max_chain == 0);
+  check_shape(&stats, 0);
+
+  for (int i = 0; i < 3; i++)
+    map_insert(map, create_int(i), create_int(i));
+  map_stats(map, &stats);
+  check_shape(&stats, 3);
+
+  map_destroy(map);
+}
+
+TEST_LIST = {
+    {"map_stats_calls", test_calls},
+    {"map_stats_shape", test_shape},
+    {"map_stats_weak_hash", test_weak_hash},
+    {"map_stats_rehashes", test_rehashes},
+    {"map_stats_small_map", test_small_map},
+
+    {NULL, NULL} // End of tests.
+};
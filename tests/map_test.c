@@ -129,6 +129,13 @@ void test_remove(void) {
         }
     }
 
+    // Check that removals did not hide any of the remaining keys.
+    for (int i = 0; i < N; i++) {
+        if (i % (N / 20) != 0) {
+            TEST_CHECK(map_find(map, key_array[i]) == value_array[i]);
+        }
+    }
+
     // Remove not existent key.
     int not_exists = N * 2;
     TEST_CHECK(!map_remove(map, &not_exists));
@@ -214,12 +221,400 @@ void test_iterate() {
     map_destroy(map);
 }
 
+void test_iterate_while_finding(void) {
+    Map map = map_create(compare_ints, free, free);
+    map_set_hash_function(map, hash_int);
+
+    int N = 1000;
+    bool seen[N];
+
+    for (int i = 0; i < N; i++) {
+        map_insert(map, create_int(i), create_int(i));
+
+        // Periodically traverse the map, looking up keys in the meantime. Some traversals happen
+        // while the map is being resized, for implementations that resize incrementally.
+        if (i % 50 != 0) {
+            continue;
+        }
+
+        for (int j = 0; j <= i; j++) {
+            seen[j] = false;
+        }
+
+        int visited = 0;
+        for (MapNode node = map_first(map); node != MAP_EOF; node = map_next(map, node)) {
+            int* key = map_node_key(map, node);
+
+            TEST_CHECK(*key >= 0 && *key <= i && !seen[*key]);
+            seen[*key] = true;
+            visited++;
+
+            int other = (*key * 7) % (i + 1);
+            TEST_CHECK(*(int*)map_find(map, &other) == other);
+        }
+        TEST_CHECK(visited == i + 1);
+    }
+
+    map_destroy(map);
+}
+
+void test_savings(void) {
+    Map map = map_create(compare_ints, free, free);
+    map_set_hash_function(map, hash_int);
+
+    MapSavings savings;
+    map_savings(map, &savings);
+    TEST_CHECK(savings.hash_calls == 0);
+    TEST_CHECK(savings.compare_calls == 0);
+
+    // Enough keys to resize the map. Squares are not spread evenly by hash_int, so some keys with
+    // different hashes end up in the same bucket.
+    int N = 1000;
+    for (int i = 0; i < N; i++) {
+        map_insert(map, create_int(i * i), create_int(i));
+    }
+    for (int i = 0; i < N; i++) {
+        int key = i * i;
+        TEST_CHECK(*(int*)map_find(map, &key) == i);
+    }
+
+    map_savings(map, &savings);
+    TEST_CHECK(savings.hash_calls > 0);
+    TEST_CHECK(savings.compare_calls > 0);
+
+    map_destroy(map);
+}
+
+static int hash_calls = 0;
+static int compare_calls = 0;
+
+/// @brief Counts the calls of the hash function.
+///
+static unsigned int counting_hash_int(void* value) {
+    hash_calls++;
+    return hash_int(value);
+}
+
+/// @brief Counts the calls of the compare function.
+///
+static int counting_compare_ints(const void* a, const void* b) {
+    compare_calls++;
+    return compare_ints(a, b);
+}
+
+void test_iterator(void) {
+    Map map = map_create(counting_compare_ints, free, free);
+    map_set_hash_function(map, counting_hash_int);
+
+    // Test for empty map.
+    MapIterator empty = map_iter_begin(map);
+    TEST_CHECK(!map_iter_valid(map, &empty));
+
+    int N = 1000;
+    for (int i = 0; i < N; i++) {
+        map_insert(map, create_int(i), create_int(2 * i));
+    }
+
+    bool seen[N];
+    for (int i = 0; i < N; i++) {
+        seen[i] = false;
+    }
+
+    // A traversal calls neither the hash nor the compare function.
+    hash_calls = 0;
+    compare_calls = 0;
+
+    int visited = 0;
+    for (MapIterator iter = map_iter_begin(map); map_iter_valid(map, &iter);
+         map_iter_next(map, &iter)) {
+        MapNode node = map_iter_node(map, &iter);
+        int* key = map_node_key(map, node);
+        int* value = map_node_value(map, node);
+
+        TEST_CHECK(*key >= 0 && *key < N && !seen[*key]);
+        TEST_CHECK(*value == 2 * *key);
+
+        seen[*key] = true;
+        visited++;
+    }
+
+    TEST_CHECK(visited == N);
+    TEST_CHECK(hash_calls == 0);
+    TEST_CHECK(compare_calls == 0);
+
+    map_destroy(map);
+}
+
+void test_find_or_insert(void) {
+    Map map = map_create(counting_compare_ints, free, free);
+    map_set_hash_function(map, counting_hash_int);
+
+    // Count the occurrences of each key, with every key appearing 3 times.
+    int N = 1000;
+    for (int round = 0; round < 3; round++) {
+        for (int i = 0; i < N; i++) {
+            int* key = create_int(i);
+
+            hash_calls = 0;
+            bool inserted;
+            int** count = (int**)map_find_or_insert(map, key, &inserted);
+            TEST_CHECK(hash_calls == 1);
+
+            TEST_CHECK(inserted == (round == 0));
+            if (inserted) {
+                TEST_CHECK(*count == NULL);
+                *count = create_int(0);
+            } else {
+                free(key);  // Not stored, key is already part of the map.
+            }
+            (**count)++;
+        }
+        TEST_CHECK(map_size(map) == N);
+    }
+
+    for (int i = 0; i < N; i++) {
+        TEST_CHECK(*(int*)map_find(map, &i) == 3);
+    }
+
+    map_destroy(map);
+}
+
+/// @brief Adds *(int*)context to the int value, creating it if needed.
+///
+static void add_to_value(void** value, void* context) {
+    if (*value == NULL) {
+        *value = create_int(0);
+    }
+    **(int**)value += *(int*)context;
+}
+
+void test_update(void) {
+    Map map = map_create(compare_ints, free, free);
+    map_set_hash_function(map, hash_int);
+
+    int N = 1000;
+    for (int i = 0; i < N; i++) {
+        int* key = create_int(i % 100);
+        if (!map_update(map, key, add_to_value, &i)) {
+            free(key);  // Not stored, key is already part of the map.
+        }
+    }
+    TEST_CHECK(map_size(map) == 100);
+
+    // Key k accumulated k + (k + 100) + ... + (k + 900).
+    for (int k = 0; k < 100; k++) {
+        TEST_CHECK(*(int*)map_find(map, &k) == 10 * k + 4500);
+    }
+
+    map_destroy(map);
+}
+
+void test_capacity(void) {
+    // Resizing reuses the cached hashes, so savings.hash_calls counts the entries moved by resizes.
+    MapSavings savings;
+
+    int N = 5000;
+    Map map = map_create_with_capacity(compare_ints, free, free, N);
+    map_set_hash_function(map, hash_int);
+    TEST_CHECK(map_size(map) == 0);
+
+    for (int i = 0; i < N; i++) {
+        map_insert(map, create_int(i), create_int(i));
+    }
+    map_savings(map, &savings);
+    TEST_CHECK(savings.hash_calls == 0);
+
+    // Remove most of the keys and shrink.
+    for (int i = 0; i < N; i++) {
+        if (i % 100 != 0) {
+            TEST_CHECK(map_remove(map, &i));
+        }
+    }
+    map_shrink_to_fit(map);
+    TEST_CHECK(map_size(map) == N / 100);
+    for (int i = 0; i < N; i++) {
+        void* value = map_find(map, &i);
+        TEST_CHECK(i % 100 == 0 ? *(int*)value == i : value == NULL);
+    }
+
+    // Shrinking to fit again has nothing to do.
+    map_savings(map, &savings);
+    size_t moved = savings.hash_calls;
+    map_shrink_to_fit(map);
+    map_savings(map, &savings);
+    TEST_CHECK(savings.hash_calls == moved);
+
+    map_destroy(map);
+
+    // Reserve room in a map that already holds elements.
+    map = map_create(compare_ints, free, free);
+    map_set_hash_function(map, hash_int);
+    for (int i = 0; i < 10; i++) {
+        map_insert(map, create_int(i), create_int(i));
+    }
+    map_reserve(map, N);
+
+    map_savings(map, &savings);
+    moved = savings.hash_calls;
+    for (int i = 10; i < N; i++) {
+        map_insert(map, create_int(i), create_int(i));
+    }
+    map_savings(map, &savings);
+    TEST_CHECK(savings.hash_calls == moved);
+    TEST_CHECK(map_size(map) == N);
+
+    map_destroy(map);
+}
+
+void test_batch(void) {
+    Map map = map_create(compare_ints, free, free);
+    map_set_hash_function(map, hash_int);
+
+    // Every key twice: its second value replaces the first one, as with
+    // map_insert().
+    int N = 1000;
+    void** keys = malloc(2 * N * sizeof(*keys));
+    void** values = malloc(2 * N * sizeof(*values));
+    for (int i = 0; i < 2 * N; i++) {
+        keys[i] = create_int(i % N);
+        values[i] = create_int(i);
+    }
+    map_insert_batch(map, keys, 2 * N, values);
+    TEST_CHECK(map_size(map) == N);
+
+    // Keys [0, N) are part of the map, keys [N, 2N) are not.
+    int* queries = malloc(2 * N * sizeof(*queries));
+    void** query_keys = malloc(2 * N * sizeof(*query_keys));
+    for (int i = 0; i < 2 * N; i++) {
+        queries[i] = i;
+        query_keys[i] = &queries[i];
+    }
+
+    void** found = malloc(2 * N * sizeof(*found));
+    map_find_batch(map, query_keys, 2 * N, found);
+    for (int i = 0; i < N; i++) {
+        TEST_CHECK(found[i] != NULL && *(int*)found[i] == N + i);
+        TEST_CHECK(found[i] == map_find(map, query_keys[i]));
+    }
+    for (int i = N; i < 2 * N; i++) {
+        TEST_CHECK(found[i] == NULL);
+    }
+
+    // Batches shorter than the prefetch distance.
+    map_find_batch(map, &query_keys[5], 1, found);
+    TEST_CHECK(*(int*)found[0] == N + 5);
+    map_find_batch(map, query_keys, 0, found);
+
+    map_destroy(map);
+    free(keys);
+    free(values);
+    free(queries);
+    free(query_keys);
+    free(found);
+}
+
+/// @brief Hash function that maps every int to one of 4 hashes.
+///
+static unsigned int colliding_hash_int(void* value) { return *(int*)value % 4; }
+
+void test_colliding_hashes(void) {
+    Map map = map_create(compare_ints, free, free);
+    map_set_hash_function(map, colliding_hash_int);
+
+    // Keys with equal hashes are told apart by compare only.
+    int N = 200;
+    for (int i = 0; i < N; i++) {
+        map_insert(map, create_int(i), create_int(i));
+    }
+    TEST_CHECK(map_size(map) == N);
+
+    for (int i = 0; i < N; i += 2) {
+        TEST_CHECK(map_remove(map, &i));
+    }
+    for (int i = 0; i < N; i++) {
+        int* value = map_find(map, &i);
+        TEST_CHECK(i % 2 == 0 ? value == NULL : *value == i);
+    }
+
+    int visited = 0;
+    for (MapIterator iter = map_iter_begin(map); map_iter_valid(map, &iter);
+         map_iter_next(map, &iter)) {
+        visited++;
+    }
+    TEST_CHECK(visited == N / 2);
+
+    map_destroy(map);
+}
+
+/// @brief Checks that map holds exactly the keys [0, n) that step divides, each
+/// mapped to itself, visiting them with both kinds of traversal.
+///
+static void check_small_map(Map map, int n, int step) {
+    TEST_CHECK(map_size(map) == (size_t)((n + step - 1) / step));
+    for (int i = -1; i <= n; i++) {
+        int* value = map_find(map, &i);
+        bool present = i >= 0 && i < n && i % step == 0;
+        TEST_CHECK(present ? value != NULL && *value == i : value == NULL);
+    }
+
+    size_t visited = 0;
+    for (MapNode node = map_first(map); node != MAP_EOF; node = map_next(map, node)) {
+        TEST_CHECK(*(int*)map_node_key(map, node) % step == 0);
+        visited++;
+    }
+    TEST_CHECK(visited == map_size(map));
+
+    visited = 0;
+    for (MapIterator iter = map_iter_begin(map); map_iter_valid(map, &iter);
+         map_iter_next(map, &iter)) {
+        visited++;
+    }
+    TEST_CHECK(visited == map_size(map));
+}
+
+void test_small_maps(void) {
+    // Sizes around the point where an implementation may switch from storing a few elements
+    // inline to a table, and back when shrinking.
+    for (int n = 0; n <= 20; n++) {
+        Map map = map_create(compare_ints, free, free);
+        map_set_hash_function(map, hash_int);
+        for (int i = 0; i < n; i++) {
+            map_insert(map, create_int(i), create_int(i));
+        }
+        check_small_map(map, n, 1);
+
+        for (int i = 1; i < n; i += 2) {
+            TEST_CHECK(map_remove(map, &i));
+        }
+        check_small_map(map, n, 2);
+
+        map_shrink_to_fit(map);
+        check_small_map(map, n, 2);
+
+        for (int i = 1; i < n; i += 2) {
+            map_insert(map, create_int(i), create_int(i));
+        }
+        check_small_map(map, n, 1);
+
+        map_destroy(map);
+    }
+}
+
 TEST_LIST = {
     {"map_create", test_create},
     {"map_insert", test_insert},
     {"map_remove", test_remove},
     {"map_find", test_find},
     {"map_iterate", test_iterate},
+    {"map_iterate_while_finding", test_iterate_while_finding},
+    {"map_savings", test_savings},
+    {"map_iterator", test_iterator},
+    {"map_find_or_insert", test_find_or_insert},
+    {"map_update", test_update},
+    {"map_capacity", test_capacity},
+    {"map_batch", test_batch},
+    {"map_colliding_hashes", test_colliding_hashes},
+    {"map_small_maps", test_small_maps},
 
     {NULL, NULL}  // End of tests.
 };
\ No newline at end of file
@@ -0,0 +1,212 @@
+#include "mapped_map.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "acutest.h"
+#include "hash.h"
+
+#define PATH "mapped_map_test.map"
+
+static int compare_strings(const void *a, const void *b) {
+  return strcmp(a, b);
+}
+
+static size_t serialize_string(void *value, void *buffer, size_t size) {
+  size_t length = strlen(value);
+  if (length <= size)
+    memcpy(buffer, value, length);
+  return length;
+}
+
+static size_t serialize_int(void *value, void *buffer, size_t size) {
+  if (sizeof(int) <= size)
+    memcpy(buffer, value, sizeof(int));
+  return sizeof(int);
+}
+
+/// @brief Returns a map of the keys "key:0", ..., "key:<N - 1>" to the ints
+/// 0, ..., N - 1, with the keys and values allocated.
+///
+static Map create_map(int N) {
+  Map map = map_create(compare_strings, free, free);
+  map_set_hash_function(map, hash_string);
+  for (int i = 0; i < N; i++) {
+    char *key = malloc(32);
+    snprintf(key, 32, "key:%d", i);
+    int *value = malloc(sizeof(*value));
+    *value = i;
+    map_insert(map, key, value);
+  }
+  return map;
+}
+
+void test_save(void) {
+  Map map = create_map(0);
+  TEST_CHECK(map_save(map, PATH, serialize_string, serialize_int));
+  map_destroy(map);
+
+  MappedMap mapped = map_open_mmap(PATH);
+  TEST_ASSERT(mapped != NULL);
+  TEST_CHECK(mapped_map_size(mapped) == 0);
+
+  size_t size;
+  TEST_CHECK(mapped_map_find(mapped, "key:0", 5, &size) == NULL);
+
+  mapped_map_close(mapped);
+  remove(PATH);
+
+  // A directory that does not exist.
+  map = create_map(1);
+  TEST_CHECK(!map_save(map, "missing/" PATH, serialize_string, serialize_int));
+  map_destroy(map);
+}
+
+void test_find(void) {
+  int N = 10000;
+  Map map = create_map(N);
+  TEST_ASSERT(map_save(map, PATH, serialize_string, serialize_int));
+  map_destroy(map); // The file holds copies of the keys and values.
+
+  MappedMap mapped = map_open_mmap(PATH);
+  TEST_ASSERT(mapped != NULL);
+  TEST_CHECK(mapped_map_size(mapped) == (size_t)N);
+
+  char key[32];
+  for (int i = 0; i < N; i++) {
+    snprintf(key, sizeof(key), "key:%d", i);
+    size_t size = 0;
+    const int *value = mapped_map_find(mapped, key, strlen(key), &size);
+    TEST_ASSERT(value != NULL);
+    TEST_CHECK(size == sizeof(int) && *value == i);
+    TEST_CHECK((uintptr_t)value % 8 == 0);
+  }
+
+  size_t size;
+  for (int i = N; i < 2 * N; i++) {
+    snprintf(key, sizeof(key), "key:%d", i);
+    TEST_CHECK(mapped_map_find(mapped, key, strlen(key), &size) == NULL);
+  }
+  // A prefix of a key is another key.
+  TEST_CHECK(mapped_map_find(mapped, "key:1", 4, &size) == NULL);
+
+  mapped_map_close(mapped);
+  remove(PATH);
+}
+
+void test_replace(void) {
+  Map map = create_map(10);
+  TEST_ASSERT(map_save(map, PATH, serialize_string, serialize_int));
+  map_destroy(map);
+  MappedMap old = map_open_mmap(PATH);
+  TEST_ASSERT(old != NULL);
+
+  // Saving over an open file leaves its mapping unchanged.
+  map = create_map(20);
+  TEST_ASSERT(map_save(map, PATH, serialize_string, serialize_int));
+  map_destroy(map);
+  MappedMap new = map_open_mmap(PATH);
+  TEST_ASSERT(new != NULL);
+
+  size_t size;
+  TEST_CHECK(mapped_map_size(old) == 10);
+  TEST_CHECK(mapped_map_find(old, "key:15", 6, &size) == NULL);
+  TEST_CHECK(mapped_map_size(new) == 20);
+  TEST_CHECK(mapped_map_find(new, "key:15", 6, &size) != NULL);
+
+  mapped_map_close(old);
+  mapped_map_close(new);
+  remove(PATH);
+}
+
+void test_invalid_file(void) {
+  TEST_CHECK(map_open_mmap("missing.map") == NULL);
+
+  FILE *file = fopen(PATH, "wb");
+  TEST_ASSERT(file != NULL);
+  fputs("Not a map, but long enough to hold a header.\n", file);
+  fclose(file);
+  TEST_CHECK(map_open_mmap(PATH) == NULL);
+
+  // A file cut short.
+  Map map = create_map(100);
+  TEST_ASSERT(map_save(map, PATH, serialize_string, serialize_int));
+  map_destroy(map);
+  TEST_ASSERT(truncate(PATH, 200) == 0);
+  TEST_CHECK(map_open_mmap(PATH) == NULL);
+
+  remove(PATH);
+}
+
+/// @brief Overwrites size bytes at offset of the file at PATH.
+///
+static void file_write_at(long offset, const void *bytes, size_t size) {
+  FILE *file = fopen(PATH, "r+b");
+  TEST_ASSERT(file != NULL);
+  TEST_CHECK(fseek(file, offset, SEEK_SET) == 0);
+  TEST_CHECK(fwrite(bytes, 1, size, file) == size);
+  fclose(file);
+}
+
+void test_corrupt_file(void) {
+  // 4 elements, so 8 slots after the 40 bytes of the header.
+  Map map = create_map(4);
+  TEST_ASSERT(map_save(map, PATH, serialize_string, serialize_int));
+  map_destroy(map);
+
+  MappedMap mapped = map_open_mmap(PATH);
+  TEST_ASSERT(mapped != NULL);
+  uint64_t seed, file_size;
+  FILE *file = fopen(PATH, "rb");
+  TEST_ASSERT(file != NULL);
+  TEST_CHECK(fseek(file, 24, SEEK_SET) == 0);
+  TEST_CHECK(fread(&seed, sizeof(seed), 1, file) == 1);
+  TEST_CHECK(fread(&file_size, sizeof(file_size), 1, file) == 1);
+  fclose(file);
+  mapped_map_close(mapped);
+
+  // Every slot points past the end of the file, with the hash of "key:0":
+  // no empty slot ends the probes, and no record can be read.
+  uint64_t hash = hash_bytes("key:0", 5, seed);
+  uint64_t slots[16];
+  for (int i = 0; i < 8; i++) {
+    slots[2 * i] = hash;
+    slots[2 * i + 1] = file_size + 8;
+  }
+  file_write_at(40, slots, sizeof(slots));
+
+  size_t size;
+  mapped = map_open_mmap(PATH);
+  TEST_ASSERT(mapped != NULL);
+  TEST_CHECK(mapped_map_find(mapped, "key:0", 5, &size) == NULL);
+  TEST_CHECK(mapped_map_find(mapped, "key:9", 5, &size) == NULL);
+  mapped_map_close(mapped);
+
+  // Every slot points to the first record, whose key runs past the end.
+  uint64_t first_record = 40 + sizeof(slots);
+  for (int i = 0; i < 8; i++)
+    slots[2 * i + 1] = first_record;
+  file_write_at(40, slots, sizeof(slots));
+  uint32_t key_size = UINT32_MAX;
+  file_write_at(first_record, &key_size, sizeof(key_size));
+
+  mapped = map_open_mmap(PATH);
+  TEST_ASSERT(mapped != NULL);
+  TEST_CHECK(mapped_map_find(mapped, "key:0", 5, &size) == NULL);
+  mapped_map_close(mapped);
+
+  remove(PATH);
+}
+
+TEST_LIST = {
+    {"mapped_map_save", test_save},
+    {"mapped_map_find", test_find},
+    {"mapped_map_replace", test_replace},
+    {"mapped_map_invalid_file", test_invalid_file},
+    {"mapped_map_corrupt_file", test_corrupt_file},
+
+    {NULL, NULL} // End of tests.
+};
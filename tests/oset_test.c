@@ -1,6 +1,7 @@
 #include "oset.h"
 
-#include <stdlib.h> // malloc, free, sizeof, rand, RAND_MAX, size_t
+#include <pthread.h> // pthread_create, pthread_join
+#include <stdlib.h>  // malloc, free, sizeof, rand, RAND_MAX, size_t
 
 #include "acutest.h" // TEST_CHECK, TEST_LIST
 #include "test_companion.h"
@@ -22,6 +23,113 @@ void test_create(void) {
   oset_destroy(oset);
 }
 
+/// @brief Inserts keys 0, ..., 9999 in descending order to the given Ordered
+/// Set. Checks run in the main thread only.
+///
+static void *insert_descending(void *oset) {
+  for (int i = 9999; i >= 0; i--)
+    oset_insert(oset, create_int(i), NULL);
+
+  return NULL;
+}
+
+/// @brief Checks that oset holds keys 0, ..., 9999 in ascending order.
+///
+static void check_ascending(OrderedSet oset) {
+  int i = 0;
+  for (OrderedSetNode node = oset_first(oset); node != OSET_EOF;
+       node = oset_next(oset, node))
+    TEST_CHECK(*(int *)oset_node_key(oset, node) == i++);
+  TEST_CHECK(i == 10000);
+}
+
+/// @brief Number of calls to compare_counted().
+///
+static size_t compare_calls = 0;
+
+/// @brief Same as compare_ints(), and counts its calls, to observe the shape
+/// of a skip list through the number of comparisons of a search.
+///
+static int compare_counted(const void *a, const void *b) {
+  compare_calls++;
+  return compare_ints(a, b);
+}
+
+/// @brief Creates an Ordered Set with the given seed, inserts keys to it, and
+/// stores the number of comparisons oset_find() makes for each key to shape.
+///
+static void record_shape(uint64_t seed, int **keys, int N, size_t *shape) {
+  OrderedSet oset = oset_create_with_seed(compare_counted, NULL, NULL, seed);
+  TEST_CHECK(oset != NULL);
+  TEST_CHECK(oset_size(oset) == 0);
+
+  for (int i = 0; i < N; i++)
+    oset_insert(oset, keys[i], NULL);
+
+  for (int key = 0; key < N; key++) {
+    compare_calls = 0;
+    TEST_CHECK(oset_find_node(oset, &key) != OSET_EOF);
+    shape[key] = compare_calls;
+  }
+
+  oset_destroy(oset);
+}
+
+void test_create_with_seed(void) {
+  int N = 1000;
+
+  // Keys 0, ..., N - 1, inserted in the same random order to each set.
+  int **key_array = create_array(N, 1);
+  shuffle(key_array, N);
+
+  size_t *alpha = malloc(N * sizeof(*alpha));
+  size_t *beta = malloc(N * sizeof(*beta));
+  size_t *gamma = malloc(N * sizeof(*gamma));
+  record_shape(42, key_array, N, alpha);
+  record_shape(42, key_array, N, beta);
+  record_shape(43, key_array, N, gamma);
+
+  // The same seed gives the same levels, so each search takes the same path.
+  bool same = true;
+  for (int i = 0; i < N; i++)
+    same = same && alpha[i] == beta[i];
+  TEST_CHECK(same);
+
+  // Another seed gives other levels, and some search another path.
+  bool different = false;
+  for (int i = 0; i < N; i++)
+    different = different || alpha[i] != gamma[i];
+  TEST_CHECK(different);
+
+  for (int i = 0; i < N; i++)
+    free(key_array[i]);
+  free(key_array);
+  free(alpha);
+  free(beta);
+  free(gamma);
+}
+
+void test_create_with_seed_threads(void) {
+  OrderedSet alpha = oset_create_with_seed(compare_ints, free, NULL, 42);
+  OrderedSet beta = oset_create_with_seed(compare_ints, free, NULL, 42);
+
+  TEST_CHECK(alpha != NULL);
+  TEST_CHECK(beta != NULL);
+
+  // Each Ordered Set draws levels from its own generator, so threads can
+  // insert to different sets at the same time.
+  pthread_t thread;
+  pthread_create(&thread, NULL, insert_descending, alpha);
+  insert_descending(beta);
+  pthread_join(thread, NULL);
+
+  check_ascending(alpha);
+  check_ascending(beta);
+
+  oset_destroy(alpha);
+  oset_destroy(beta);
+}
+
 /// @brief Inserts (key, value) pair to oset and test for correct insertion.
 ///
 void insert_and_test(OrderedSet oset, void *key, void *value) {
@@ -259,6 +367,233 @@ void test_find(void) {
   free(value_array);
 }
 
+/// @brief Checks the positions of the nodes of oset against a traversal: each
+/// node is found by oset_get_at(), each key is ranked at its first node, and
+/// counted as often as it appears.
+///
+static void check_positions(OrderedSet oset) {
+  size_t i = 0, first = 0;
+  OrderedSetNode previous = OSET_BOF;
+  for (OrderedSetNode node = oset_first(oset); node != OSET_EOF;
+       node = oset_next(oset, node), i++) {
+    int *key = oset_node_key(oset, node);
+    if (previous != OSET_BOF &&
+        compare_ints(oset_node_key(oset, previous), key) != 0)
+      first = i;
+
+    TEST_CHECK(oset_get_at(oset, i) == node);
+    TEST_CHECK(oset_rank(oset, key) == first);
+    TEST_CHECK(oset_previous(oset, node) == previous);
+    previous = node;
+  }
+  TEST_CHECK(i == oset_size(oset));
+  TEST_CHECK(oset_last(oset) == (i > 0 ? previous : OSET_EOF));
+  TEST_CHECK(oset_get_at(oset, i) == OSET_EOF);
+
+  // Count each key, the nodes from its first to its last.
+  for (size_t j = 0; j < i; j = first) {
+    int *key = oset_node_key(oset, oset_get_at(oset, j));
+    for (first = j; first < i; first++)
+      if (compare_ints(oset_node_key(oset, oset_get_at(oset, first)), key))
+        break;
+    TEST_CHECK(oset_count_range(oset, key, key) == first - j);
+  }
+}
+
+void test_positions(void) {
+  OrderedSet oset = oset_create(compare_ints, free, NULL);
+
+  int N = 1000;
+
+  // Even keys 0, 2, ..., 2*(N-1), inserted in random order.
+  int **key_array = create_array(N, 2);
+  shuffle(key_array, N);
+  for (int i = 0; i < N; i++)
+    oset_insert(oset, key_array[i], NULL);
+
+  for (int i = 0; i < N; i++) {
+    TEST_CHECK(*(int *)oset_node_key(oset, oset_get_at(oset, i)) == 2 * i);
+
+    int key = 2 * i;
+    TEST_CHECK(oset_rank(oset, &key) == i);
+    key = 2 * i + 1; // Not part of oset.
+    TEST_CHECK(oset_rank(oset, &key) == i + 1);
+  }
+  TEST_CHECK(oset_get_at(oset, N) == OSET_EOF);
+
+  int lo = -1, hi = -1;
+  TEST_CHECK(oset_count_range(oset, &lo, &hi) == 0);
+  lo = 10, hi = 20; // 10, 12, ..., 20.
+  TEST_CHECK(oset_count_range(oset, &lo, &hi) == 6);
+  lo = 11, hi = 19;
+  TEST_CHECK(oset_count_range(oset, &lo, &hi) == 4);
+  TEST_CHECK(oset_count_range(oset, &hi, &lo) == 0);
+  lo = -5, hi = 2 * N;
+  TEST_CHECK(oset_count_range(oset, &lo, &hi) == N);
+
+  // Remove the keys that are multiples of 4, and insert duplicates of the
+  // others. Positions follow.
+  for (int i = 0; i < N; i += 2) {
+    int key = 2 * i;
+    TEST_CHECK(oset_remove(oset, &key));
+  }
+  for (int i = 1; i < N; i += 2)
+    oset_insert(oset, create_int(2 * i), NULL);
+  for (int i = 0; i < N; i++) {
+    int expected = 2 * (2 * (i / 2) + 1); // Each remaining key twice.
+    TEST_CHECK(*(int *)oset_node_key(oset, oset_get_at(oset, i)) == expected);
+  }
+  lo = 2, hi = 6;
+  TEST_CHECK(oset_count_range(oset, &lo, &hi) == 4);
+
+  // Split keeps positions on both sides.
+  int split_key = N;
+  OrderedSet split = oset_split(oset, &split_key);
+  TEST_CHECK(oset_size(oset) + oset_size(split) == N);
+  TEST_CHECK(oset_size(oset) == oset_rank(oset, &split_key));
+  for (size_t i = 0; i < oset_size(split); i++) {
+    int *key = oset_node_key(split, oset_get_at(split, i));
+    TEST_CHECK(*key > split_key);
+    TEST_CHECK(oset_rank(split, key) <= i);
+  }
+
+  check_positions(oset);
+  check_positions(split);
+
+  // A duplicate of the smallest key is the new first node.
+  size_t size;
+  int *smallest = create_int(*(int *)oset_node_key(oset, oset_first(oset)));
+  oset_insert(oset, smallest, NULL);
+  TEST_CHECK(oset_node_key(oset, oset_first(oset)) == smallest);
+  TEST_CHECK(oset_rank(oset, smallest) == 0);
+  TEST_CHECK(oset_count_range(oset, smallest, smallest) == 3);
+  check_positions(oset);
+
+  // Removing a node links its neighbours, in both directions.
+  size = oset_size(oset);
+  int removed = *(int *)oset_node_key(oset, oset_get_at(oset, 10));
+  TEST_CHECK(oset_remove(oset, &removed));
+  TEST_CHECK(oset_size(oset) == size - 1);
+  TEST_CHECK(oset_previous(oset, oset_get_at(oset, 10)) ==
+             oset_get_at(oset, 9));
+  check_positions(oset);
+
+  // Merge keeps the keys of both sets, duplicates included.
+  for (int i = 0; i < 100; i += 3)
+    oset_insert(split, create_int(2 * i), NULL);
+  size = oset_size(oset) + oset_size(split);
+  OrderedSet merged = oset_merge(oset, split);
+  TEST_CHECK(oset_size(merged) == size);
+  int key = 0;
+  TEST_CHECK(oset_count_range(merged, &key, &key) == 1);
+  key = 6; // Twice in oset, and once in split.
+  TEST_CHECK(oset_count_range(merged, &key, &key) == 3);
+  check_positions(merged);
+
+  // Split everything away, and concat it back.
+  key = -1;
+  split = oset_split(merged, &key);
+  TEST_CHECK(oset_size(merged) == 0);
+  TEST_CHECK(oset_first(merged) == OSET_BOF);
+  TEST_CHECK(oset_last(merged) == OSET_EOF);
+  TEST_CHECK(oset_size(split) == size);
+  check_positions(merged);
+  check_positions(split);
+
+  oset_concat(merged, split);
+  TEST_CHECK(oset_size(merged) == size);
+  check_positions(merged);
+
+  // Concat a set of greater keys, with duplicates of the last key.
+  OrderedSet greater = oset_create(compare_ints, free, NULL);
+  int largest = *(int *)oset_node_key(merged, oset_last(merged));
+  for (int i = 0; i < 100; i++)
+    oset_insert(greater, create_int(largest + i / 2), NULL);
+  oset_concat(merged, greater);
+  TEST_CHECK(oset_size(merged) == size + 100);
+  TEST_CHECK(oset_count_range(merged, &largest, &largest) == 2 + 2);
+  check_positions(merged);
+
+  // Concat an empty set.
+  OrderedSetNode last = oset_last(merged);
+  oset_concat(merged, oset_create(compare_ints, free, NULL));
+  TEST_CHECK(oset_last(merged) == last);
+  check_positions(merged);
+
+  oset_destroy(merged);
+
+  free(key_array);
+}
+
+/// @brief Keys visited by oset_range().
+///
+struct visited {
+  int keys[100];
+  int count;
+};
+
+/// @brief Appends key to the visited keys given as context.
+///
+static void visit(void *key, void *value, void *context) {
+  struct visited *visited = context;
+  if (visited->count < 100)
+    visited->keys[visited->count] = *(int *)key;
+  visited->count++;
+}
+
+void test_ranges(void) {
+  OrderedSet oset = oset_create(compare_ints, free, NULL);
+
+  int N = 1000;
+
+  // Even keys 0, 2, ..., 2*(N-1), inserted in random order.
+  int **key_array = create_array(N, 2);
+  shuffle(key_array, N);
+  for (int i = 0; i < N; i++)
+    oset_insert(oset, key_array[i], NULL);
+
+  for (int key = -1; key < 2 * N - 1; key++) {
+    int lower = key < 0 ? 0 : key + key % 2;     // Smallest even >= key.
+    int upper = key < 0 ? 0 : key + 2 - key % 2; // Smallest even > key.
+    TEST_CHECK(*(int *)oset_node_key(oset, oset_lower_bound(oset, &key)) ==
+               lower);
+    if (upper < 2 * N)
+      TEST_CHECK(*(int *)oset_node_key(oset, oset_upper_bound(oset, &key)) ==
+                 upper);
+  }
+  int key = 2 * N - 2; // Largest key.
+  TEST_CHECK(oset_upper_bound(oset, &key) == OSET_EOF);
+  key = 2 * N;
+  TEST_CHECK(oset_lower_bound(oset, &key) == OSET_EOF);
+
+  // Duplicates of key 10: lower bound is the newest, upper bound skips both.
+  int *duplicate = create_int(10);
+  oset_insert(oset, duplicate, NULL);
+  key = 10;
+  TEST_CHECK(oset_node_key(oset, oset_lower_bound(oset, &key)) == duplicate);
+  TEST_CHECK(*(int *)oset_node_key(oset, oset_upper_bound(oset, &key)) == 12);
+
+  struct visited visited = {.count = 0};
+  int lo = 7, hi = 20; // 8, 10, 10, 12, ..., 20.
+  TEST_CHECK(oset_range(oset, &lo, &hi, visit, &visited) == 8);
+  TEST_CHECK(visited.count == 8);
+  int expected[] = {8, 10, 10, 12, 14, 16, 18, 20};
+  for (int i = 0; i < 8; i++)
+    TEST_CHECK(visited.keys[i] == expected[i]);
+
+  visited.count = 0;
+  TEST_CHECK(oset_range(oset, &hi, &lo, visit, &visited) == 0);
+  lo = 2 * N, hi = 3 * N;
+  TEST_CHECK(oset_range(oset, &lo, &hi, visit, &visited) == 0);
+  lo = -N, hi = 3 * N;
+  TEST_CHECK(oset_range(oset, &lo, &hi, visit, &visited) == N + 1);
+  TEST_CHECK(visited.count == N + 1);
+
+  oset_destroy(oset);
+
+  free(key_array);
+}
+
 void test_split(void) {
   OrderedSet alpha = oset_create(compare_ints, free, free);
 
@@ -522,10 +857,14 @@ void test_concat(void) {
 
 TEST_LIST = {
     {"oset_create", test_create},
+    {"oset_create_with_seed", test_create_with_seed},
+    {"oset_create_with_seed_threads", test_create_with_seed_threads},
     {"oset_insert", test_insert},
     {"oset_remove", test_remove},
     {"oset_traversal", test_traversal},
     {"oset_find", test_find},
+    {"oset_positions", test_positions},
+    {"oset_ranges", test_ranges},
     {"oset_split", test_split},
     {"oset_merge", test_merge},
     {"oset_concat", test_concat},